@@ -0,0 +1,382 @@
+#include "ConfirmTracker.h"
+
+#include <amqpcpp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+
+/*
+ * Microbenchmark of the publisher confirm tracking of a channel: ConfirmTracker, fed by the onAck callback of
+ * confirmSelect as in SynchronousChannel, against the AMQP::Reliable<> it replaced. Both run on a real AMQP::Channel
+ * of a connection whose handler discards the frames written, the broker frames (handshake, then basic.ack) are
+ * parsed by the connection as if read from the socket. The frame encoding and parsing of AMQP-CPP are the same on
+ * both sides, the difference is the bookkeeping of the messages waiting for their confirm.
+ *
+ * The window is first filled with the in-flight messages, then each round publishes a batch and receives the confirm
+ * of the oldest batch, with the multiple flag or one confirm per message.
+ */
+
+namespace
+{
+    std::atomic<uint64_t> allocation_count__{ 0 };
+}
+
+void* operator new(std::size_t size)
+{
+    allocation_count__.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct BenchOptions
+    {
+        size_t in_flight_ = 10000;
+        size_t batch_size_ = 64;
+        uint64_t messages_ = 10000000;
+        bool is_multiple_ = true;
+    };
+
+    // Discards the frames written by the client, the broker side is played by LoopbackChannel
+    class DiscardingHandler : public AMQP::ConnectionHandler
+    {
+    public:
+        void onData(AMQP::Connection*, const char*, size_t) override
+        {
+        }
+
+        void onError(AMQP::Connection*, const char* message) override
+        {
+            std::cerr << "Connection error: " << message << "\n";
+        }
+    };
+
+    std::string methodFrame(uint16_t channel, uint16_t class_id, uint16_t method_id, const std::string& arguments)
+    {
+        std::string frame;
+        frame.push_back(1);
+        frame.push_back(static_cast<char>(channel >> 8));
+        frame.push_back(static_cast<char>(channel & 0xFF));
+        const auto size = static_cast<uint32_t>(4 + arguments.size());
+        for (int shift = 24; shift >= 0; shift -= 8)
+        {
+            frame.push_back(static_cast<char>((size >> shift) & 0xFF));
+        }
+        frame.push_back(static_cast<char>(class_id >> 8));
+        frame.push_back(static_cast<char>(class_id & 0xFF));
+        frame.push_back(static_cast<char>(method_id >> 8));
+        frame.push_back(static_cast<char>(method_id & 0xFF));
+        frame += arguments;
+        frame.push_back(static_cast<char>(0xCE));
+        return frame;
+    }
+
+    std::string bigEndian(uint64_t value, size_t size)
+    {
+        std::string bytes(size, '\0');
+        for (size_t index = 0; index < size; ++index)
+        {
+            bytes[size - 1 - index] = static_cast<char>((value >> (8 * index)) & 0xFF);
+        }
+        return bytes;
+    }
+
+    std::string longString(const std::string& value)
+    {
+        return bigEndian(value.size(), 4) + value;
+    }
+
+    /*
+     * One connection and its channel, opened by feeding the broker side of the handshake: connection.start, tune and
+     * open-ok, channel.open-ok then confirm.select-ok. The confirm mode must be requested before open is called.
+     */
+    class LoopbackChannel
+    {
+    public:
+        LoopbackChannel()
+            : connection_(&handler_, AMQP::Login("guest", "guest"), "/")
+            , channel_(&connection_)
+            , ack_frame_(methodFrame(1, 60, 80, std::string(9, '\0')))
+        {
+        }
+
+        AMQP::Channel& channel()
+        {
+            return channel_;
+        }
+
+        // Returns false when the connection didn't accept the handshake
+        bool open()
+        {
+            feed(methodFrame(0, 10, 10, std::string("\0\x09", 2) + longString("") + longString("PLAIN")
+                + longString("en_US")));
+            feed(methodFrame(0, 10, 30, bigEndian(2047, 2) + bigEndian(131072, 4) + bigEndian(0, 2)));
+            feed(methodFrame(0, 10, 41, std::string(1, '\0')));
+            feed(methodFrame(1, 20, 11, longString("")));
+            feed(methodFrame(1, 85, 11, ""));
+            return connection_.ready() && channel_.usable();
+        }
+
+        // basic.ack from the broker, the frame is rewritten in place
+        void ack(uint64_t delivery_tag, bool multiple)
+        {
+            constexpr size_t arguments_offset = 11;
+            for (size_t index = 0; index < 8; ++index)
+            {
+                ack_frame_[arguments_offset + 7 - index] = static_cast<char>((delivery_tag >> (8 * index)) & 0xFF);
+            }
+            ack_frame_[arguments_offset + 8] = multiple ? 1 : 0;
+            connection_.parse(ack_frame_.data(), ack_frame_.size());
+        }
+
+    private:
+        void feed(const std::string& frame)
+        {
+            connection_.parse(frame.data(), frame.size());
+        }
+
+        DiscardingHandler handler_;
+        AMQP::Connection connection_;
+        AMQP::Channel channel_;
+        std::string ack_frame_;
+    };
+
+    // Same payload as the messages of SynchronousChannel: completion state, body size and pickup time
+    struct TrackedMessage
+    {
+        uint64_t ticket_ = 0;
+        size_t body_size_ = 0;
+        Clock::time_point picked_up_at_;
+    };
+
+    struct RunResult
+    {
+        double nanoseconds_per_message_ = 0;
+        double allocations_per_message_ = 0;
+        // Messages confirmed over the whole run, warm up included
+        uint64_t confirmed_ = 0;
+    };
+
+    template <typename Publish, typename Confirm>
+    RunResult run(const BenchOptions& options, Publish publish, Confirm confirm)
+    {
+        uint64_t published = 0;
+        uint64_t confirmed = 0;
+        const auto publishBatch = [&]()
+        {
+            for (size_t index = 0; index < options.batch_size_; ++index)
+            {
+                publish(++published);
+            }
+        };
+        const auto confirmBatch = [&]()
+        {
+            if (options.is_multiple_)
+            {
+                confirmed += options.batch_size_;
+                confirm(confirmed, true);
+                return;
+            }
+            for (size_t index = 0; index < options.batch_size_; ++index)
+            {
+                confirm(++confirmed, false);
+            }
+        };
+
+        // Warm up: fills the window and runs a few rounds so the steady state doesn't grow anything
+        while (published < options.in_flight_)
+        {
+            publishBatch();
+        }
+        for (size_t round = 0; round < options.in_flight_ / options.batch_size_ + 1; ++round)
+        {
+            publishBatch();
+            confirmBatch();
+        }
+
+        const uint64_t first_published = published;
+        const uint64_t allocations_before = allocation_count__.load();
+        const auto started_at = Clock::now();
+        while (published - first_published < options.messages_)
+        {
+            publishBatch();
+            confirmBatch();
+        }
+        const auto elapsed = Clock::now() - started_at;
+        const auto messages = static_cast<double>(published - first_published);
+
+        RunResult result;
+        result.nanoseconds_per_message_ =
+            std::chrono::duration<double, std::nano>(elapsed).count() / messages;
+        result.allocations_per_message_ = (allocation_count__.load() - allocations_before) / messages;
+        result.confirmed_ = confirmed;
+        return result;
+    }
+
+    void printUsage()
+    {
+        std::cout << "Usage: amqpcpp-confirm-bench [--name=value]...\n"
+            << "  --in-flight=N    messages waiting for their confirm (10000)\n"
+            << "  --batch=N        messages published, then confirmed, per round (64)\n"
+            << "  --messages=N     messages measured (10000000)\n"
+            << "  --multiple=0|1   one confirm with the multiple flag per batch, or one per message (1)\n";
+    }
+
+    bool parseOptions(int argc, char** argv, BenchOptions& options)
+    {
+        for (int index = 1; index < argc; ++index)
+        {
+            const std::string argument(argv[index]);
+            const auto separator = argument.find('=');
+            if (argument.rfind("--", 0) != 0 || separator == std::string::npos)
+            {
+                return false;
+            }
+
+            const std::string name = argument.substr(2, separator - 2);
+            const uint64_t value = std::strtoull(argument.c_str() + separator + 1, nullptr, 10);
+            if (name == "in-flight")
+            {
+                options.in_flight_ = std::max<uint64_t>(value, 1);
+            }
+            else if (name == "batch")
+            {
+                options.batch_size_ = std::max<uint64_t>(value, 1);
+            }
+            else if (name == "messages")
+            {
+                options.messages_ = std::max<uint64_t>(value, 1);
+            }
+            else if (name == "multiple")
+            {
+                options.is_multiple_ = value != 0;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Returns false when the channel didn't settle every confirmed message
+    bool printResult(const std::string& name, const RunResult& result, uint64_t settled)
+    {
+        if (settled != result.confirmed_)
+        {
+            std::cerr << name << ": " << settled << " messages settled out of " << result.confirmed_ << "\n";
+            return false;
+        }
+        std::cout << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(1)
+            << std::setw(8) << result.nanoseconds_per_message_ << " ns/msg  " << std::setprecision(2)
+            << std::setw(6) << result.allocations_per_message_ << " allocations/msg\n";
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    using namespace RabbitMqStreamingPlugin;
+
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    std::cout << options.in_flight_ << " in flight, batches of " << options.batch_size_ << ", "
+        << (options.is_multiple_ ? "multiple" : "single") << " confirms\n";
+
+    const std::string body(64, 'a');
+    bool is_consistent = true;
+
+    uint64_t reliable_checksum = 0;
+    uint64_t reliable_settled = 0;
+    {
+        LoopbackChannel loopback;
+        AMQP::Reliable<> reliable(loopback.channel());
+        if (!loopback.open())
+        {
+            std::cerr << "The loopback channel failed to open\n";
+            return 1;
+        }
+
+        const auto result = run(options,
+            [&reliable, &body, &reliable_checksum, &reliable_settled](uint64_t ticket)
+        {
+            // Same captures as the confirm callback SynchronousChannel used to set
+            const auto picked_up_at = Clock::now();
+            reliable.publish("topic", "partition_key", AMQP::Envelope(body.data(), body.size()))
+                .onAck([&reliable_checksum, &reliable_settled, ticket, picked_up_at]()
+            {
+                reliable_checksum += ticket + (picked_up_at.time_since_epoch().count() & 1);
+                ++reliable_settled;
+            });
+        },
+            [&loopback](uint64_t delivery_tag, bool multiple)
+        {
+            loopback.ack(delivery_tag, multiple);
+        });
+        is_consistent &= printResult("Reliable<>", result, reliable_settled);
+    }
+
+    uint64_t tracker_checksum = 0;
+    uint64_t tracker_settled = 0;
+    {
+        LoopbackChannel loopback;
+        ConfirmTracker<TrackedMessage> tracker(options.in_flight_);
+        loopback.channel().confirmSelect()
+            .onAck([&tracker, &tracker_checksum, &tracker_settled](uint64_t delivery_tag, bool multiple)
+        {
+            tracker_settled += tracker.settle(delivery_tag, multiple, [&tracker_checksum](TrackedMessage& message)
+            {
+                tracker_checksum += message.ticket_ + (message.picked_up_at_.time_since_epoch().count() & 1);
+            });
+        });
+        if (!loopback.open())
+        {
+            std::cerr << "The loopback channel failed to open\n";
+            return 1;
+        }
+
+        const auto result = run(options,
+            [&loopback, &tracker, &body](uint64_t ticket)
+        {
+            loopback.channel().publish("topic", "partition_key", AMQP::Envelope(body.data(), body.size()));
+            tracker.push(TrackedMessage{ ticket, body.size(), Clock::now() });
+        },
+            [&loopback](uint64_t delivery_tag, bool multiple)
+        {
+            loopback.ack(delivery_tag, multiple);
+        });
+        is_consistent &= printResult("ConfirmTracker", result, tracker_settled);
+    }
+
+    // Keeps the callbacks from being optimized out
+    std::cout << "checksums " << (reliable_checksum & 0xFFFF) << " " << (tracker_checksum & 0xFFFF) << "\n";
+    return 0;
+}
@@ -0,0 +1,773 @@
+#include "FakeBroker.h"
+
+#include "Logging.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include <cstring>
+#include <deque>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+namespace RabbitMqStreamingPlugin
+{
+    namespace Bench
+    {
+        namespace FakeBrokerPrivate
+        {
+            constexpr uint8_t method_frame__ = 1;
+            constexpr uint8_t header_frame__ = 2;
+            constexpr uint8_t body_frame__ = 3;
+            constexpr uint8_t heartbeat_frame__ = 8;
+            constexpr uint8_t frame_end__ = 0xCE;
+            constexpr size_t frame_header_size__ = 7;
+
+            const char protocol_header__[] = { 'A', 'M', 'Q', 'P', 0, 0, 9, 1 };
+
+            uint16_t readUint16(const char* data)
+            {
+                const auto bytes = reinterpret_cast<const uint8_t*>(data);
+                return static_cast<uint16_t>((bytes[0] << 8) | bytes[1]);
+            }
+
+            uint32_t readUint32(const char* data)
+            {
+                const auto bytes = reinterpret_cast<const uint8_t*>(data);
+                return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | bytes[3];
+            }
+
+            uint64_t readUint64(const char* data)
+            {
+                return (uint64_t(readUint32(data)) << 32) | readUint32(data + 4);
+            }
+
+            void writeUint8(std::string& output, uint8_t value)
+            {
+                output.push_back(static_cast<char>(value));
+            }
+
+            void writeUint16(std::string& output, uint16_t value)
+            {
+                writeUint8(output, static_cast<uint8_t>(value >> 8));
+                writeUint8(output, static_cast<uint8_t>(value));
+            }
+
+            void writeUint32(std::string& output, uint32_t value)
+            {
+                writeUint16(output, static_cast<uint16_t>(value >> 16));
+                writeUint16(output, static_cast<uint16_t>(value));
+            }
+
+            void writeUint64(std::string& output, uint64_t value)
+            {
+                writeUint32(output, static_cast<uint32_t>(value >> 32));
+                writeUint32(output, static_cast<uint32_t>(value));
+            }
+
+            void writeShortString(std::string& output, const std::string& value)
+            {
+                writeUint8(output, static_cast<uint8_t>(value.size()));
+                output.append(value);
+            }
+
+            void writeLongString(std::string& output, const std::string& value)
+            {
+                writeUint32(output, static_cast<uint32_t>(value.size()));
+                output.append(value);
+            }
+
+            std::string readShortString(const char*& data)
+            {
+                const auto size = static_cast<uint8_t>(*data);
+                std::string value(data + 1, size);
+                data += 1 + size;
+                return value;
+            }
+
+            void writeMethodFrame(
+                std::string& output, uint16_t channel, uint16_t class_id, uint16_t method_id, const std::string& arguments)
+            {
+                writeUint8(output, method_frame__);
+                writeUint16(output, channel);
+                writeUint32(output, static_cast<uint32_t>(4 + arguments.size()));
+                writeUint16(output, class_id);
+                writeUint16(output, method_id);
+                output.append(arguments);
+                writeUint8(output, frame_end__);
+            }
+
+            // Header frame without any property, then the body in a single frame
+            void writeContentFrames(std::string& output, uint16_t channel, uint16_t class_id, const std::string& body)
+            {
+                writeUint8(output, header_frame__);
+                writeUint16(output, channel);
+                writeUint32(output, 14);
+                writeUint16(output, class_id);
+                writeUint16(output, 0); // weight
+                writeUint64(output, body.size());
+                writeUint16(output, 0); // property flags
+                writeUint8(output, frame_end__);
+
+                writeUint8(output, body_frame__);
+                writeUint16(output, channel);
+                writeUint32(output, static_cast<uint32_t>(body.size()));
+                output.append(body);
+                writeUint8(output, frame_end__);
+            }
+
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+            // Server context with a fresh P-256 key and a self-signed certificate for 127.0.0.1, valid for a day
+            std::unique_ptr<boost::asio::ssl::context> createSelfSignedTlsContext()
+            {
+                auto context = std::make_unique<boost::asio::ssl::context>(boost::asio::ssl::context::tls_server);
+
+                EVP_PKEY* key = nullptr;
+                EVP_PKEY_CTX* key_context = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+                X509* certificate = X509_new();
+                const bool is_generated = key_context != nullptr && certificate != nullptr
+                    && EVP_PKEY_keygen_init(key_context) > 0
+                    && EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_context, NID_X9_62_prime256v1) > 0
+                    && EVP_PKEY_keygen(key_context, &key) > 0;
+
+                bool is_signed = false;
+                if (is_generated)
+                {
+                    X509_set_version(certificate, 2);
+                    ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+                    X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+                    X509_gmtime_adj(X509_getm_notAfter(certificate), 24 * 60 * 60);
+                    X509_set_pubkey(certificate, key);
+                    X509_NAME* name = X509_get_subject_name(certificate);
+                    X509_NAME_add_entry_by_txt(
+                        name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("127.0.0.1"), -1, -1, 0);
+                    X509_set_issuer_name(certificate, name);
+                    is_signed = X509_sign(certificate, key, EVP_sha256()) > 0
+                        && SSL_CTX_use_certificate(context->native_handle(), certificate) == 1
+                        && SSL_CTX_use_PrivateKey(context->native_handle(), key) == 1;
+                }
+
+                X509_free(certificate);
+                EVP_PKEY_free(key);
+                EVP_PKEY_CTX_free(key_context);
+                if (!is_signed)
+                {
+                    throw std::runtime_error("FakeBroker error: Failed to create the self-signed certificate.");
+                }
+
+                const unsigned char session_id_context[] = "fake-broker";
+                SSL_CTX_set_session_id_context(
+                    context->native_handle(), session_id_context, sizeof(session_id_context) - 1);
+                return context;
+            }
+#endif
+        }  // namespace FakeBrokerPrivate
+
+        class FakeBrokerSession : public std::enable_shared_from_this<FakeBrokerSession>
+        {
+        public:
+            FakeBrokerSession(FakeBroker& broker, boost::asio::ip::tcp::socket socket)
+                : broker_(broker)
+                , socket_(std::move(socket))
+                , ack_timer_(socket_.get_executor())
+                , read_buffer_(64 * 1024)
+                , read_size_(0)
+                , has_protocol_header_(false)
+                , is_writing_(false)
+                , is_closing_(false)
+            {
+            }
+
+            void start()
+            {
+                boost::system::error_code ignored_error;
+                socket_.set_option(boost::asio::ip::tcp::no_delay(true), ignored_error);
+
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+                if (broker_.tlsContext() != nullptr)
+                {
+                    tls_stream_ = std::make_unique<TlsStream>(socket_, *broker_.tlsContext());
+                    auto self = shared_from_this();
+                    tls_stream_->async_handshake(boost::asio::ssl::stream_base::server,
+                        [this, self](boost::system::error_code ec)
+                    {
+                        if (ec)
+                        {
+                            close();
+                            return;
+                        }
+                        doRead();
+                    });
+                    return;
+                }
+#endif
+                doRead();
+            }
+
+            void close()
+            {
+                boost::system::error_code ignored_error;
+                ack_timer_.cancel(ignored_error);
+                socket_.close(ignored_error);
+            }
+
+        private:
+            struct ChannelState
+            {
+                bool is_confirming_ = false;
+                uint64_t delivery_tag_ = 0;
+                // Body bytes still expected for the message being received, and whether a message is being received
+                uint64_t remaining_body_size_ = 0;
+                uint64_t body_size_ = 0;
+                bool is_receiving_content_ = false;
+
+                // Consumer of the channel, deliveries are sent while fewer than the prefetch count are unsettled
+                std::string consumer_tag_;
+                std::string queue_;
+                uint16_t prefetch_count_ = 0;
+                uint64_t remaining_deliveries_ = 0;
+                uint64_t delivered_messages_ = 0;
+                std::set<uint64_t> unsettled_deliveries_;
+            };
+
+            struct PendingAck
+            {
+                std::chrono::steady_clock::time_point due_;
+                uint16_t channel_;
+                uint64_t delivery_tag_;
+            };
+
+            template <typename MutableBuffers, typename Handler>
+            void asyncReadSome(const MutableBuffers& buffers, Handler handler)
+            {
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+                if (tls_stream_)
+                {
+                    tls_stream_->async_read_some(buffers, std::move(handler));
+                    return;
+                }
+#endif
+                socket_.async_read_some(buffers, std::move(handler));
+            }
+
+            template <typename ConstBuffers, typename Handler>
+            void asyncWrite(const ConstBuffers& buffers, Handler handler)
+            {
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+                if (tls_stream_)
+                {
+                    boost::asio::async_write(*tls_stream_, buffers, std::move(handler));
+                    return;
+                }
+#endif
+                boost::asio::async_write(socket_, buffers, std::move(handler));
+            }
+
+            void doRead()
+            {
+                if (read_buffer_.size() - read_size_ < 4096)
+                {
+                    read_buffer_.resize(read_buffer_.size() * 2);
+                }
+
+                auto self = shared_from_this();
+                asyncReadSome(
+                    boost::asio::buffer(read_buffer_.data() + read_size_, read_buffer_.size() - read_size_),
+                    [this, self](boost::system::error_code ec, std::size_t length)
+                {
+                    if (ec)
+                    {
+                        close();
+                        return;
+                    }
+
+                    read_size_ += length;
+                    const size_t parsed = parse(read_buffer_.data(), read_size_);
+                    std::memmove(read_buffer_.data(), read_buffer_.data() + parsed, read_size_ - parsed);
+                    read_size_ -= parsed;
+
+                    sendDueAcks();
+                    if (!is_closing_)
+                    {
+                        doRead();
+                    }
+                });
+            }
+
+            size_t parse(const char* data, size_t size)
+            {
+                using namespace FakeBrokerPrivate;
+
+                size_t parsed = 0;
+                if (!has_protocol_header_)
+                {
+                    if (size < sizeof(protocol_header__))
+                    {
+                        return 0;
+                    }
+                    has_protocol_header_ = true;
+                    parsed = sizeof(protocol_header__);
+                    sendConnectionStart();
+                }
+
+                while (size - parsed >= frame_header_size__)
+                {
+                    const char* frame = data + parsed;
+                    const uint32_t payload_size = readUint32(frame + 3);
+                    const size_t frame_size = frame_header_size__ + payload_size + 1;
+                    if (size - parsed < frame_size)
+                    {
+                        break;
+                    }
+
+                    onFrame(static_cast<uint8_t>(frame[0]), readUint16(frame + 1), frame + frame_header_size__, payload_size);
+                    parsed += frame_size;
+                }
+                return parsed;
+            }
+
+            void onFrame(uint8_t type, uint16_t channel, const char* payload, uint32_t size)
+            {
+                using namespace FakeBrokerPrivate;
+
+                switch (type)
+                {
+                case method_frame__:
+                    onMethod(channel, readUint16(payload), readUint16(payload + 2), payload + 4, size - 4);
+                    break;
+                case header_frame__:
+                {
+                    auto& state = channels_[channel];
+                    state.body_size_ = readUint64(payload + 4);
+                    state.remaining_body_size_ = state.body_size_;
+                    if (state.remaining_body_size_ == 0)
+                    {
+                        onMessageReceived(channel, state);
+                    }
+                    break;
+                }
+                case body_frame__:
+                {
+                    auto& state = channels_[channel];
+                    state.remaining_body_size_ -= std::min<uint64_t>(size, state.remaining_body_size_);
+                    if (state.is_receiving_content_ && state.remaining_body_size_ == 0)
+                    {
+                        onMessageReceived(channel, state);
+                    }
+                    break;
+                }
+                case heartbeat_frame__:
+                    // Answered so the client sees traffic on an idle connection
+                    writeUint8(output_, heartbeat_frame__);
+                    writeUint16(output_, 0);
+                    writeUint32(output_, 0);
+                    writeUint8(output_, frame_end__);
+                    doWrite();
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            void onMethod(uint16_t channel, uint16_t class_id, uint16_t method_id, const char* arguments, uint32_t size)
+            {
+                using namespace FakeBrokerPrivate;
+
+                std::string response;
+                switch ((uint32_t(class_id) << 16) | method_id)
+                {
+                case (10 << 16) | 11: // connection.start-ok
+                    writeUint16(response, broker_.options().channel_max_);
+                    writeUint32(response, broker_.options().frame_max_);
+                    writeUint16(response, broker_.options().heartbeat_interval_);
+                    writeMethodFrame(output_, 0, 10, 30, response);
+                    break;
+                case (10 << 16) | 31: // connection.tune-ok
+                    break;
+                case (10 << 16) | 40: // connection.open
+                    writeShortString(response, "");
+                    writeMethodFrame(output_, 0, 10, 41, response);
+                    break;
+                case (10 << 16) | 50: // connection.close
+                    writeMethodFrame(output_, 0, 10, 51, response);
+                    is_closing_ = true;
+                    break;
+                case (10 << 16) | 51: // connection.close-ok
+                    is_closing_ = true;
+                    break;
+                case (20 << 16) | 10: // channel.open
+                    channels_[channel] = ChannelState();
+                    writeLongString(response, "");
+                    writeMethodFrame(output_, channel, 20, 11, response);
+                    break;
+                case (20 << 16) | 40: // channel.close
+                    channels_.erase(channel);
+                    writeMethodFrame(output_, channel, 20, 41, response);
+                    break;
+                case (60 << 16) | 10: // basic.qos
+                    // prefetch-size, then prefetch-count
+                    channels_[channel].prefetch_count_ = readUint16(arguments + 4);
+                    writeMethodFrame(output_, channel, 60, 11, response);
+                    break;
+                case (60 << 16) | 20: // basic.consume
+                {
+                    auto& state = channels_[channel];
+                    const char* argument = arguments + 2;
+                    state.queue_ = readShortString(argument);
+                    state.consumer_tag_ = readShortString(argument);
+                    if (state.consumer_tag_.empty())
+                    {
+                        state.consumer_tag_ = "ctag-" + std::to_string(channel);
+                    }
+                    // no-wait is the fourth bit
+                    if ((*argument & 8) == 0)
+                    {
+                        writeShortString(response, state.consumer_tag_);
+                        writeMethodFrame(output_, channel, 60, 21, response);
+                    }
+                    state.remaining_deliveries_ = broker_.options().deliveries_per_consumer_;
+                    deliverMessages(channel, state);
+                    break;
+                }
+                case (60 << 16) | 80: // basic.ack
+                    settleDeliveries(channel, readUint64(arguments), (arguments[8] & 1) != 0, false);
+                    break;
+                case (60 << 16) | 90: // basic.reject
+                    settleDeliveries(channel, readUint64(arguments), false, true);
+                    break;
+                case (60 << 16) | 40: // basic.publish
+                    channels_[channel].is_receiving_content_ = true;
+                    break;
+                case (85 << 16) | 10: // confirm.select
+                    channels_[channel].is_confirming_ = true;
+                    // The only argument is the nowait bit
+                    if (size == 0 || (arguments[0] & 1) == 0)
+                    {
+                        writeMethodFrame(output_, channel, 85, 11, response);
+                    }
+                    break;
+                default:
+                    STREAMER_LOG_DEBUG("FakeBroker: ignoring method ", class_id, ".", method_id, " on channel ", channel);
+                    break;
+                }
+                doWrite();
+            }
+
+            void sendConnectionStart()
+            {
+                using namespace FakeBrokerPrivate;
+
+                std::string arguments;
+                writeUint8(arguments, 0); // version major
+                writeUint8(arguments, 9); // version minor
+                writeUint32(arguments, 0); // empty server properties table
+                writeLongString(arguments, "PLAIN");
+                writeLongString(arguments, "en_US");
+                writeMethodFrame(output_, 0, 10, 10, arguments);
+                doWrite();
+            }
+
+            void onMessageReceived(uint16_t channel, ChannelState& state)
+            {
+                state.is_receiving_content_ = false;
+                broker_.onMessageReceived(state.body_size_);
+                if (state.is_confirming_)
+                {
+                    pending_acks_.push_back(PendingAck{
+                        std::chrono::steady_clock::now() + broker_.options().confirm_latency_, channel, ++state.delivery_tag_ });
+                }
+            }
+
+            void deliverMessages(uint16_t channel, ChannelState& state)
+            {
+                using namespace FakeBrokerPrivate;
+
+                while (state.remaining_deliveries_ > 0
+                    && (state.prefetch_count_ == 0 || state.unsettled_deliveries_.size() < state.prefetch_count_))
+                {
+                    const uint64_t delivery_tag = ++state.delivered_messages_;
+                    std::string arguments;
+                    writeShortString(arguments, state.consumer_tag_);
+                    writeUint64(arguments, delivery_tag);
+                    writeUint8(arguments, 0); // redelivered
+                    writeShortString(arguments, ""); // default exchange
+                    writeShortString(arguments, state.queue_);
+                    writeMethodFrame(output_, channel, 60, 60, arguments);
+                    writeContentFrames(output_, channel, 60, "message " + std::to_string(delivery_tag - 1));
+
+                    state.unsettled_deliveries_.insert(delivery_tag);
+                    --state.remaining_deliveries_;
+                }
+            }
+
+            void settleDeliveries(uint16_t channel, uint64_t delivery_tag, bool multiple, bool is_rejected)
+            {
+                auto& state = channels_[channel];
+                auto& unsettled = state.unsettled_deliveries_;
+                uint64_t count = 0;
+                if (multiple)
+                {
+                    const auto end = unsettled.upper_bound(delivery_tag);
+                    count = std::distance(unsettled.begin(), end);
+                    unsettled.erase(unsettled.begin(), end);
+                }
+                else
+                {
+                    count = unsettled.erase(delivery_tag);
+                }
+
+                broker_.onDeliveriesSettled(is_rejected ? 0 : count, is_rejected ? count : 0);
+                deliverMessages(channel, state);
+            }
+
+            void sendDueAcks()
+            {
+                using namespace FakeBrokerPrivate;
+
+                const auto now = std::chrono::steady_clock::now();
+
+                // Latest due delivery tag of every channel when acks are coalesced
+                std::map<uint16_t, uint64_t> multiple_acks;
+                while (!pending_acks_.empty() && pending_acks_.front().due_ <= now)
+                {
+                    const auto& ack = pending_acks_.front();
+                    if (broker_.options().ack_multiple_)
+                    {
+                        multiple_acks[ack.channel_] = ack.delivery_tag_;
+                    }
+                    else
+                    {
+                        writeAck(ack.channel_, ack.delivery_tag_, false);
+                    }
+                    pending_acks_.pop_front();
+                }
+                for (const auto& [channel, delivery_tag] : multiple_acks)
+                {
+                    writeAck(channel, delivery_tag, true);
+                }
+                doWrite();
+
+                if (!pending_acks_.empty())
+                {
+                    auto self = shared_from_this();
+                    ack_timer_.expires_at(pending_acks_.front().due_);
+                    ack_timer_.async_wait([this, self](boost::system::error_code ec)
+                    {
+                        if (!ec)
+                        {
+                            sendDueAcks();
+                        }
+                    });
+                }
+            }
+
+            void writeAck(uint16_t channel, uint64_t delivery_tag, bool multiple)
+            {
+                using namespace FakeBrokerPrivate;
+
+                std::string arguments;
+                writeUint64(arguments, delivery_tag);
+                writeUint8(arguments, multiple ? 1 : 0);
+                writeMethodFrame(output_, channel, 60, 80, arguments);
+            }
+
+            void doWrite()
+            {
+                if (is_writing_ || output_.empty())
+                {
+                    if (is_closing_ && !is_writing_)
+                    {
+                        close();
+                    }
+                    return;
+                }
+
+                is_writing_ = true;
+                writing_.swap(output_);
+                output_.clear();
+
+                auto self = shared_from_this();
+                asyncWrite(boost::asio::buffer(writing_),
+                    [this, self](boost::system::error_code ec, std::size_t)
+                {
+                    is_writing_ = false;
+                    if (ec)
+                    {
+                        close();
+                        return;
+                    }
+                    doWrite();
+                });
+            }
+
+            FakeBroker& broker_;
+            boost::asio::ip::tcp::socket socket_;
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+            using TlsStream = boost::asio::ssl::stream<boost::asio::ip::tcp::socket&>;
+            std::unique_ptr<TlsStream> tls_stream_;
+#endif
+            boost::asio::steady_timer ack_timer_;
+
+            std::vector<char> read_buffer_;
+            size_t read_size_;
+            std::string output_;
+            std::string writing_;
+
+            std::map<uint16_t, ChannelState> channels_;
+            std::deque<PendingAck> pending_acks_;
+            bool has_protocol_header_;
+            bool is_writing_;
+            bool is_closing_;
+        };
+
+        FakeBroker::FakeBroker(const FakeBrokerOptions& options)
+            : options_(options)
+            , acceptor_(io_service_, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0))
+            , received_messages_(0)
+            , received_body_bytes_(0)
+            , acked_deliveries_(0)
+            , rejected_deliveries_(0)
+        {
+            if (options_.use_tls_)
+            {
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+                tls_context_ = FakeBrokerPrivate::createSelfSignedTlsContext();
+#else
+                throw std::runtime_error("FakeBroker error: Built without TLS.");
+#endif
+            }
+
+            doAccept();
+            thread_ = std::thread([this]()
+            {
+                run();
+            });
+        }
+
+        FakeBroker::~FakeBroker()
+        {
+            io_service_.post([this]()
+            {
+                boost::system::error_code ignored_error;
+                acceptor_.close(ignored_error);
+                for (const auto& session : sessions_)
+                {
+                    if (auto locked_session = session.lock())
+                    {
+                        locked_session->close();
+                    }
+                }
+                io_service_.stop();
+            });
+            thread_.join();
+        }
+
+        uint16_t FakeBroker::port() const
+        {
+            return acceptor_.local_endpoint().port();
+        }
+
+        uint64_t FakeBroker::receivedMessages() const
+        {
+            return received_messages_.load(std::memory_order_relaxed);
+        }
+
+        uint64_t FakeBroker::receivedBodyBytes() const
+        {
+            return received_body_bytes_.load(std::memory_order_relaxed);
+        }
+
+        uint64_t FakeBroker::ackedDeliveries() const
+        {
+            return acked_deliveries_.load(std::memory_order_relaxed);
+        }
+
+        uint64_t FakeBroker::rejectedDeliveries() const
+        {
+            return rejected_deliveries_.load(std::memory_order_relaxed);
+        }
+
+        std::chrono::nanoseconds FakeBroker::threadCpuTime() const
+        {
+#if defined(__linux__)
+            clockid_t clock_id;
+            timespec time;
+            if (pthread_getcpuclockid(const_cast<std::thread&>(thread_).native_handle(), &clock_id) == 0
+                && clock_gettime(clock_id, &time) == 0)
+            {
+                return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+            }
+#endif
+            return std::chrono::nanoseconds(0);
+        }
+
+        void FakeBroker::dropConnections()
+        {
+            io_service_.post([this]()
+            {
+                for (const auto& session : sessions_)
+                {
+                    if (auto locked_session = session.lock())
+                    {
+                        locked_session->close();
+                    }
+                }
+                sessions_.clear();
+            });
+        }
+
+        const FakeBrokerOptions& FakeBroker::options() const
+        {
+            return options_;
+        }
+
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+        boost::asio::ssl::context* FakeBroker::tlsContext()
+        {
+            return tls_context_.get();
+        }
+#endif
+
+        void FakeBroker::onMessageReceived(uint64_t body_size)
+        {
+            received_messages_.fetch_add(1, std::memory_order_relaxed);
+            received_body_bytes_.fetch_add(body_size, std::memory_order_relaxed);
+        }
+
+        void FakeBroker::onDeliveriesSettled(uint64_t acked, uint64_t rejected)
+        {
+            acked_deliveries_.fetch_add(acked, std::memory_order_relaxed);
+            rejected_deliveries_.fetch_add(rejected, std::memory_order_relaxed);
+        }
+
+        void FakeBroker::doAccept()
+        {
+            acceptor_.async_accept([this](boost::system::error_code ec, boost::asio::ip::tcp::socket socket)
+            {
+                if (ec)
+                {
+                    return;
+                }
+
+                auto session = std::make_shared<FakeBrokerSession>(*this, std::move(socket));
+                sessions_.push_back(session);
+                session->start();
+                doAccept();
+            });
+        }
+
+        void FakeBroker::run()
+        {
+            if (options_.on_thread_start_)
+            {
+                options_.on_thread_start_();
+            }
+            io_service_.run();
+        }
+
+    }  // namespace Bench
+}  // namespace RabbitMqStreamingPlugin
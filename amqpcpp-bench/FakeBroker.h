@@ -0,0 +1,104 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+#include <boost/asio/ssl.hpp>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RabbitMqStreamingPlugin
+{
+    namespace Bench
+    {
+        class FakeBrokerSession;
+
+        struct FakeBrokerOptions
+        {
+            // Delay between the reception of a message and its publisher confirm
+            std::chrono::microseconds confirm_latency_{ 0 };
+            // Confirm every ready message of a channel with a single basic.ack using the multiple flag
+            bool ack_multiple_ = true;
+            uint32_t frame_max_ = 131072;
+            uint16_t channel_max_ = 2047;
+            // Heartbeat interval proposed in connection.tune, in seconds, 0 proposes none
+            uint16_t heartbeat_interval_ = 0;
+            // Accepts amqps connections only, with a self-signed certificate generated at startup
+            bool use_tls_ = false;
+            // Messages delivered to every consumer, with the bodies "message 0", "message 1"... within the basic.qos
+            // prefetch of its channel
+            uint64_t deliveries_per_consumer_ = 0;
+            // Called on the broker thread before it starts, e.g. to exclude it from allocation counting
+            std::function<void()> on_thread_start_;
+        };
+
+        /*
+         * FakeBroker is a loopback stand-in for RabbitMQ speaking just enough AMQP 0-9-1 for the streamer:
+         * connection handshake (any credentials are accepted), channel open and close, confirm.select and basic.qos,
+         * basic.publish with its content frames, and publisher confirms sent after a configurable latency.
+         * Published messages are counted and dropped, heartbeats are answered with a heartbeat. Consumers of any
+         * queue receive generated messages, their acks and rejects are counted.
+         *
+         * It runs its own io_service on a dedicated thread, listening on an ephemeral port of 127.0.0.1.
+         * With TLS, the clients must not verify the certificate. Sessions are resumable with tickets or session ids.
+         */
+        class FakeBroker
+        {
+        public:
+            explicit FakeBroker(const FakeBrokerOptions& options);
+            ~FakeBroker();
+
+            FakeBroker(const FakeBroker&) = delete;
+            FakeBroker& operator=(const FakeBroker&) = delete;
+
+            uint16_t port() const;
+
+            uint64_t receivedMessages() const;
+            uint64_t receivedBodyBytes() const;
+            // Deliveries settled by the consumers, a rejected delivery isn't requeued
+            uint64_t ackedDeliveries() const;
+            uint64_t rejectedDeliveries() const;
+            // CPU time used by the broker thread, 0 when the platform can't measure it
+            std::chrono::nanoseconds threadCpuTime() const;
+
+            // Closes the sockets of the connected clients without closing the AMQP connections, as a lost network would
+            void dropConnections();
+
+            const FakeBrokerOptions& options() const;
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+            // Null without TLS
+            boost::asio::ssl::context* tlsContext();
+#endif
+
+            // Called by the sessions
+            void onMessageReceived(uint64_t body_size);
+            void onDeliveriesSettled(uint64_t acked, uint64_t rejected);
+
+        private:
+            void doAccept();
+            void run();
+
+            const FakeBrokerOptions options_;
+            boost::asio::io_service io_service_;
+            boost::asio::ip::tcp::acceptor acceptor_;
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+            std::unique_ptr<boost::asio::ssl::context> tls_context_;
+#endif
+            std::vector<std::weak_ptr<FakeBrokerSession>> sessions_;
+
+            std::atomic<uint64_t> received_messages_;
+            std::atomic<uint64_t> received_body_bytes_;
+            std::atomic<uint64_t> acked_deliveries_;
+            std::atomic<uint64_t> rejected_deliveries_;
+            std::thread thread_;
+        };
+
+    }  // namespace Bench
+}  // namespace RabbitMqStreamingPlugin
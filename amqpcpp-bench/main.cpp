@@ -0,0 +1,658 @@
+#include "FakeBroker.h"
+
+#include "AmqpCppStreamer.h"
+#include "HandlerAllocator.h"
+#include "StreamerMetrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Every heap allocation of the process is counted, on the producer threads apart from the others (IO threads,
+    // worker pools), except on the threads that opted out (the fake broker)
+    std::atomic<uint64_t> producer_allocation_count__(0);
+    std::atomic<uint64_t> allocation_count__(0);
+    thread_local std::atomic<uint64_t>* allocation_counter__ = &allocation_count__;
+
+    std::atomic<uint64_t> failed_handler_publishes__(0);
+
+    void* countedAllocation(std::size_t size)
+    {
+        if (allocation_counter__ != nullptr)
+        {
+            allocation_counter__->fetch_add(1, std::memory_order_relaxed);
+        }
+        if (void* memory = std::malloc(size > 0 ? size : 1))
+        {
+            return memory;
+        }
+        throw std::bad_alloc();
+    }
+
+    void* countedAlignedAllocation(std::size_t size, std::align_val_t alignment)
+    {
+        if (allocation_counter__ != nullptr)
+        {
+            allocation_counter__->fetch_add(1, std::memory_order_relaxed);
+        }
+        const auto align = static_cast<std::size_t>(alignment);
+#if defined(_WIN32)
+        void* memory = _aligned_malloc(size > 0 ? size : 1, align);
+#else
+        // aligned_alloc takes a multiple of the alignment
+        void* memory = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align);
+#endif
+        if (memory != nullptr)
+        {
+            return memory;
+        }
+        throw std::bad_alloc();
+    }
+
+    void alignedFree(void* memory)
+    {
+#if defined(_WIN32)
+        _aligned_free(memory);
+#else
+        std::free(memory);
+#endif
+    }
+
+    struct BenchOptions
+    {
+        uint64_t messages_ = 100000;
+        size_t message_size_ = 500;
+        size_t producers_ = 1;
+        size_t batch_size_ = 1;
+        bool is_async_ = false;
+        bool uses_template_ = false;
+        bool is_zero_copy_ = false;
+        bool uses_handler_ = false;
+        // Reconnections before the run, to measure the resumed TLS handshakes
+        size_t tls_reconnects_ = 0;
+        int first_io_cpu_ = -1;
+        RabbitMqStreamingPlugin::StreamerOptions streamer_options_;
+        RabbitMqStreamingPlugin::Bench::FakeBrokerOptions broker_options_;
+    };
+
+    void printUsage()
+    {
+        std::cout << "Usage: amqpcpp-bench [--name=value]...\n"
+            << "  --messages=N            messages published in total (100000)\n"
+            << "  --size=BYTES            message body size (500)\n"
+            << "  --producers=N           publishing threads (1)\n"
+            << "  --batch=N               messages per publishBatch call, 1 uses publish (1)\n"
+            << "  --async=0|1             use publishAsync and flush at the end (0)\n"
+            << "  --handler=0|1           use asyncPublish with a callback bound to a HandlerMemory, never blocking (0)\n"
+            << "  --template=0|1          publish with a PublishTemplate instead of the topic, key and type (0)\n"
+            << "  --zero-copy=0|1         share a single payload buffer instead of copying it for each message (0)\n"
+            << "  --window=N              max in-flight messages per channel (1)\n"
+            << "  --channels=N            channels per connection (1)\n"
+            << "  --connections=N         connections, each with its own IO thread (1)\n"
+            << "  --max-pending=N         flow control high watermark in messages, resumes at half, 0 disables (0)\n"
+            << "  --ready-channels=N      channels open and in confirm mode before connect returns (0)\n"
+            << "  --round-robin=0|1       spread messages round robin instead of by partition key (0)\n"
+            << "  --aggregate=N           asyncPublishAggregated with up to N messages per container, 0 disables (0)\n"
+            << "  --compress=0|1|2        compress the bodies: 0 none, 1 zlib, 2 zstd (0)\n"
+            << "  --compress-level=N      compression level, 0 for the algorithm default (0)\n"
+            << "  --compress-threads=N    threads compressing the asyncPublish bodies, 0 compresses on the caller (0)\n"
+            << "  --low-latency=0|1       spinning IO threads, TCP_NODELAY and SO_BUSY_POLL (0)\n"
+            << "  --spin-us=N             IO thread spin budget before a blocking wait, overrides --low-latency (0)\n"
+            << "  --io-cpus=N             pins the IO thread of connection i to CPU N + i, -1 leaves them unpinned (-1)\n"
+            << "  --heartbeat-s=N         heartbeat interval proposed by the fake broker and the streamer, 0 disables (0)\n"
+            << "  --tls=0|1               amqps with a self-signed certificate, not verified by the streamer (0)\n"
+            << "  --tls-reconnects=N      reconnections before the run, resuming the TLS session (0)\n"
+            << "  --confirm-latency-us=N  delay of the fake broker confirms (0)\n"
+            << "  --ack-multiple=0|1      fake broker coalesces confirms with the multiple flag (1)\n";
+    }
+
+    bool parseOptions(int argc, char** argv, BenchOptions& options)
+    {
+        for (int index = 1; index < argc; ++index)
+        {
+            const std::string argument(argv[index]);
+            const auto separator = argument.find('=');
+            if (argument.rfind("--", 0) != 0 || separator == std::string::npos)
+            {
+                return false;
+            }
+
+            const std::string name = argument.substr(2, separator - 2);
+            const uint64_t value = std::strtoull(argument.c_str() + separator + 1, nullptr, 10);
+            if (name == "messages")
+            {
+                options.messages_ = value;
+            }
+            else if (name == "size")
+            {
+                options.message_size_ = value;
+            }
+            else if (name == "producers")
+            {
+                options.producers_ = std::max<uint64_t>(value, 1);
+            }
+            else if (name == "batch")
+            {
+                options.batch_size_ = std::max<uint64_t>(value, 1);
+            }
+            else if (name == "async")
+            {
+                options.is_async_ = value != 0;
+            }
+            else if (name == "handler")
+            {
+                options.uses_handler_ = value != 0;
+            }
+            else if (name == "template")
+            {
+                options.uses_template_ = value != 0;
+            }
+            else if (name == "zero-copy")
+            {
+                options.is_zero_copy_ = value != 0;
+            }
+            else if (name == "window")
+            {
+                options.streamer_options_.channel_.max_in_flight_messages_ = value;
+            }
+            else if (name == "channels")
+            {
+                options.streamer_options_.channel_count_ = value;
+            }
+            else if (name == "connections")
+            {
+                options.streamer_options_.connection_count_ = value;
+            }
+            else if (name == "max-pending")
+            {
+                options.streamer_options_.flow_control_.high_watermark_messages_ = value;
+                options.streamer_options_.flow_control_.low_watermark_messages_ = value / 2;
+            }
+            else if (name == "round-robin")
+            {
+                options.streamer_options_.routing_ = value != 0
+                    ? RabbitMqStreamingPlugin::PublishRouting::RoundRobin
+                    : RabbitMqStreamingPlugin::PublishRouting::PartitionKey;
+            }
+            else if (name == "aggregate")
+            {
+                options.streamer_options_.aggregation_.is_enabled_ = value > 0;
+                options.streamer_options_.aggregation_.max_messages_ = value;
+            }
+            else if (name == "compress")
+            {
+                options.streamer_options_.compression_.algorithm_ =
+                    static_cast<RabbitMqStreamingPlugin::CompressionAlgorithm>(std::min<uint64_t>(value, 2));
+            }
+            else if (name == "compress-level")
+            {
+                options.streamer_options_.compression_.level_ = static_cast<int>(value);
+            }
+            else if (name == "compress-threads")
+            {
+                options.streamer_options_.compression_.worker_threads_ = value;
+            }
+            else if (name == "ready-channels")
+            {
+                options.streamer_options_.ready_channels_ = value;
+            }
+            else if (name == "low-latency")
+            {
+                auto& handler_options = options.streamer_options_.handler_;
+                handler_options.tcp_no_delay_ = value != 0;
+                handler_options.socket_busy_poll_ = std::chrono::microseconds(value != 0 ? 50 : 0);
+                options.streamer_options_.io_spin_budget_ = std::chrono::microseconds(value != 0 ? 200 : 0);
+            }
+            else if (name == "spin-us")
+            {
+                options.streamer_options_.io_spin_budget_ = std::chrono::microseconds(value);
+            }
+            else if (name == "io-cpus")
+            {
+                options.first_io_cpu_ = std::atoi(argument.c_str() + separator + 1);
+            }
+            else if (name == "heartbeat-s")
+            {
+                options.broker_options_.heartbeat_interval_ = static_cast<uint16_t>(std::min<uint64_t>(value, 0xFFFF));
+                options.streamer_options_.handler_.heartbeat_interval_ = std::chrono::seconds(value);
+            }
+            else if (name == "tls")
+            {
+                options.broker_options_.use_tls_ = value != 0;
+                options.streamer_options_.tls_.is_enabled_ = value != 0;
+                options.streamer_options_.tls_.verify_peer_ = false;
+            }
+            else if (name == "tls-reconnects")
+            {
+                options.tls_reconnects_ = value;
+            }
+            else if (name == "confirm-latency-us")
+            {
+                options.broker_options_.confirm_latency_ = std::chrono::microseconds(value);
+            }
+            else if (name == "ack-multiple")
+            {
+                options.broker_options_.ack_multiple_ = value != 0;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void printHistogram(const std::string& name, const RabbitMqStreamingPlugin::HistogramSnapshot& histogram)
+    {
+        const auto microseconds = [](uint64_t nanoseconds)
+        {
+            return nanoseconds / 1000.0;
+        };
+
+        std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(1)
+            << " count " << std::setw(9) << histogram.count_
+            << "  p50 " << std::setw(9) << microseconds(histogram.valueAtPercentile(50))
+            << "  p90 " << std::setw(9) << microseconds(histogram.valueAtPercentile(90))
+            << "  p99 " << std::setw(9) << microseconds(histogram.valueAtPercentile(99))
+            << "  p99.9 " << std::setw(9) << microseconds(histogram.valueAtPercentile(99.9))
+            << "  max " << std::setw(9) << microseconds(histogram.max_) << " us\n";
+    }
+
+    void runProducer(
+        RabbitMqStreamingPlugin::AmqpCppStreamer& streamer,
+        const BenchOptions& options,
+        size_t producer_index,
+        uint64_t message_count,
+        RabbitMqStreamingPlugin::LatencyHistogram& call_latency)
+    {
+        using RabbitMqStreamingPlugin::MetricsClock;
+
+        const std::string topic = "topic";
+        const std::string partition_key = "po=amqpcpp-bench-" + std::to_string(producer_index);
+        const std::string event_type_name = "event_type_name";
+        const std::string message(options.message_size_, 'a');
+        const auto shared_message = std::make_shared<const std::string>(message);
+        const auto message_body = [&options, &message, &shared_message]()
+        {
+            return options.is_zero_copy_
+                ? RabbitMqStreamingPlugin::MessageBody(shared_message)
+                : RabbitMqStreamingPlugin::MessageBody(message);
+        };
+        const auto publish_template = streamer.createPublishTemplate(topic, partition_key, event_type_name);
+        // The completion callbacks are allocated from it, as would an application publishing at a high rate
+        const auto handler_memory = RabbitMqStreamingPlugin::HandlerMemory::create(256, 4096);
+
+        uint64_t published = 0;
+        while (published < message_count)
+        {
+            const auto started_at = MetricsClock::now();
+            if (options.batch_size_ > 1)
+            {
+                const auto batch_size = std::min<uint64_t>(options.batch_size_, message_count - published);
+                std::vector<RabbitMqStreamingPlugin::OutgoingMessage> batch;
+                batch.reserve(batch_size);
+                for (uint64_t index = 0; index < batch_size; ++index)
+                {
+                    batch.push_back({ topic, partition_key, event_type_name, message_body() });
+                }
+                const auto report = streamer.publishBatch(std::move(batch));
+                if (!report.succeeded())
+                {
+                    throw std::runtime_error(report.failures_.front().second);
+                }
+                published += batch_size;
+            }
+            else if (options.uses_handler_ || options.streamer_options_.aggregation_.is_enabled_)
+            {
+                const auto on_published = [](std::exception_ptr exception)
+                {
+                    if (exception != nullptr)
+                    {
+                        failed_handler_publishes__.fetch_add(1, std::memory_order_relaxed);
+                    }
+                };
+                if (options.streamer_options_.aggregation_.is_enabled_)
+                {
+                    streamer.asyncPublishAggregated(
+                        topic, partition_key, event_type_name, message_body(), on_published);
+                }
+                else
+                {
+                    streamer.asyncPublish(topic, partition_key, event_type_name, message_body(),
+                        RabbitMqStreamingPlugin::bindHandlerMemory(*handler_memory, on_published));
+                }
+                ++published;
+            }
+            else if (options.uses_template_)
+            {
+                if (options.is_async_)
+                {
+                    streamer.publishAsync(publish_template, message_body());
+                }
+                else
+                {
+                    streamer.publish(publish_template, message_body());
+                }
+                ++published;
+            }
+            else if (options.is_async_)
+            {
+                streamer.publishAsync(topic, partition_key, event_type_name, message_body());
+                ++published;
+            }
+            else
+            {
+                streamer.publish(topic, partition_key, event_type_name, message_body());
+                ++published;
+            }
+            call_latency.recordSince(started_at);
+        }
+    }
+}  // namespace
+
+void* operator new(std::size_t size)
+{
+    return countedAllocation(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return countedAllocation(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+// The nothrow and aligned forms are counted too, the standard library doesn't route all of them to the ones above
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return countedAllocation(size);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    return countedAlignedAllocation(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return countedAlignedAllocation(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return countedAlignedAllocation(size, alignment);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return operator new(size, alignment, std::nothrow);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+    alignedFree(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept
+{
+    alignedFree(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept
+{
+    alignedFree(memory);
+}
+
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept
+{
+    alignedFree(memory);
+}
+
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    alignedFree(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    alignedFree(memory);
+}
+
+int main(int argc, char** argv)
+{
+    using namespace RabbitMqStreamingPlugin;
+
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    if (options.first_io_cpu_ >= 0)
+    {
+        const size_t connection_count = std::max<size_t>(options.streamer_options_.connection_count_, 1);
+        for (size_t index = 0; index < connection_count; ++index)
+        {
+            options.streamer_options_.io_thread_cpus_.push_back(options.first_io_cpu_ + static_cast<int>(index));
+        }
+    }
+
+    options.broker_options_.on_thread_start_ = []()
+    {
+        allocation_counter__ = nullptr;
+    };
+    Bench::FakeBroker broker(options.broker_options_);
+
+    std::exception_ptr exception = nullptr;
+    std::mutex exception_mutex;
+    auto error_callback = [&exception, &exception_mutex](std::exception_ptr new_exception)
+    {
+        std::unique_lock lock(exception_mutex);
+        exception = new_exception;
+    };
+
+    const RabbitMqServerConfig server_config{ "127.0.0.1", broker.port(), "/", "guest", "guest" };
+    AmqpCppStreamer streamer(server_config, error_callback, options.streamer_options_);
+    if (!streamer.connect())
+    {
+        std::cout << "Failed to connect to the fake broker\n";
+        return 1;
+    }
+
+    // Warm up: the first publish waits for the connection and channel handshakes
+    streamer.publish("topic", "warm-up", "event_type_name", std::string(options.message_size_, 'a'));
+    for (size_t reconnect = 0; reconnect < options.tls_reconnects_; ++reconnect)
+    {
+        if (!streamer.connect())
+        {
+            std::cout << "Failed to reconnect to the fake broker\n";
+            return 1;
+        }
+        streamer.publish("topic", "warm-up", "event_type_name", std::string(options.message_size_, 'a'));
+    }
+    const auto warm_up_metrics = streamer.metrics();
+
+    LatencyHistogram call_latency;
+    const uint64_t allocations_before = allocation_count__.load();
+    const uint64_t producer_allocations_before = producer_allocation_count__.load();
+    const std::clock_t cpu_before = std::clock();
+    const auto broker_cpu_before = broker.threadCpuTime();
+    const auto started_at = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> producers;
+    for (size_t index = 0; index < options.producers_; ++index)
+    {
+        const uint64_t message_count =
+            options.messages_ / options.producers_ + (index < options.messages_ % options.producers_ ? 1 : 0);
+        producers.emplace_back([&, index, message_count]()
+        {
+            allocation_counter__ = &producer_allocation_count__;
+            try
+            {
+                runProducer(streamer, options, index, message_count, call_latency);
+            }
+            catch (const std::exception&)
+            {
+                error_callback(std::current_exception());
+            }
+        });
+    }
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+
+    try
+    {
+        streamer.flush();
+    }
+    catch (const std::exception&)
+    {
+        error_callback(std::current_exception());
+    }
+
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_at).count();
+    const double cpu_seconds = static_cast<double>(std::clock() - cpu_before) / CLOCKS_PER_SEC;
+    const double broker_cpu_seconds = std::chrono::duration<double>(broker.threadCpuTime() - broker_cpu_before).count();
+    const uint64_t producer_allocations = producer_allocation_count__.load() - producer_allocations_before;
+    const uint64_t allocations = allocation_count__.load() - allocations_before + producer_allocations;
+    const auto metrics = streamer.metrics();
+
+    if (exception == nullptr && failed_handler_publishes__.load() > 0)
+    {
+        exception = std::make_exception_ptr(
+            std::runtime_error(std::to_string(failed_handler_publishes__.load()) + " asyncPublish failures"));
+    }
+    if (exception != nullptr)
+    {
+        try
+        {
+            std::rethrow_exception(exception);
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << "Error during the benchmark: " << e.what() << "\n";
+        }
+    }
+
+    const auto broker_messages = static_cast<double>(metrics.messages_acked_ - warm_up_metrics.messages_acked_);
+    // Containers are acked by the broker, every message they hold is published
+    const auto messages = options.streamer_options_.aggregation_.is_enabled_
+        ? static_cast<double>(options.messages_ - failed_handler_publishes__.load())
+        : broker_messages;
+    const auto bytes = static_cast<double>(metrics.bytes_published_ - warm_up_metrics.bytes_published_);
+    std::cout << std::fixed << std::setprecision(2)
+        << "messages acked       " << static_cast<uint64_t>(messages) << " of " << options.messages_
+        << " (" << options.message_size_ << " bytes each)\n"
+        << "elapsed              " << elapsed << " s\n"
+        << "throughput           " << messages / elapsed << " msgs/s, " << bytes / elapsed / (1024 * 1024) << " MB/s\n";
+    printHistogram("connect", metrics.connect_);
+    printHistogram("publish call", call_latency.snapshot());
+    printHistogram("enqueue to IO", metrics.enqueue_to_io_);
+    printHistogram("IO to socket write", metrics.io_to_socket_write_);
+    printHistogram("IO to ack", metrics.io_to_ack_);
+    printHistogram("socket write to ack", metrics.socket_write_to_ack_);
+    std::cout << std::setprecision(3)
+        << "cpu time             " << cpu_seconds << " s process, " << broker_cpu_seconds << " s fake broker, "
+        << (messages > 0 ? (cpu_seconds - broker_cpu_seconds) * 1e6 / messages : 0.0) << " us/msg streamer side\n"
+        << "allocations          " << allocations << ", " << (messages > 0 ? allocations / messages : 0.0)
+        << " per message, " << (messages > 0 ? producer_allocations / messages : 0.0) << " on the producers and "
+        << (messages > 0 ? (allocations - producer_allocations) / messages : 0.0) << " on the other threads\n"
+        << "flow control         " << metrics.flow_control_pauses_ << " pauses, "
+        << metrics.flow_control_rejections_ << " rejections\n"
+        << "socket writes        " << metrics.socket_writes_ - warm_up_metrics.socket_writes_ << ", "
+        << (messages > 0 ? (metrics.socket_writes_ - warm_up_metrics.socket_writes_) / messages : 0.0) << " per message\n";
+    if (options.streamer_options_.io_spin_budget_.count() > 0)
+    {
+        std::cout << "io thread waits      " << metrics.io_thread_waits_ - warm_up_metrics.io_thread_waits_ << ", "
+            << (messages > 0 ? (metrics.io_thread_waits_ - warm_up_metrics.io_thread_waits_) / messages : 0.0)
+            << " per message\n";
+    }
+    if (metrics.control_to_socket_write_.count_ > 0)
+    {
+        std::cout << "heartbeats           " << metrics.heartbeats_sent_ << " sent, "
+            << metrics.heartbeats_received_ << " received\n";
+        printHistogram("control to write", metrics.control_to_socket_write_);
+    }
+    if (options.streamer_options_.aggregation_.is_enabled_)
+    {
+        std::cout << "aggregation          " << static_cast<uint64_t>(broker_messages) << " containers, "
+            << (broker_messages > 0 ? messages / broker_messages : 0.0) << " messages per container\n";
+    }
+    if (metrics.compression_input_bytes_ > 0)
+    {
+        std::cout << "compression          " << metrics.compressionRatio() << " ratio, "
+            << metrics.compressed_messages_ << " bodies compressed\n";
+        printHistogram("compression", metrics.compression_);
+    }
+    if (metrics.tls_handshakes_ > 0)
+    {
+        const auto records = metrics.tls_records_written_ - warm_up_metrics.tls_records_written_;
+        std::cout << "tls                  " << metrics.tls_handshakes_ << " handshakes, "
+            << metrics.tls_resumed_handshakes_ << " resumed, "
+            << (records > 0 ? static_cast<double>(metrics.bytes_written_ - warm_up_metrics.bytes_written_) / records : 0.0)
+            << " bytes per record\n";
+        printHistogram("tls handshake", metrics.tls_handshake_);
+    }
+
+    return exception == nullptr ? 0 : 1;
+}
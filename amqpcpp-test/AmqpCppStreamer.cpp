@@ -1,119 +1,704 @@
 #include "AmqpCppStreamer.h"
 
-#include "AsioHandler.h"
+#include "Logging.h"
+#include "StreamerConnection.h"
 #include "SynchronousChannel.h"
 
-#define NOMINMAX
-
-#include <amqpcpp.h>
-#include <boost/asio/io_service.hpp>
-
-#include <iostream>
+#include <algorithm>
+#include <utility>
 
 namespace RabbitMqStreamingPlugin
 {
     AmqpCppStreamer::AmqpCppStreamer(
         const RabbitMqServerConfig& server_config,
-        const OnErrorCallback error_callback)
+        const OnErrorCallback error_callback,
+        const StreamerOptions& options)
         : server_config_(server_config)
         , error_callback_(error_callback)
+        , options_(options)
+        , flow_controller_(options.flow_control_, metrics_)
+        , compressor_(options.compression_, metrics_)
+        , has_connected_(false)
+        , next_round_robin_slot_(0)
+        , is_spool_stopping_(false)
+        , is_connection_lost_(false)
+        , needs_replay_(false)
+        , spool_cursor_(0)
+        , spool_in_flight_(0)
+        , spool_session_(0)
+        , next_consumer_connection_(0)
     {
+        if (options_.tls_.is_enabled_)
+        {
+            tls_context_ = std::make_unique<TlsContext>(options_.tls_, metrics_);
+        }
+
+        if (!options_.spool_.path_.empty())
+        {
+            spool_ = std::make_unique<MessageSpool>(options_.spool_.path_, options_.spool_.capacity_);
+        }
+
+        if (compressor_.isEnabled() && options_.compression_.worker_threads_ > 0)
+        {
+            compression_pool_ = std::make_unique<boost::asio::thread_pool>(options_.compression_.worker_threads_);
+            // More strands than threads, so a busy partition key doesn't hold the others back
+            for (size_t index = 0; index < options_.compression_.worker_threads_ * 4; ++index)
+            {
+                compression_strands_.push_back(boost::asio::make_strand(compression_pool_->get_executor()));
+            }
+        }
+
+        if (options_.consumer_.worker_threads_ > 0)
+        {
+            delivery_pool_ = std::make_unique<boost::asio::thread_pool>(options_.consumer_.worker_threads_);
+        }
+
+        if (options_.aggregation_.is_enabled_)
+        {
+            aggregator_ = std::make_unique<MessageAggregator>(
+                options_.aggregation_,
+                flow_controller_,
+                [this](OutgoingMessage container, PublishCompletion completion)
+            {
+                submitAsyncPublish(std::move(container), std::move(completion));
+            });
+        }
     }
 
     AmqpCppStreamer::~AmqpCppStreamer()
     {
+        if (aggregator_)
+        {
+            aggregator_->flush();
+        }
+        if (compression_pool_)
+        {
+            // The queued messages still reach their channels before they are stopped
+            compression_pool_->join();
+        }
         stop();
+        // Runs the completions of the containers settled when the connections stopped
+        aggregator_.reset();
     }
 
     void AmqpCppStreamer::publish(
         const std::string& topic,
         const std::string& partition_key,
         const std::string& event_type_name,
-        const std::string& message)
+        MessageBody message)
     {
         try
         {
-            std::cout << std::this_thread::get_id() << ": AmqpCppStreamer::publish begin\n";
+            STREAMER_LOG_TRACE("AmqpCppStreamer::publish begin");
 
-            channel_->publish(topic, partition_key, event_type_name, message);
+            channelInSlot(channelSlotFor(partition_key))->publish(
+                topic, partition_key, event_type_name, compressor_.compress(event_type_name, std::move(message)));
 
-            std::cout << std::this_thread::get_id() << ": AmqpCppStreamer::publish success\n";
+            STREAMER_LOG_TRACE("AmqpCppStreamer::publish success");
         }
         catch (const std::exception& e)
         {
-            std::cout << std::this_thread::get_id() << ": AmqpCppStreamer::publish error: " << e.what() << "\n";
+            STREAMER_LOG_WARNING("AmqpCppStreamer::publish error: ", e.what());
             throw;
         }
     }
 
-    bool AmqpCppStreamer::connect()
+    std::future<void> AmqpCppStreamer::publishAsync(
+        const std::string& topic,
+        const std::string& partition_key,
+        const std::string& event_type_name,
+        MessageBody message)
+    {
+        return channelInSlot(channelSlotFor(partition_key))->publishAsync(
+            topic, partition_key, event_type_name, compressor_.compress(event_type_name, std::move(message)));
+    }
+
+    void AmqpCppStreamer::submitAsyncPublish(OutgoingMessage message, PublishCompletion completion)
+    {
+        if (!compression_pool_)
+        {
+            routeAsyncPublish(std::move(message), std::move(completion));
+            return;
+        }
+
+        // The strand queues are bounded by the watermarks too, the credit is handed over to the channel once the
+        // message is compressed
+        const size_t body_size = message.message_.size();
+        if (!flow_controller_.tryAcquire(1, body_size))
+        {
+            completion.complete(
+                std::make_exception_ptr(std::runtime_error("FlowController error: Publishing is paused.")),
+                boost::asio::system_executor());
+            return;
+        }
+
+        auto& strand = compression_strands_[
+            std::hash<std::string>()(message.partition_key_) % compression_strands_.size()];
+        boost::asio::post(strand,
+            [this, body_size, message = std::move(message), completion = std::move(completion)]() mutable
+        {
+            flow_controller_.release(1, body_size);
+            routeAsyncPublish(std::move(message), std::move(completion));
+        });
+    }
+
+    void AmqpCppStreamer::submitAggregatedPublish(OutgoingMessage message, PublishCompletion completion)
+    {
+        if (!aggregator_)
+        {
+            completion.complete(
+                std::make_exception_ptr(std::runtime_error("AmqpCppStreamer error: Aggregation is disabled.")),
+                boost::asio::system_executor());
+            return;
+        }
+
+        aggregator_->add(std::move(message), std::move(completion));
+    }
+
+    void AmqpCppStreamer::routeAsyncPublish(OutgoingMessage message, PublishCompletion completion)
     {
+        RoutedChannel channel;
         try
         {
-            std::cout << std::this_thread::get_id() << ": AmqpCppStreamer::connect begin\n";
+            message.message_ = compressor_.compress(message.event_type_name_, std::move(message.message_));
+            channel = channelInSlot(channelSlotFor(message.partition_key_));
+        }
+        catch (const std::exception& e)
+        {
+            STREAMER_LOG_WARNING("AmqpCppStreamer::asyncPublish error: ", e.what());
+            // No IO thread to run the handler on
+            completion.complete(std::current_exception(), boost::asio::system_executor());
+            return;
+        }
 
-            stop();
+        channel->submitAsyncPublish(std::move(message), std::move(completion));
+    }
+
+    PublishTemplateHandle AmqpCppStreamer::createPublishTemplate(
+        const std::string& topic,
+        const std::string& partition_key,
+        const std::string& event_type_name) const
+    {
+        return std::make_shared<const PublishTemplate>(topic, partition_key, event_type_name);
+    }
+
+    void AmqpCppStreamer::publish(const PublishTemplateHandle& publish_template, MessageBody message)
+    {
+        try
+        {
+            STREAMER_LOG_TRACE("AmqpCppStreamer::publish with template begin");
+
+            channelInSlot(channelSlotForHash(publish_template->partitionKeyHash()))->publish(
+                publish_template, compressor_.compress(publish_template->eventTypeName(), std::move(message)));
 
-            io_service_ = std::make_unique<boost::asio::io_service>();
+            STREAMER_LOG_TRACE("AmqpCppStreamer::publish with template success");
+        }
+        catch (const std::exception& e)
+        {
+            STREAMER_LOG_WARNING("AmqpCppStreamer::publish with template error: ", e.what());
+            throw;
+        }
+    }
+
+    std::future<void> AmqpCppStreamer::publishAsync(
+        const PublishTemplateHandle& publish_template, MessageBody message)
+    {
+        return channelInSlot(channelSlotForHash(publish_template->partitionKeyHash()))
+            ->publishAsync(
+                publish_template, compressor_.compress(publish_template->eventTypeName(), std::move(message)));
+    }
+
+    BatchPublishReport AmqpCppStreamer::publishBatch(std::vector<OutgoingMessage> messages)
+    {
+        try
+        {
+            STREAMER_LOG_TRACE("AmqpCppStreamer::publishBatch begin");
 
-            connection_handler_ =
-                std::make_unique<AsioHandler>(*io_service_, server_config_.ip_address_, server_config_.port_);
+            // Split the batch per channel, each part is handed to its channel IO thread at once
+            // The slot count drops to one while the spool thread replaces the connections
+            const size_t slot_count = channelSlotCount();
+            std::vector<std::vector<OutgoingMessage>> slot_messages(slot_count);
+            std::vector<std::vector<size_t>> slot_indexes(slot_count);
+            for (size_t index = 0; index < messages.size(); ++index)
+            {
+                const size_t slot = channelSlotFor(messages[index].partition_key_) % slot_count;
+                messages[index].message_ =
+                    compressor_.compress(messages[index].event_type_name_, std::move(messages[index].message_));
+                slot_messages[slot].push_back(std::move(messages[index]));
+                slot_indexes[slot].push_back(index);
+            }
 
-            connection_ = std::make_unique<AMQP::Connection>(
-                connection_handler_.get(),
-                AMQP::Login(server_config_.username_, server_config_.password_),
-                server_config_.vhost_);
+            std::vector<std::future<void>> futures(messages.size());
+            for (size_t slot = 0; slot < slot_messages.size(); ++slot)
+            {
+                if (slot_messages[slot].empty())
+                {
+                    continue;
+                }
 
-            channel_ = std::make_unique<SynchronousChannel>(*io_service_, *connection_);
+                auto channel_futures = channelInSlot(slot)->publishBatchAsync(std::move(slot_messages[slot]));
+                for (size_t index = 0; index < channel_futures.size(); ++index)
+                {
+                    futures[slot_indexes[slot][index]] = std::move(channel_futures[index]);
+                }
+            }
 
-            io_service_thread_ = std::thread([this]()
+            BatchPublishReport report;
+            for (size_t index = 0; index < futures.size(); ++index)
             {
-                runConnectionService();
-            });
+                try
+                {
+                    futures[index].get();
+                    ++report.published_count_;
+                }
+                catch (const std::exception& e)
+                {
+                    report.failures_.emplace_back(index, e.what());
+                }
+            }
 
-            std::cout << std::this_thread::get_id() << ": AmqpCppStreamer::connect success\n";
-            return true;
+            STREAMER_LOG_TRACE("AmqpCppStreamer::publishBatch done, ", report.failures_.size(), " failure(s)");
+            return report;
         }
         catch (const std::exception& e)
         {
-            std::cout << std::this_thread::get_id() << ": AmqpCppStreamer::connect error: " << e.what() << "\n";
-            return false;
+            STREAMER_LOG_WARNING("AmqpCppStreamer::publishBatch error: ", e.what());
+            throw;
+        }
+    }
+
+    void AmqpCppStreamer::publishSpooled(
+        const std::string& topic,
+        const std::string& partition_key,
+        const std::string& event_type_name,
+        MessageBody message)
+    {
+        if (!spool_)
+        {
+            throw std::runtime_error("AmqpCppStreamer error: No spool configured.");
+        }
+
+        spool_->append(OutgoingMessage{ topic, partition_key, event_type_name, std::move(message) });
+        std::unique_lock lock(spool_mutex_);
+        spool_cv_.notify_all();
+    }
+
+    void AmqpCppStreamer::flush()
+    {
+        if (aggregator_)
+        {
+            aggregator_->flush();
+        }
+        for (const auto& connection : connectionsSnapshot())
+        {
+            connection->flush();
         }
     }
 
-    void AmqpCppStreamer::runConnectionService()
+    void AmqpCppStreamer::consume(const std::string& queue, DeliveryCallback callback)
     {
         try
         {
-            std::cout << std::this_thread::get_id() << ": AmqpCppStreamer::runConnectionService begin\n";
-            io_service_->run();
-            std::cout << std::this_thread::get_id() << ": AmqpCppStreamer::runConnectionService success\n";
+            STREAMER_LOG_INFO("AmqpCppStreamer::consume ", queue);
+
+            // Held while opening, so a reconnection reopens either none or all of the consumers
+            std::unique_lock lock(consumers_mutex_);
+            openConsumer(queue, callback);
+            consumers_.push_back(ConsumerRegistration{ queue, std::move(callback) });
         }
         catch (const std::exception& e)
         {
-            std::cout << std::this_thread::get_id() << ": AmqpCppStreamer::runConnectionService error: " << e.what() << "\n";
-            error_callback_(std::current_exception());
+            STREAMER_LOG_ERROR("AmqpCppStreamer::consume error: ", e.what());
+            throw;
+        }
+    }
+
+    void AmqpCppStreamer::openConsumer(const std::string& queue, DeliveryCallback callback)
+    {
+        std::shared_ptr<StreamerConnection> connection;
+        {
+            std::unique_lock lock(connections_mutex_);
+            if (connections_.empty())
+            {
+                throw std::runtime_error("AmqpCppStreamer error: Not connected.");
+            }
+            connection = connections_[next_consumer_connection_.fetch_add(1) % connections_.size()];
         }
-        channel_->stop();
+        connection->consume(queue, std::move(callback), delivery_pool_.get());
+    }
+
+    void AmqpCppStreamer::reopenConsumers()
+    {
+        std::vector<std::exception_ptr> failures;
+        {
+            std::unique_lock lock(consumers_mutex_);
+            for (const auto& consumer : consumers_)
+            {
+                try
+                {
+                    openConsumer(consumer.queue_, consumer.callback_);
+                }
+                catch (const std::exception& e)
+                {
+                    // Kept for the next reconnection, the connection is left alone when the broker refuses it
+                    STREAMER_LOG_ERROR("AmqpCppStreamer::reopenConsumers error on ", consumer.queue_, ": ", e.what());
+                    failures.push_back(std::current_exception());
+                }
+            }
+        }
+
+        // Reported outside of the lock, the error callback may open another consumer
+        std::unique_lock lock(error_callback_mutex_);
+        for (const auto& failure : failures)
+        {
+            error_callback_(failure);
+        }
+    }
+
+    bool AmqpCppStreamer::connect()
+    {
+        bool is_connected = true;
+        try
+        {
+            STREAMER_LOG_INFO("AmqpCppStreamer::connect begin");
+
+            const auto started_at = MetricsClock::now();
+            stop();
+            startConnections();
+            waitForReadyChannels(started_at);
+            reopenConsumers();
+            metrics_.connect_.recordSince(started_at);
+
+            STREAMER_LOG_INFO("AmqpCppStreamer::connect success");
+        }
+        catch (const std::exception& e)
+        {
+            STREAMER_LOG_ERROR("AmqpCppStreamer::connect error: ", e.what());
+            is_connected = false;
+        }
+
+        if (spool_)
+        {
+            std::unique_lock lock(spool_mutex_);
+            is_connection_lost_ = !is_connected;
+            // Recovered records and the ones left by the previous connection are replayed
+            needs_replay_ = false;
+            spool_cursor_ = spool_->firstSequence();
+            spool_in_flight_ = 0;
+            ++spool_session_;
+            spool_thread_ = std::thread([this]()
+            {
+                runSpoolForwarder();
+            });
+        }
+        return is_connected;
+    }
+
+    void AmqpCppStreamer::startConnections()
+    {
+        if (has_connected_)
+        {
+            metrics_.reconnects_.add(1);
+        }
+        has_connected_ = true;
+
+        std::vector<std::shared_ptr<StreamerConnection>> connections;
+        const size_t connection_count = std::max<size_t>(options_.connection_count_, 1);
+        for (size_t index = 0; index < connection_count; ++index)
+        {
+            const int io_thread_cpu = options_.io_thread_cpus_.empty()
+                ? -1
+                : options_.io_thread_cpus_[index % options_.io_thread_cpus_.size()];
+
+            connections.push_back(std::make_shared<StreamerConnection>(
+                server_config_,
+                options_,
+                [this](std::exception_ptr exception)
+            {
+                onConnectionError(exception);
+            },
+                metrics_,
+                flow_controller_,
+                tls_context_.get(),
+                io_thread_cpu));
+            connections.back()->start();
+        }
+
+        std::unique_lock lock(connections_mutex_);
+        connections_ = std::move(connections);
+    }
+
+    void AmqpCppStreamer::waitForReadyChannels(MetricsClock::time_point started_at)
+    {
+        const auto& handler_options = options_.handler_;
+        const auto deadline = started_at + handler_options.connect_timeout_ + handler_options.handshake_timeout_
+            + options_.channel_open_timeout_;
+        const auto connections = connectionsSnapshot();
+        const size_t channel_count = std::min(options_.ready_channels_, channelSlotCount());
+        for (size_t slot = 0; slot < channel_count; ++slot)
+        {
+            // Same slot layout as channelInSlot, without recreating the failed channels
+            connections[slot % connections.size()]->waitUntilChannelReady(slot / connections.size(), deadline);
+        }
+    }
+
+    OutputBufferPool::Statistics AmqpCppStreamer::outputBufferStatistics() const
+    {
+        OutputBufferPool::Statistics statistics;
+        std::unique_lock lock(connections_mutex_);
+        for (const auto& connection : connections_)
+        {
+            const auto connection_statistics = connection->outputBufferStatistics();
+            statistics.chunk_size_ = connection_statistics.chunk_size_;
+            statistics.allocated_chunks_ += connection_statistics.allocated_chunks_;
+            statistics.free_chunks_ += connection_statistics.free_chunks_;
+            statistics.peak_allocated_chunks_ += connection_statistics.peak_allocated_chunks_;
+            statistics.pending_bytes_ += connection_statistics.pending_bytes_;
+            statistics.chunk_allocations_ += connection_statistics.chunk_allocations_;
+        }
+        return statistics;
+    }
+
+    StreamerMetrics::Snapshot AmqpCppStreamer::metrics() const
+    {
+        auto snapshot = metrics_.snapshot();
+        snapshot.output_buffer_bytes_ = outputBufferStatistics().pending_bytes_;
+        const auto flow_statistics = flow_controller_.statistics();
+        snapshot.pending_messages_ = flow_statistics.pending_messages_;
+        snapshot.pending_bytes_ = flow_statistics.pending_bytes_;
+        if (spool_)
+        {
+            const auto spool_statistics = spool_->statistics();
+            snapshot.spooled_messages_ = spool_statistics.unreleased_records_;
+            snapshot.spool_used_bytes_ = spool_statistics.used_bytes_;
+        }
+        return snapshot;
     }
 
     void AmqpCppStreamer::stop()
     {
-        std::cout << std::this_thread::get_id() << ": AmqpCppStreamer::stop begin\n";
-        if (io_service_thread_.joinable())
+        STREAMER_LOG_INFO("AmqpCppStreamer::stop begin");
+        if (spool_thread_.joinable())
+        {
+            {
+                std::unique_lock lock(spool_mutex_);
+                is_spool_stopping_ = true;
+                spool_cv_.notify_all();
+            }
+            spool_thread_.join();
+            is_spool_stopping_ = false;
+        }
+
+        // Destroyed outside of the lock, stopping a connection joins its IO thread
+        std::vector<std::shared_ptr<StreamerConnection>> connections;
+        {
+            std::unique_lock lock(connections_mutex_);
+            connections.swap(connections_);
+        }
+        connections.clear();
+        STREAMER_LOG_INFO("AmqpCppStreamer::stop reset");
+    }
+
+    void AmqpCppStreamer::onConnectionError(std::exception_ptr exception)
+    {
+        if (spool_)
         {
-            io_service_->stop();
-            io_service_thread_.join();
+            std::unique_lock lock(spool_mutex_);
+            is_connection_lost_ = true;
+            spool_cv_.notify_all();
         }
-        std::cout << std::this_thread::get_id() << ": AmqpCppStreamer::stop joined\n";
 
-        channel_.reset();
-        connection_.reset();
-        // destruction order is important between the handler and the service
-        // because some handler's internal objects depends on the service being in a valid state during destruction
-        connection_handler_.reset();
-        io_service_.reset();
-        std::cout << std::this_thread::get_id() << ": AmqpCppStreamer::stop reset\n";
+        std::unique_lock lock(error_callback_mutex_);
+        error_callback_(exception);
+    }
+
+    void AmqpCppStreamer::runSpoolForwarder()
+    {
+        STREAMER_LOG_INFO("AmqpCppStreamer::runSpoolForwarder begin");
+
+        std::unique_lock lock(spool_mutex_);
+        while (!is_spool_stopping_)
+        {
+            if (is_connection_lost_)
+            {
+                reconnectSpool(lock);
+            }
+            else
+            {
+                forwardSpooledMessages(lock);
+            }
+        }
+
+        STREAMER_LOG_INFO("AmqpCppStreamer::runSpoolForwarder end");
+    }
+
+    void AmqpCppStreamer::reconnectSpool(std::unique_lock<std::mutex>& lock)
+    {
+        bool is_connected = false;
+        lock.unlock();
+        try
+        {
+            STREAMER_LOG_INFO("AmqpCppStreamer::reconnectSpool begin");
+
+            // The messages in flight on the lost connection are settled with an error before it is destroyed, here or
+            // by the last publisher still using it
+            std::vector<std::shared_ptr<StreamerConnection>> connections;
+            {
+                std::unique_lock connections_lock(connections_mutex_);
+                connections.swap(connections_);
+            }
+            connections.clear();
+            startConnections();
+            reopenConsumers();
+            is_connected = true;
+
+            STREAMER_LOG_INFO("AmqpCppStreamer::reconnectSpool success");
+        }
+        catch (const std::exception& e)
+        {
+            STREAMER_LOG_ERROR("AmqpCppStreamer::reconnectSpool error: ", e.what());
+        }
+        lock.lock();
+
+        if (!is_connected)
+        {
+            spool_cv_.wait_for(lock, options_.spool_.reconnect_delay_, [this]()
+            {
+                return is_spool_stopping_;
+            });
+            return;
+        }
+
+        is_connection_lost_ = false;
+        needs_replay_ = false;
+        ++spool_session_;
+        spool_in_flight_ = 0;
+        if (spool_cursor_ != spool_->firstSequence())
+        {
+            metrics_.spool_replays_.add(1);
+        }
+        spool_cursor_ = spool_->firstSequence();
+    }
+
+    void AmqpCppStreamer::forwardSpooledMessages(std::unique_lock<std::mutex>& lock)
+    {
+        if (needs_replay_ && spool_in_flight_ == 0)
+        {
+            // Resent in order from the oldest unconfirmed message, the confirmed ones are skipped
+            needs_replay_ = false;
+            spool_cursor_ = spool_->firstSequence();
+            metrics_.spool_replays_.add(1);
+        }
+
+        const size_t max_in_flight = std::max<size_t>(options_.spool_.max_in_flight_messages_, 1);
+        if (needs_replay_ || spool_in_flight_ >= max_in_flight)
+        {
+            spool_cv_.wait(lock);
+            return;
+        }
+        if (flow_controller_.isPaused())
+        {
+            // The flow controller doesn't notify the spool thread, poll until it resumes
+            spool_cv_.wait_for(lock, std::chrono::milliseconds(10));
+            return;
+        }
+
+        auto records = spool_->read(spool_cursor_, max_in_flight - spool_in_flight_);
+        if (records.empty())
+        {
+            spool_cv_.wait(lock, [this]()
+            {
+                return is_spool_stopping_ || is_connection_lost_ || (needs_replay_ && spool_in_flight_ == 0)
+                    || spool_cursor_ < spool_->endSequence();
+            });
+            return;
+        }
+
+        const uint64_t session = spool_session_;
+        spool_cursor_ = records.back().sequence_ + 1;
+        spool_in_flight_ += records.size();
+
+        // Compressed on this thread, completions rejected right away are settled on it too
+        lock.unlock();
+        for (auto& record : records)
+        {
+            routeAsyncPublish(std::move(record.message_), PublishCompletion(
+                [this, session, sequence = record.sequence_](std::exception_ptr exception)
+            {
+                onSpooledMessageSettled(session, sequence, exception);
+            }));
+        }
+        lock.lock();
+    }
+
+    void AmqpCppStreamer::onSpooledMessageSettled(uint64_t session, uint64_t sequence, std::exception_ptr exception)
+    {
+        if (!exception)
+        {
+            spool_->release(sequence);
+        }
+
+        std::unique_lock lock(spool_mutex_);
+        if (session != spool_session_)
+        {
+            return;
+        }
+
+        --spool_in_flight_;
+        if (exception)
+        {
+            needs_replay_ = true;
+        }
+        spool_cv_.notify_all();
+    }
+
+    size_t AmqpCppStreamer::channelSlotFor(const std::string& partition_key)
+    {
+        // The key isn't hashed when routing round robin
+        return channelSlotForHash(
+            options_.routing_ == PublishRouting::PartitionKey ? std::hash<std::string>()(partition_key) : 0);
+    }
+
+    size_t AmqpCppStreamer::channelSlotForHash(size_t partition_key_hash)
+    {
+        if (options_.routing_ == PublishRouting::RoundRobin)
+        {
+            return next_round_robin_slot_.fetch_add(1, std::memory_order_relaxed) % channelSlotCount();
+        }
+        return partition_key_hash % channelSlotCount();
+    }
+
+    AmqpCppStreamer::RoutedChannel AmqpCppStreamer::channelInSlot(size_t slot)
+    {
+        RoutedChannel routed;
+        size_t channel_index = 0;
+        {
+            std::unique_lock lock(connections_mutex_);
+            if (connections_.empty())
+            {
+                throw std::runtime_error("AmqpCppStreamer error: Not connected.");
+            }
+
+            // Consecutive slots are on different connections
+            routed.connection_ = connections_[slot % connections_.size()];
+            channel_index = slot / connections_.size();
+        }
+
+        // Outside of the lock, a failed channel is recreated first
+        routed.channel_ = routed.connection_->channel(channel_index);
+        return routed;
+    }
+
+    size_t AmqpCppStreamer::channelSlotCount() const
+    {
+        std::unique_lock lock(connections_mutex_);
+        return connections_.empty() ? 1 : connections_.size() * connections_.front()->channelCount();
+    }
+
+    std::vector<std::shared_ptr<StreamerConnection>> AmqpCppStreamer::connectionsSnapshot() const
+    {
+        std::unique_lock lock(connections_mutex_);
+        return connections_;
     }
 
 }  // namespace RabbitMqStreamingPlugin
@@ -1,21 +1,36 @@
 #pragma once
 
-#include <boost/asio/io_service.hpp>
+#include "ConsumerChannel.h"
+#include "FlowController.h"
+#include "MessageAggregator.h"
+#include "MessageBody.h"
+#include "MessageSpool.h"
+#include "OutgoingMessage.h"
+#include "OutputBufferPool.h"
+#include "PayloadCompressor.h"
+#include "PublishCompletion.h"
+#include "PublishTemplate.h"
+#include "StreamerMetrics.h"
+#include "StreamerOptions.h"
+#include "TlsContext.h"
+
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/thread_pool.hpp>
 
 #include <memory>
 #include <string>
-#include <thread>
+#include <vector>
+#include <atomic>
+#include <condition_variable>
 #include <functional>
+#include <future>
 #include <mutex>
-
-namespace AMQP
-{
-    class Connection;
-    class ConnectionHandler;
-}  // namespace AMQP
+#include <thread>
 
 namespace RabbitMqStreamingPlugin
 {
+    class StreamerConnection;
     class SynchronousChannel;
 
     struct RabbitMqServerConfig
@@ -35,30 +50,207 @@ namespace RabbitMqStreamingPlugin
     public:
         AmqpCppStreamer(
             const RabbitMqServerConfig& server_config,
-            const OnErrorCallback error_callback);
+            const OnErrorCallback error_callback,
+            const StreamerOptions& options = StreamerOptions());
         ~AmqpCppStreamer();
 
+        // The message is copied only when given as a std::string lvalue, move it or pass a shared or borrowed
+        // MessageBody to hand the payload over without copying it.
         void publish(
             const std::string& topic,
             const std::string& partition_key,
             const std::string& event_type_name,
-            const std::string& message);
+            MessageBody message);
+
+        // Returns once the message fits in the channel in-flight window, see SynchronousChannel::publishAsync.
+        std::future<void> publishAsync(
+            const std::string& topic,
+            const std::string& partition_key,
+            const std::string& event_type_name,
+            MessageBody message);
+
+        // Asio initiating function that never blocks on the in-flight window, see SynchronousChannel::asyncPublish.
+        // The completion token can be a callback taking a std::exception_ptr, use_future, or use_awaitable in a
+        // C++20 coroutine. Routing errors, e.g. when not connected, are reported to the handler too.
+        // The body is compressed on the compression worker threads when there are some (CompressionOptions).
+        template <typename CompletionToken>
+        auto asyncPublish(
+            const std::string& topic,
+            const std::string& partition_key,
+            const std::string& event_type_name,
+            MessageBody message,
+            CompletionToken&& token)
+        {
+            return boost::asio::async_initiate<CompletionToken, PublishSignature>(
+                [this](auto handler, OutgoingMessage outgoing)
+                {
+                    submitAsyncPublish(std::move(outgoing), PublishCompletion(std::move(handler)));
+                },
+                token,
+                OutgoingMessage{ topic, partition_key, event_type_name, std::move(message) });
+        }
+
+        // Same as asyncPublish, but the message is packed with the other messages of the same topic, partition key
+        // and event type into a MessageContainer (StreamerOptions::aggregation_), completed by the container confirm.
+        // The message is rejected when the aggregation isn't enabled.
+        template <typename CompletionToken>
+        auto asyncPublishAggregated(
+            const std::string& topic,
+            const std::string& partition_key,
+            const std::string& event_type_name,
+            MessageBody message,
+            CompletionToken&& token)
+        {
+            return boost::asio::async_initiate<CompletionToken, PublishSignature>(
+                [this](auto handler, OutgoingMessage outgoing)
+                {
+                    submitAggregatedPublish(std::move(outgoing), PublishCompletion(std::move(handler)));
+                },
+                token,
+                OutgoingMessage{ topic, partition_key, event_type_name, std::move(message) });
+        }
+
+        // Builds once the routing and metadata shared by the messages of a topic, partition key and event type.
+        // The template doesn't depend on the connection, it can be created before connect and kept across reconnects.
+        PublishTemplateHandle createPublishTemplate(
+            const std::string& topic,
+            const std::string& partition_key,
+            const std::string& event_type_name) const;
 
+        // Same as publish and publishAsync, with the topic, partition key and metadata taken from the template
+        void publish(const PublishTemplateHandle& publish_template, MessageBody message);
+        std::future<void> publishAsync(const PublishTemplateHandle& publish_template, MessageBody message);
+
+        // Moves the whole batch to the IO thread in a single hand-off, see SynchronousChannel::publishBatch.
+        BatchPublishReport publishBatch(std::vector<OutgoingMessage> messages);
+
+        // Appends the message to the spool (StreamerOptions::spool_) and returns without waiting for the broker.
+        // The spooled messages are forwarded in order by a background thread, which also reconnects when the
+        // connection is lost and replays every message not confirmed yet, so they may be delivered more than once.
+        // Throws when the spool isn't configured or is full.
+        void publishSpooled(
+            const std::string& topic,
+            const std::string& partition_key,
+            const std::string& event_type_name,
+            MessageBody message);
+
+        void flush();
+
+        // Consumes the queue with the basic.qos prefetch and batched acks of StreamerOptions::consumer_, see
+        // ConsumerChannel. The consumers are spread over the connections and reopened on the new connections after a
+        // reconnection, a consumer failing to reopen is reported to the error callback and tried again on the next
+        // one. Throws when not connected or when the broker refuses the consumer.
+        void consume(const std::string& queue, DeliveryCallback callback);
+
+        // With a spool, the connection is then kept open by the spool thread: the first attempt result is returned
+        // but the spool thread keeps retrying if it failed. The publishes racing with a reconnection fail, on the
+        // lost connections or while there is none, or go to the new connections.
+        // Returns false when the connections fail to start or, with StreamerOptions::ready_channels_, when the channels
+        // fail to open in time. The time spent is recorded in the connect_ metric.
         bool connect();
 
+        // Statistics of the pools storing the frames waiting to be written, summed over the connections
+        OutputBufferPool::Statistics outputBufferStatistics() const;
+
+        // Latency histograms and counters recorded since the streamer creation, can be called from any thread
+        StreamerMetrics::Snapshot metrics() const;
+
     private:
-        void runConnectionService();
         void stop();
+        void startConnections();
+        // Waits for StreamerOptions::ready_channels_, throws when one fails or on the timeouts
+        void waitForReadyChannels(MetricsClock::time_point started_at);
+        void onConnectionError(std::exception_ptr exception);
+        // Opens the consumer on the next connection, throws on failure
+        void openConsumer(const std::string& queue, DeliveryCallback callback);
+        // Opens the consumers of consume again on the current connections, the failures are reported
+        void reopenConsumers();
+
+        // Spool thread, reconnects and forwards the spooled messages
+        void runSpoolForwarder();
+        // Starts new connections and rewinds to the oldest unreleased message, spool_mutex_ must be held
+        void reconnectSpool(std::unique_lock<std::mutex>& lock);
+        void forwardSpooledMessages(std::unique_lock<std::mutex>& lock);
+        void onSpooledMessageSettled(uint64_t session, uint64_t sequence, std::exception_ptr exception);
+        void submitAsyncPublish(OutgoingMessage message, PublishCompletion completion);
+        void submitAggregatedPublish(OutgoingMessage message, PublishCompletion completion);
+        // Compresses the message on the calling thread and submits it to its channel
+        void routeAsyncPublish(OutgoingMessage message, PublishCompletion completion);
+
+        // A channel with the connection it is opened on, kept alive while a publish uses them
+        struct RoutedChannel
+        {
+            SynchronousChannel* operator->() const
+            {
+                return channel_.get();
+            }
+
+            std::shared_ptr<StreamerConnection> connection_;
+            std::shared_ptr<SynchronousChannel> channel_;
+        };
+
+        // Index of the channel slot a message is published on, slots are spread over the connections
+        size_t channelSlotFor(const std::string& partition_key);
+        size_t channelSlotForHash(size_t partition_key_hash);
+        RoutedChannel channelInSlot(size_t slot);
+        size_t channelSlotCount() const;
+        // Copy of the current connections, which stay alive while it is used
+        std::vector<std::shared_ptr<StreamerConnection>> connectionsSnapshot() const;
 
         const RabbitMqServerConfig server_config_;
         const OnErrorCallback error_callback_;
+        const StreamerOptions options_;
+
+        StreamerMetrics metrics_;
+        // Shared by every connection, the bounds apply to the whole streamer
+        FlowController flow_controller_;
+        PayloadCompressor compressor_;
+        // Shared by the connections so a reconnection resumes their TLS session, null without TLS
+        std::unique_ptr<TlsContext> tls_context_;
+        bool has_connected_;
+
+        // Replaced by the spool thread on a reconnection, a lost connection is destroyed by the last publisher using it
+        std::vector<std::shared_ptr<StreamerConnection>> connections_;
+        mutable std::mutex connections_mutex_;
+        std::atomic<size_t> next_round_robin_slot_;
+        // Serializes the error callback, connections report their errors from their own IO thread
+        std::mutex error_callback_mutex_;
+
+        // The channels may hold views of its records, the destructor stops the connections before it is destroyed
+        std::unique_ptr<MessageSpool> spool_;
+        std::thread spool_thread_;
+        std::mutex spool_mutex_;
+        std::condition_variable spool_cv_;
+        bool is_spool_stopping_;
+        bool is_connection_lost_;
+        // A spooled message failed, the spool is rewound once the messages in flight are settled
+        bool needs_replay_;
+        // Next spooled message to forward
+        uint64_t spool_cursor_;
+        size_t spool_in_flight_;
+        // Incremented on every reconnection, settlements of the previous connections are then ignored
+        uint64_t spool_session_;
+
+        // Compresses the asyncPublish messages off the calling thread, the messages with the same partition key hash
+        // go through the same strand to keep their order
+        std::unique_ptr<boost::asio::thread_pool> compression_pool_;
+        std::vector<boost::asio::strand<boost::asio::thread_pool::executor_type>> compression_strands_;
+
+        // Submits its containers through submitAsyncPublish
+        std::unique_ptr<MessageAggregator> aggregator_;
 
-        std::unique_ptr<AMQP::ConnectionHandler> connection_handler_;
-        std::unique_ptr<AMQP::Connection> connection_;
-        std::unique_ptr<SynchronousChannel> channel_;
+        // Runs the delivery callbacks of every consumer, each consumer on its own strand
+        std::unique_ptr<boost::asio::thread_pool> delivery_pool_;
+        std::atomic<size_t> next_consumer_connection_;
 
-        std::thread io_service_thread_;
-        std::unique_ptr<boost::asio::io_service> io_service_;
+        struct ConsumerRegistration
+        {
+            std::string queue_;
+            DeliveryCallback callback_;
+        };
+        // Consumers opened by consume, reopened after every reconnection
+        std::mutex consumers_mutex_;
+        std::vector<ConsumerRegistration> consumers_;
     };
 
 }  // namespace RabbitMqStreamingPlugin
@@ -1,118 +1,459 @@
-#include "asiohandler.h"
+#include "AsioHandler.h"
 
-#include <iostream>
+#include "Logging.h"
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
 
 namespace RabbitMqStreamingPlugin
 {
     namespace AsioHandlerPrivate
     {
-        class AmqpBuffer
+        // Header, empty payload and frame end
+        constexpr size_t heartbeat_frame_size__ = 8;
+
+        // Fits the composed TLS operations, a read, a write and a heartbeat are in flight at most
+        constexpr size_t handler_memory_block_size__ = 1024;
+        constexpr size_t handler_memory_blocks__ = 4;
+        // Socket writes whose completion time is kept for the confirms, far more than are written during a round trip
+        constexpr size_t write_timeline_capacity__ = 4096;
+
+        // The gathered buffers without their vector, asio copies the buffer sequence of every write
+        class WriteBufferSequence
+        {
+        public:
+            explicit WriteBufferSequence(const std::vector<boost::asio::const_buffer>& buffers) :
+                begin_(buffers.data()),
+                end_(buffers.data() + buffers.size())
+            {
+            }
+
+            const boost::asio::const_buffer* begin() const
+            {
+                return begin_;
+            }
+
+            const boost::asio::const_buffer* end() const
+            {
+                return end_;
+            }
+
+        private:
+            const boost::asio::const_buffer* begin_;
+            const boost::asio::const_buffer* end_;
+        };
+
+        /*
+         * Receive buffer the socket reads into and the connection parses in place.
+         * Parsed bytes are dropped by moving the read position, leftover bytes are only moved back to the front when
+         * the free space at the end is too small for the next read, and the storage grows, up to a maximum, when a
+         * frame doesn't fit in it. The maximum is the frame_max negotiated with the broker once known.
+         */
+        class ReceiveBuffer
         {
         public:
-            AmqpBuffer(size_t size) :
-                data_(size, 0),
-                use_(0)
+            ReceiveBuffer(size_t initial_size, size_t max_size) :
+                data_(std::max<size_t>(initial_size, 1), 0),
+                max_size_(std::max(data_.size(), max_size)),
+                begin_(0),
+                end_(0)
             {
             }
 
-            size_t write(const char* data, size_t size)
+            // Returns the free space at the end of the buffer, compacting or growing it to get at least min_size
+            // bytes when possible.
+            boost::asio::mutable_buffer prepare(size_t min_size)
             {
-                if (use_ == data_.size())
+                if (begin_ == end_)
                 {
-                    return 0;
+                    begin_ = 0;
+                    end_ = 0;
                 }
 
-                const size_t length = (size + use_);
-                size_t write = length < data_.size() ? size : data_.size() - use_;
-                memcpy(data_.data() + use_, data, write);
-                use_ += write;
-                return write;
+                if (data_.size() - end_ < min_size)
+                {
+                    compact();
+                    const size_t required_size = std::min(end_ + min_size, max_size_);
+                    if (data_.size() < required_size)
+                    {
+                        data_.resize(std::min(std::max(data_.size() * 2, required_size), max_size_));
+                    }
+                }
+
+                return boost::asio::buffer(data_.data() + end_, data_.size() - end_);
+            }
+
+            void commit(size_t size)
+            {
+                assert(end_ + size <= data_.size());
+                end_ += size;
             }
 
-            void drain()
+            void consume(size_t size)
             {
-                use_ = 0;
+                assert(begin_ + size <= end_);
+                begin_ += size;
             }
 
             size_t available() const
             {
-                return use_;
+                return end_ - begin_;
             }
 
             const char* data() const
             {
-                return data_.data();
+                return data_.data() + begin_;
             }
 
-            void shl(size_t count)
+            bool full() const
             {
-                assert(count < use_);
+                return available() >= max_size_;
+            }
 
-                const size_t diff = use_ - count;
-                std::memmove(data_.data(), data_.data() + count, diff);
-                use_ = use_ - count;
+            // The largest frame fits, the storage is allocated as it grows
+            void setMaxSize(size_t max_size)
+            {
+                max_size_ = std::max(max_size, available());
             }
 
         private:
+            void compact()
+            {
+                if (begin_ > 0)
+                {
+                    std::memmove(data_.data(), data_.data() + begin_, available());
+                    end_ -= begin_;
+                    begin_ = 0;
+                }
+            }
+
             std::vector<char> data_;
-            size_t use_;
+            size_t max_size_;
+            size_t begin_;
+            size_t end_;
         };
     }
 
-    AsioHandler::AsioHandler(boost::asio::io_service& io_service, const std::string& host, uint16_t port)
-        : io_service_(io_service)
+    AsioHandler::AsioHandler(
+        boost::asio::io_service& io_service,
+        const std::string& host,
+        uint16_t port,
+        StreamerMetrics& metrics,
+        FlowController& flow_controller,
+        TlsContext* tls_context,
+        const AsioHandlerOptions& options)
+        : options_(options)
+        , metrics_(metrics)
+        , flow_controller_(flow_controller)
+        , io_service_(io_service)
         , socket_(io_service)
         , timer_(io_service)
-        , input_buffer_(asio_input_buffer_size__, 0)
-        , amqp_buffer_(std::make_shared<AsioHandlerPrivate::AmqpBuffer>(asio_input_buffer_size__ * 2))
+        , heartbeat_timer_(io_service)
+        , heartbeat_tick_(0)
+        , resolver_(io_service)
+        , host_(host)
+        , tls_context_(tls_context)
+        , receive_buffer_(std::make_unique<AsioHandlerPrivate::ReceiveBuffer>(
+            options.initial_receive_buffer_size_, options.max_receive_buffer_size_))
         , connection_(nullptr)
+        , output_buffer_(
+            options.output_chunk_size_,
+            options.max_free_output_chunks_,
+            options.high_priority_weight_,
+            options.normal_priority_weight_)
+        , write_timeline_(AsioHandlerPrivate::write_timeline_capacity__)
+        , handler_memory_(HandlerMemory::create(
+            AsioHandlerPrivate::handler_memory_block_size__, AsioHandlerPrivate::handler_memory_blocks__))
+        , has_pending_frames_(false)
         , is_writing_(false)
         , is_connected_(false)
+        , is_socket_connected_(false)
+        , is_ready_(false)
+        , failed_connect_attempts_(0)
+        , has_read_since_tick_(false)
+        , bytes_written_since_tick_(0)
+        , has_sent_heartbeat_(false)
+        , silent_ticks_(0)
         , should_quit_(false)
+        , is_closed_(false)
+        , is_blocked_by_broker_(false)
     {
         doConnect(host, port);
     }
 
     AsioHandler::~AsioHandler()
     {
+        // A closed connection doesn't hold the flow anymore
+        if (is_blocked_by_broker_)
+        {
+            flow_controller_.onBrokerUnblocked();
+        }
+    }
+
+    OutputBufferPool::Statistics AsioHandler::outputBufferStatistics() const
+    {
+        return output_buffer_.statistics();
+    }
+
+    const WriteTimeline& AsioHandler::writeTimeline() const
+    {
+        return write_timeline_;
+    }
+
+    void AsioHandler::setOpeningChannelPriority(FramePriority priority)
+    {
+        output_buffer_.setOpeningChannelPriority(priority);
+    }
+
+    bool AsioHandler::isClosed() const
+    {
+        return is_closed_;
+    }
+
+    void AsioHandler::abort()
+    {
+        should_quit_ = true;
+        boost::system::error_code ignored_error;
+        timer_.cancel(ignored_error);
+        heartbeat_timer_.cancel(ignored_error);
+        resolver_.cancel();
+        for (const auto& attempt : connect_attempts_)
+        {
+            attempt->close(ignored_error);
+        }
+        socket_.close(ignored_error);
+        is_closed_ = true;
     }
 
     void AsioHandler::doConnect(const std::string& host, uint16_t port)
     {
         using boost::asio::ip::tcp;
 
-        tcp::resolver::query query(host, std::to_string(port));
-        tcp::resolver::iterator iter = tcp::resolver(io_service_).resolve(query);
-        timer_.expires_from_now(boost::posix_time::milliseconds(500));
-        timer_.async_wait([this](const boost::system::error_code& ec)
+        armTimeout(options_.connect_timeout_, "Connection timed out", [this]()
         {
-            if (!ec && !is_connected_)
+            return is_socket_connected_;
+        });
+
+        resolver_.async_resolve(host, std::to_string(port),
+            [this](boost::system::error_code ec, tcp::resolver::results_type endpoints)
+        {
+            if (should_quit_)
             {
-                boost::system::error_code ignoredError;
-                socket_.cancel(ignoredError);
-                onNetworkError(ec, "Connection timed out");
+                return;
+            }
+            if (ec)
+            {
+                onNetworkError(ec, "resolve");
+            }
+
+            // Every address is tried at once, the first connected socket is kept
+            for (const auto& endpoint : endpoints)
+            {
+                connect_attempts_.push_back(std::make_unique<tcp::socket>(io_service_));
+                tcp::socket& attempt = *connect_attempts_.back();
+                attempt.async_connect(endpoint, [this, &attempt](boost::system::error_code ec)
+                {
+                    onConnectAttempt(attempt, ec);
+                });
             }
         });
+    }
 
-        boost::asio::async_connect(socket_, iter,
-            [this](boost::system::error_code ec, tcp::resolver::iterator)
+    void AsioHandler::onConnectAttempt(boost::asio::ip::tcp::socket& attempt, boost::system::error_code ec)
+    {
+        // Another attempt won, this one has been closed, or the handler has been aborted
+        if (is_socket_connected_ || ec == boost::asio::error::operation_aborted || should_quit_)
         {
-            if (!ec)
+            return;
+        }
+
+        if (ec)
+        {
+            ++failed_connect_attempts_;
+            if (failed_connect_attempts_ < connect_attempts_.size())
             {
-                is_connected_ = true;
-                doRead();
+                return;
+            }
+            onNetworkError(ec, "connect");
+        }
 
-                if (!output_buffer_.empty())
+        is_socket_connected_ = true;
+        socket_ = std::move(attempt);
+        setSocketOptions();
+        for (const auto& other_attempt : connect_attempts_)
+        {
+            boost::system::error_code ignored_error;
+            other_attempt->close(ignored_error);
+        }
+
+        armTimeout(options_.handshake_timeout_, "Handshake timed out", [this]()
+        {
+            return is_ready_;
+        });
+
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+        if (tls_context_ != nullptr)
+        {
+            const auto handshake_started_at = MetricsClock::now();
+            tls_stream_ = tls_context_->createStream(socket_, host_);
+            tls_stream_->async_handshake(boost::asio::ssl::stream_base::client,
+                [this, handshake_started_at](boost::system::error_code ec)
+            {
+                if (should_quit_)
                 {
-                    doWrite();
+                    return;
                 }
+                if (ec)
+                {
+                    onNetworkError(ec, "TLS handshake");
+                }
+                tls_context_->onHandshake(*tls_stream_, handshake_started_at);
+                onConnected();
+            });
+            return;
+        }
+#endif
+        onConnected();
+    }
+
+    void AsioHandler::setSocketOptions()
+    {
+        if (options_.tcp_no_delay_)
+        {
+            boost::system::error_code error;
+            socket_.set_option(boost::asio::ip::tcp::no_delay(true), error);
+            if (error)
+            {
+                STREAMER_LOG_WARNING("AsioHandler failed to set TCP_NODELAY: ", error.message());
             }
-            else
+        }
+
+        if (options_.socket_busy_poll_.count() > 0)
+        {
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+            const int busy_poll = static_cast<int>(options_.socket_busy_poll_.count());
+            if (setsockopt(socket_.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)) != 0)
+            {
+                STREAMER_LOG_WARNING("AsioHandler failed to set SO_BUSY_POLL: ", std::strerror(errno));
+            }
+#else
+            STREAMER_LOG_WARNING("AsioHandler can't set SO_BUSY_POLL on this platform");
+#endif
+        }
+    }
+
+    template <typename IsDone>
+    void AsioHandler::armTimeout(std::chrono::milliseconds timeout, const char* source, IsDone is_done)
+    {
+        // Re-arming cancels the previous wait
+        timer_.expires_after(timeout);
+        timer_.async_wait([this, source, is_done](const boost::system::error_code& ec)
+        {
+            if (!ec && !is_done())
             {
-                onNetworkError(ec, "connect");
+                boost::system::error_code ignored_error;
+                socket_.cancel(ignored_error);
+                for (const auto& attempt : connect_attempts_)
+                {
+                    attempt->close(ignored_error);
+                }
+                onNetworkError(boost::asio::error::timed_out, source);
             }
         });
+    }
+
+    void AsioHandler::onConnected()
+    {
+        is_connected_ = true;
+        doRead();
+
+        if (!output_buffer_.empty())
+        {
+            doWrite();
+        }
+    }
+
+    uint16_t AsioHandler::onNegotiate(AMQP::Connection* connection, uint16_t interval)
+    {
+        connection_ = connection;
+
+        // The connection has taken the frame_max of the broker, 0 is no limit so the receive buffer keeps its cap
+        const size_t frame_max = connection->maxFrame();
+        if (frame_max > options_.max_receive_buffer_size_)
+        {
+            throw std::runtime_error("AsioHandler error: The broker negotiated a frame_max of "
+                + std::to_string(frame_max) + " bytes, above the maximum receive buffer size of "
+                + std::to_string(options_.max_receive_buffer_size_) + " bytes.");
+        }
+        receive_buffer_->setMaxSize(frame_max == 0 ? options_.max_receive_buffer_size_ : frame_max);
+
+        // The lower interval wins, a broker proposing 0 accepts any
+        const auto requested = static_cast<uint16_t>(std::min<std::chrono::seconds::rep>(
+            std::max<std::chrono::seconds::rep>(options_.heartbeat_interval_.count(), 0), 0xFFFF));
+        const uint16_t negotiated = (requested == 0 || interval == 0) ? requested : std::min(interval, requested);
+
+        STREAMER_LOG_INFO("AsioHandler heartbeat interval: ", negotiated, "s (broker ", interval, "s)");
+        if (negotiated > 0)
+        {
+            heartbeat_tick_ = std::chrono::milliseconds(negotiated * 1000 / 2);
+            scheduleHeartbeat();
+        }
+        return negotiated;
+    }
+
+    void AsioHandler::onHeartbeat(AMQP::Connection* connection)
+    {
+        STREAMER_LOG_TRACE("AsioHandler::onHeartbeat");
+        metrics_.heartbeats_received_.add(1);
+    }
+
+    void AsioHandler::scheduleHeartbeat()
+    {
+        heartbeat_timer_.expires_after(heartbeat_tick_);
+        heartbeat_timer_.async_wait(bindHandlerMemory(*handler_memory_, [this](const boost::system::error_code& ec)
+        {
+            if (!ec)
+            {
+                onHeartbeatTick();
+            }
+        }));
+    }
+
+    void AsioHandler::onHeartbeatTick()
+    {
+        if (should_quit_)
+        {
+            return;
+        }
+
+        // The broker sends its heartbeats at the same pace, any frame received counts
+        silent_ticks_ = has_read_since_tick_ ? 0 : silent_ticks_ + 1;
+        has_read_since_tick_ = false;
+        if (silent_ticks_ >= 4)
+        {
+            boost::system::error_code ignored_error;
+            socket_.cancel(ignored_error);
+            onNetworkError(boost::asio::error::timed_out, "heartbeat");
+        }
+
+        // The heartbeat goes in the control lane, ahead of the frames already queued. The previous heartbeat
+        // doesn't count as traffic, so an idle connection sends one every tick.
+        const size_t own_bytes = has_sent_heartbeat_ ? AsioHandlerPrivate::heartbeat_frame_size__ : 0;
+        has_sent_heartbeat_ = bytes_written_since_tick_ <= own_bytes && connection_ != nullptr;
+        bytes_written_since_tick_ = 0;
+        if (has_sent_heartbeat_)
+        {
+            connection_->heartbeat();
+            metrics_.heartbeats_sent_.add(1);
+        }
 
+        scheduleHeartbeat();
     }
 
     void AsioHandler::onData(
@@ -120,7 +461,13 @@ namespace RabbitMqStreamingPlugin
     {
         connection_ = connection;
 
-        output_buffer_.push_back(std::vector<char>(data, data + size));
+        if (!has_pending_frames_)
+        {
+            pending_since_ = MetricsClock::now();
+            has_pending_frames_ = true;
+        }
+        output_buffer_.append(data, size);
+        write_timeline_.onQueued(size);
         if (!is_writing_ && is_connected_)
         {
             doWrite();
@@ -129,36 +476,91 @@ namespace RabbitMqStreamingPlugin
 
     void AsioHandler::doRead()
     {
-        std::cout << std::this_thread::get_id() << ": AsioHandler::doRead begin\n";
-        socket_.async_receive(boost::asio::buffer(input_buffer_),
-            [this](boost::system::error_code ec, std::size_t length)
+        STREAMER_LOG_TRACE("AsioHandler::doRead begin");
+
+        if (receive_buffer_->full())
         {
-            std::cout << std::this_thread::get_id() << ": AsioHandler::doRead async_receive\n";
+            onNetworkError(boost::asio::error::no_buffer_space, "read");
+        }
+
+        // Size the read after what is already waiting on the socket and what the connection needs to complete the
+        // frame being received, so a large frame is received in as few reads as possible
+        boost::system::error_code ignored_error;
+        size_t read_size = std::max(options_.min_read_size_, socket_.available(ignored_error));
+        if (connection_ != nullptr && connection_->expected() > receive_buffer_->available())
+        {
+            read_size = std::max<size_t>(read_size, connection_->expected() - receive_buffer_->available());
+        }
+
+        auto on_read = bindHandlerMemory(*handler_memory_, [this](boost::system::error_code ec, std::size_t length)
+        {
+            STREAMER_LOG_TRACE("AsioHandler::doRead async_receive");
             if (!ec)
             {
-                amqp_buffer_->write(input_buffer_.data(), length);
+                has_read_since_tick_ = true;
+                receive_buffer_->commit(length);
                 parseData();
                 doRead();
             }
+            else if (should_quit_)
+            {
+                // The broker closed its end, which also ends a TLS shutdown waiting for its close_notify
+                boost::system::error_code ignored_error;
+                socket_.close(ignored_error);
+            }
             else
             {
                 onNetworkError(ec, "read");
             }
         });
+
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+        if (tls_stream_)
+        {
+            tls_stream_->async_read_some(receive_buffer_->prepare(read_size), std::move(on_read));
+            return;
+        }
+#endif
+        socket_.async_receive(receive_buffer_->prepare(read_size), std::move(on_read));
     }
 
     void AsioHandler::doWrite()
     {
-        std::cout << std::this_thread::get_id() << ": AsioHandler::doWrite begin\n";
+        STREAMER_LOG_TRACE("AsioHandler::doWrite begin");
         is_writing_ = true;
-        boost::asio::async_write(socket_,
-            boost::asio::buffer(output_buffer_.front()),
-            [this](boost::system::error_code ec, std::size_t length)
+
+        // Gather as many pending bytes as the limits allow, frames queued while this write is in flight
+        // go out with the next one.
+        write_buffers_.clear();
+        const size_t write_size =
+            output_buffer_.gather(write_buffers_, options_.max_write_bytes_, options_.max_write_buffers_);
+        if (write_size == 0)
         {
-            std::cout << std::this_thread::get_id() << ": AsioHandler::doWrite async_write\n";
+            // Only the first piece of a frame is queued
+            is_writing_ = false;
+            return;
+        }
+        writing_since_ = pending_since_;
+        // Whatever is left behind by the limits is pending from now on
+        has_pending_frames_ = write_size < output_buffer_.pendingBytes();
+        pending_since_ = MetricsClock::now();
+
+        auto on_written = bindHandlerMemory(*handler_memory_, [this](boost::system::error_code ec, std::size_t length)
+        {
+            STREAMER_LOG_TRACE("AsioHandler::doWrite async_write");
             if (!ec)
             {
-                output_buffer_.pop_front();
+                if (const auto control_since = output_buffer_.gatheredSince(FramePriority::Control))
+                {
+                    metrics_.control_to_socket_write_.recordSince(*control_since);
+                }
+                output_buffer_.consume(length);
+                bytes_written_since_tick_ += length;
+                const auto written_at = MetricsClock::now();
+                write_timeline_.onWritten(length, written_at);
+                metrics_.io_to_socket_write_.record(written_at - writing_since_);
+                metrics_.socket_writes_.add(1);
+                metrics_.bytes_written_.add(static_cast<int64_t>(length));
                 if (!output_buffer_.empty())
                 {
                     doWrite();
@@ -168,58 +570,147 @@ namespace RabbitMqStreamingPlugin
                     is_writing_ = false;
                 }
 
-                if (should_quit_)
+                if (should_quit_ && !is_writing_)
                 {
-                    socket_.close();
+                    closeSocket();
                 }
             }
             else
             {
                 boost::system::error_code ignoredError;
                 socket_.close(ignoredError);
-                onNetworkError(ec, "write");
+                if (!should_quit_)
+                {
+                    onNetworkError(ec, "write");
+                }
             }
         });
+
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+        if (tls_stream_)
+        {
+            coalesceWriteBuffers(write_size);
+            boost::asio::async_write(
+                *tls_stream_, AsioHandlerPrivate::WriteBufferSequence(write_buffers_), std::move(on_written));
+            return;
+        }
+#endif
+        boost::asio::async_write(
+            socket_, AsioHandlerPrivate::WriteBufferSequence(write_buffers_), std::move(on_written));
     }
 
-    void AsioHandler::parseData()
+    void AsioHandler::closeSocket()
     {
-        if (connection_ == nullptr)
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+        if (tls_stream_ && is_connected_)
         {
+            // The shutdown completes once the broker answers with its own close_notify, or fails when it closes the
+            // socket first
+            timer_.expires_after(options_.close_timeout_);
+            timer_.async_wait([this](const boost::system::error_code& ec)
+            {
+                if (!ec)
+                {
+                    boost::system::error_code ignored_error;
+                    socket_.close(ignored_error);
+                }
+            });
+            tls_stream_->async_shutdown([this](boost::system::error_code)
+            {
+                timer_.cancel();
+                boost::system::error_code ignored_error;
+                socket_.close(ignored_error);
+                is_closed_ = true;
+            });
             return;
         }
+#endif
+        boost::system::error_code ignored_error;
+        socket_.close(ignored_error);
+        is_closed_ = true;
+    }
 
-        const auto count = connection_->parse(amqp_buffer_->data(), amqp_buffer_->available());
+    void AsioHandler::coalesceWriteBuffers(size_t write_size)
+    {
+        // The TLS stream encrypts only the first buffer of a sequence per write, so every small frame would end up
+        // in its own record. Copying them in one buffer lets OpenSSL fill each record up to its maximum size.
+        if (write_buffers_.size() <= 1)
+        {
+            return;
+        }
 
-        if (count == amqp_buffer_->available())
+        tls_write_buffer_.resize(write_size);
+        boost::asio::buffer_copy(boost::asio::buffer(tls_write_buffer_), write_buffers_);
+        write_buffers_.clear();
+        write_buffers_.push_back(boost::asio::buffer(tls_write_buffer_));
+    }
+
+    void AsioHandler::parseData()
+    {
+        if (connection_ == nullptr)
         {
-            amqp_buffer_->drain();
+            return;
         }
-        else if (count > 0)
+
+        // Parse every complete frame in place, the bytes of an incomplete frame stay in the buffer for the next read
+        while (receive_buffer_->available() > 0)
         {
-            amqp_buffer_->shl(count);
+            const auto count = connection_->parse(receive_buffer_->data(), receive_buffer_->available());
+            if (count == 0)
+            {
+                break;
+            }
+            receive_buffer_->consume(count);
         }
     }
 
     void AsioHandler::onError(AMQP::Connection* connection, const char* message)
     {
-        std::cout << std::this_thread::get_id() << ": AsioHandler::onError: " << message << "\n";
+        STREAMER_LOG_ERROR("AsioHandler::onError: ", message);
         throw std::runtime_error(message);
     }
 
+    void AsioHandler::onReady(AMQP::Connection* connection)
+    {
+        STREAMER_LOG_INFO("AsioHandler::onReady");
+        is_ready_ = true;
+        timer_.cancel();
+    }
+
     void AsioHandler::onClosed(AMQP::Connection* connection)
     {
-        std::cout << std::this_thread::get_id() << ": AsioHandler::onClosed\n";
+        STREAMER_LOG_INFO("AsioHandler::onClosed");
         should_quit_ = true;
+        heartbeat_timer_.cancel();
         if (!is_writing_)
         {
-            socket_.close();
+            closeSocket();
+        }
+    }
+
+    void AsioHandler::onBlocked(AMQP::Connection* connection, const char* reason)
+    {
+        STREAMER_LOG_WARNING("AsioHandler::onBlocked: ", reason);
+        if (!is_blocked_by_broker_)
+        {
+            is_blocked_by_broker_ = true;
+            flow_controller_.onBrokerBlocked(reason);
+        }
+    }
+
+    void AsioHandler::onUnblocked(AMQP::Connection* connection)
+    {
+        STREAMER_LOG_INFO("AsioHandler::onUnblocked");
+        if (is_blocked_by_broker_)
+        {
+            is_blocked_by_broker_ = false;
+            flow_controller_.onBrokerUnblocked();
         }
     }
 
     void AsioHandler::onNetworkError(boost::system::error_code error_code, const std::string& source)
     {
-        std::cout << std::this_thread::get_id() << ": AsioHandler::onNetworkError: " << error_code.message() << "(Source: " << source << ")\n";
+        STREAMER_LOG_ERROR("AsioHandler::onNetworkError: ", error_code.message(), "(Source: ", source, ")");
         boost::asio::detail::throw_error(error_code);
     }
 }
\ No newline at end of file
@@ -1,11 +1,20 @@
 #pragma once
 
+#include "FlowController.h"
+#include "FrameScheduler.h"
+#include "HandlerAllocator.h"
+#include "OutputBufferPool.h"
+#include "StreamerMetrics.h"
+#include "StreamerOptions.h"
+#include "TlsContext.h"
+#include "WriteTimeline.h"
+
 #define NOMINMAX
 
 #include <boost/asio.hpp>
 #include <amqpcpp.h>
 
-#include <deque>
+#include <atomic>
 #include <vector>
 #include <memory>
 
@@ -13,46 +22,135 @@ namespace RabbitMqStreamingPlugin
 {
     namespace AsioHandlerPrivate
     {
-        class AmqpBuffer;
+        class ReceiveBuffer;
     }
 
     // AsioHandler implementation based on
     // https//:github.com/fantastory/AMQP-CPP/blob/master/examples/rabbitmq_tutorials
+    // With a TlsContext, the socket is wrapped in a TLS stream once connected and the frames gathered by a write are
+    // copied in a single buffer, so they are sent in full-size TLS records instead of one record per frame.
+    // The frames are written in the order of their FrameScheduler lane, and the heartbeats negotiated with the broker
+    // are sent by a timer of the IO thread.
+    // The read, write and heartbeat completion handlers are allocated from a HandlerMemory recycling their blocks,
+    // so a connection doesn't allocate per socket operation.
     class AsioHandler : public AMQP::ConnectionHandler
     {
     public:
 
-        AsioHandler(boost::asio::io_service& io_service, const std::string& host, uint16_t port);
+        AsioHandler(
+            boost::asio::io_service& io_service,
+            const std::string& host,
+            uint16_t port,
+            StreamerMetrics& metrics,
+            FlowController& flow_controller,
+            TlsContext* tls_context = nullptr,
+            const AsioHandlerOptions& options = AsioHandlerOptions());
         ~AsioHandler() override;
 
         AsioHandler(const AsioHandler&) = delete;
         AsioHandler& operator=(const AsioHandler&) = delete;
 
+        // Can be called from any thread
+        OutputBufferPool::Statistics outputBufferStatistics() const;
+
+        // Completion times of the socket writes, for the write to confirm latency of the channels. IO thread only.
+        const WriteTimeline& writeTimeline() const;
+
+        // Lane of the channels opened from now on, see FrameScheduler. IO thread only.
+        void setOpeningChannelPriority(FramePriority priority);
+
+        // The socket has been closed after the connection, can be called from any thread
+        bool isClosed() const;
+
+        // Cancels the timers and closes the sockets without closing the AMQP connection, their handlers then complete
+        // without reporting an error. IO thread only, or once the IO thread is stopped.
+        void abort();
+
     private:
+        // Resolves the host and connects to every resolved address in parallel, without blocking the caller
         void doConnect(const std::string& host, uint16_t port);
+        void onConnectAttempt(boost::asio::ip::tcp::socket& attempt, boost::system::error_code error);
+        // TCP_NODELAY and SO_BUSY_POLL of AsioHandlerOptions, failures are only logged
+        void setSocketOptions();
+        // Fails the connection unless is_done returns true after the timeout
+        template <typename IsDone>
+        void armTimeout(std::chrono::milliseconds timeout, const char* source, IsDone is_done);
+        // Starts reading and writing once the connection, and the TLS handshake if any, are done
+        void onConnected();
 
+        // Returns the heartbeat interval, from AsioHandlerOptions and the broker proposal, and starts the heartbeats
+        uint16_t onNegotiate(AMQP::Connection* connection, uint16_t interval) override;
         void onData(AMQP::Connection* connection, const char* data, size_t size) override;
+        void onHeartbeat(AMQP::Connection* connection) override;
         void onError(AMQP::Connection* connection, const char* message) override;
+        // The AMQP handshake is done
+        void onReady(AMQP::Connection* connection) override;
         void onClosed(AMQP::Connection* connection) override;
+        void onBlocked(AMQP::Connection* connection, const char* reason) override;
+        void onUnblocked(AMQP::Connection* connection) override;
 
         void onNetworkError(boost::system::error_code error, const std::string& source);
 
+        // Ticks twice per heartbeat interval: sends a heartbeat when nothing was written since the previous tick,
+        // and fails the connection when nothing was read for two intervals
+        void scheduleHeartbeat();
+        void onHeartbeatTick();
+
         void doWrite();
+        // Sends the TLS close_notify before closing the socket
+        void closeSocket();
+        // Copies the gathered frames into tls_write_buffer_ when there are several of them
+        void coalesceWriteBuffers(size_t write_size);
         void doRead();
         void parseData();
 
-        static constexpr size_t asio_input_buffer_size__ = 4 * 1024; //4kb
-
+        const AsioHandlerOptions options_;
+        StreamerMetrics& metrics_;
+        FlowController& flow_controller_;
         boost::asio::io_service& io_service_;
         boost::asio::ip::tcp::socket socket_;
-        boost::asio::deadline_timer timer_;
+        // Connection then handshake timeout
+        boost::asio::steady_timer timer_;
+        boost::asio::steady_timer heartbeat_timer_;
+        std::chrono::milliseconds heartbeat_tick_;
+        boost::asio::ip::tcp::resolver resolver_;
+        // One socket per resolved address, the first one connected is moved to socket_
+        std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> connect_attempts_;
+        const std::string host_;
+        TlsContext* tls_context_;
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+        // Reads and writes go through it instead of socket_ when TLS is enabled
+        std::unique_ptr<TlsContext::Stream> tls_stream_;
+#endif
+        std::vector<char> tls_write_buffer_;
 
-        std::vector<char> input_buffer_;
-        std::shared_ptr<AsioHandlerPrivate::AmqpBuffer> amqp_buffer_;
+        std::unique_ptr<AsioHandlerPrivate::ReceiveBuffer> receive_buffer_;
         AMQP::Connection* connection_;
-        std::deque<std::vector<char>> output_buffer_;
+        FrameScheduler output_buffer_;
+        // Buffer sequence of the write in progress, the frames of output_buffer_ gathered by the scheduler
+        std::vector<boost::asio::const_buffer> write_buffers_;
+        WriteTimeline write_timeline_;
+        // Memory of the read, write and heartbeat handlers
+        HandlerMemory::Handle handler_memory_;
+        // When the oldest frame not yet gathered in a write, and the oldest frame of the write in progress, were queued
+        MetricsClock::time_point pending_since_;
+        MetricsClock::time_point writing_since_;
+        bool has_pending_frames_;
         bool is_writing_;
+        // Ready to read and write, after the TLS handshake if any
         bool is_connected_;
+        bool is_socket_connected_;
+        // connection.open-ok received
+        bool is_ready_;
+        size_t failed_connect_attempts_;
+        // Traffic since the previous heartbeat tick, and consecutive ticks without anything read
+        bool has_read_since_tick_;
+        size_t bytes_written_since_tick_;
+        bool has_sent_heartbeat_;
+        size_t silent_ticks_;
         bool should_quit_;
+        std::atomic<bool> is_closed_;
+        // The broker blocked the publishes of this connection, see FlowController
+        bool is_blocked_by_broker_;
     };
 }
\ No newline at end of file
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace RabbitMqStreamingPlugin
+{
+    /*
+     * ConfirmTracker holds the messages of a channel waiting for their publisher confirm, in a ring buffer indexed by
+     * delivery tag. Tags are given in publish order from 1, as the broker numbers the messages after confirm.select,
+     * so the slot of a tag is found without lookup and a confirm with the multiple flag settles a contiguous range in
+     * one pass.
+     *
+     * The ring only grows, doubling when more messages than its capacity are waiting, so it stops allocating once it
+     * fits the in-flight window. Out of order single confirms leave a hole that is skipped when the oldest message is
+     * settled. Confirms of tags that aren't waiting (already settled or never given) are ignored.
+     *
+     * Not thread safe.
+     */
+    template <typename Message>
+    class ConfirmTracker
+    {
+    public:
+        explicit ConfirmTracker(size_t initial_capacity = 64)
+            : slots_(roundUpToPowerOfTwo(initial_capacity))
+            , first_tag_(1)
+            , next_tag_(1)
+            , waiting_count_(0)
+        {
+        }
+
+        // Tag the next message pushed gets
+        uint64_t nextTag() const
+        {
+            return next_tag_;
+        }
+
+        size_t size() const
+        {
+            return waiting_count_;
+        }
+
+        bool empty() const
+        {
+            return waiting_count_ == 0;
+        }
+
+        // Returns the tag of the message
+        uint64_t push(Message message)
+        {
+            if (next_tag_ - first_tag_ == slots_.size())
+            {
+                grow();
+            }
+
+            Slot& slot = slotOf(next_tag_);
+            slot.message_ = std::move(message);
+            slot.is_waiting_ = true;
+            ++waiting_count_;
+            return next_tag_++;
+        }
+
+        // Calls on_settled with each message settled by the confirm of the tag, in tag order, and returns their count.
+        // The messages can be moved from.
+        template <typename OnSettled>
+        size_t settle(uint64_t tag, bool multiple, OnSettled&& on_settled)
+        {
+            if (tag < first_tag_ || tag >= next_tag_)
+            {
+                return 0;
+            }
+
+            size_t settled_count = 0;
+            for (uint64_t current_tag = multiple ? first_tag_ : tag; current_tag <= tag; ++current_tag)
+            {
+                Slot& slot = slotOf(current_tag);
+                if (slot.is_waiting_)
+                {
+                    slot.is_waiting_ = false;
+                    on_settled(slot.message_);
+                    ++settled_count;
+                }
+            }
+            waiting_count_ -= settled_count;
+
+            while (first_tag_ < next_tag_ && !slotOf(first_tag_).is_waiting_)
+            {
+                ++first_tag_;
+            }
+            return settled_count;
+        }
+
+        // Settles every waiting message, e.g. when the channel fails
+        template <typename OnSettled>
+        size_t settleAll(OnSettled&& on_settled)
+        {
+            return next_tag_ > first_tag_ ? settle(next_tag_ - 1, true, std::forward<OnSettled>(on_settled)) : 0;
+        }
+
+    private:
+        struct Slot
+        {
+            Message message_{};
+            bool is_waiting_ = false;
+        };
+
+        static size_t roundUpToPowerOfTwo(size_t value)
+        {
+            size_t power = 1;
+            while (power < value)
+            {
+                power *= 2;
+            }
+            return power;
+        }
+
+        Slot& slotOf(uint64_t tag)
+        {
+            return slots_[static_cast<size_t>(tag) & (slots_.size() - 1)];
+        }
+
+        void grow()
+        {
+            // Slots are indexed by tag, they are moved to their index in the larger ring
+            std::vector<Slot> slots(slots_.size() * 2);
+            for (uint64_t tag = first_tag_; tag < next_tag_; ++tag)
+            {
+                slots[static_cast<size_t>(tag) & (slots.size() - 1)] = std::move(slotOf(tag));
+            }
+            slots_ = std::move(slots);
+            assert(next_tag_ - first_tag_ < slots_.size());
+        }
+
+        std::vector<Slot> slots_;
+        // Oldest waiting message, next_tag_ when none is waiting
+        uint64_t first_tag_;
+        uint64_t next_tag_;
+        size_t waiting_count_;
+    };
+
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,289 @@
+#include "ConsumerChannel.h"
+
+#include "Logging.h"
+#include "MessageContainer.h"
+
+#include <boost/asio/post.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace RabbitMqStreamingPlugin
+{
+    namespace ConsumerChannelPrivate
+    {
+        void readEventTypeName(const AMQP::MetaData& meta_data, std::string& event_type_name)
+        {
+            if (meta_data.hasHeaders() && meta_data.headers().contains("proto"))
+            {
+                const std::string& value = meta_data.headers().get("proto");
+                event_type_name.assign(value);
+            }
+            else
+            {
+                event_type_name.clear();
+            }
+        }
+
+        std::string_view contentEncoding(const AMQP::MetaData& meta_data)
+        {
+            return meta_data.hasContentEncoding() ? std::string_view(meta_data.contentEncoding()) : std::string_view();
+        }
+
+        size_t ackBatchSize(const ConsumerOptions& options)
+        {
+            const size_t max_batch_size = options.prefetch_count_ > 0
+                ? std::max<size_t>(options.prefetch_count_ / 2, 1)
+                : std::numeric_limits<size_t>::max();
+            return std::clamp<size_t>(options.ack_batch_size_, 1, max_batch_size);
+        }
+    }  // namespace ConsumerChannelPrivate
+
+    using namespace ConsumerChannelPrivate;
+
+    ConsumerChannel::ConsumerChannel(
+        boost::asio::io_service& io_service,
+        std::string queue,
+        DeliveryCallback callback,
+        StreamerMetrics& metrics,
+        const ConsumerOptions& options,
+        boost::asio::thread_pool* worker_pool)
+        : io_service_(io_service)
+        , queue_(std::move(queue))
+        , callback_(std::move(callback))
+        , metrics_(metrics)
+        , prefetch_count_(options.prefetch_count_)
+        , ack_batch_size_(ackBatchSize(options))
+        , ack_interval_(options.ack_interval_)
+        , last_handled_tag_(0)
+        , unacked_deliveries_(0)
+        , is_ack_timer_armed_(false)
+        , is_stopped_(false)
+        , is_in_error_state_(false)
+    {
+        if (worker_pool != nullptr)
+        {
+            worker_strand_.emplace(boost::asio::make_strand(worker_pool->get_executor()));
+        }
+    }
+
+    ConsumerChannel::~ConsumerChannel()
+    {
+        stop();
+    }
+
+    std::future<void> ConsumerChannel::start(AMQP::Connection& connection)
+    {
+        channel_ = std::make_unique<AMQP::Channel>(&connection);
+        ack_timer_ = std::make_unique<boost::asio::steady_timer>(io_service_);
+        start_promise_.emplace();
+        auto future = start_promise_->get_future();
+
+        channel_->onError([this](const char* message)
+        {
+            STREAMER_LOG_ERROR("ConsumerChannel onError: ", message);
+            onError(message);
+        });
+        if (prefetch_count_ > 0)
+        {
+            channel_->setQos(prefetch_count_);
+        }
+        channel_->consume(queue_)
+            .onSuccess([this](const std::string& consumer_tag)
+        {
+            STREAMER_LOG_INFO("ConsumerChannel consuming ", queue_, " as ", consumer_tag);
+            if (start_promise_)
+            {
+                start_promise_->set_value();
+                start_promise_.reset();
+            }
+        })
+            .onMessage([this](const AMQP::Message& message, uint64_t delivery_tag, bool is_redelivered)
+        {
+            onMessage(message, delivery_tag, is_redelivered);
+        });
+        return future;
+    }
+
+    void ConsumerChannel::stop()
+    {
+        {
+            std::unique_lock lock(io_service_mutex_);
+            is_stopped_ = true;
+        }
+        ack_timer_.reset();
+        channel_.reset();
+    }
+
+    const std::string& ConsumerChannel::queue() const
+    {
+        return queue_;
+    }
+
+    bool ConsumerChannel::isInErrorState() const
+    {
+        return is_in_error_state_;
+    }
+
+    void ConsumerChannel::onMessage(const AMQP::Message& message, uint64_t delivery_tag, bool is_redelivered)
+    {
+        metrics_.deliveries_.add(1);
+        if (worker_strand_)
+        {
+            handOffToWorker(message, delivery_tag, is_redelivered);
+            return;
+        }
+
+        readEventTypeName(message, event_type_name_);
+
+        Delivery delivery;
+        delivery.body_ = std::string_view(message.body(), static_cast<size_t>(message.bodySize()));
+        delivery.routing_key_ = message.routingKey();
+        delivery.event_type_name_ = event_type_name_;
+        delivery.content_encoding_ = contentEncoding(message);
+        delivery.is_container_ = MessageContainer::isContainer(message);
+        delivery.is_redelivered_ = is_redelivered;
+        delivery.delivery_tag_ = delivery_tag;
+        onDeliveryHandled(delivery_tag, handle(delivery));
+    }
+
+    bool ConsumerChannel::handle(const Delivery& delivery)
+    {
+        try
+        {
+            callback_(delivery);
+            return true;
+        }
+        catch (const std::exception& e)
+        {
+            STREAMER_LOG_WARNING("ConsumerChannel delivery callback error on ", queue_, ": ", e.what());
+            return false;
+        }
+    }
+
+    void ConsumerChannel::handOffToWorker(const AMQP::Message& message, uint64_t delivery_tag, bool is_redelivered)
+    {
+        std::unique_ptr<DeliveryBuffer> buffer;
+        {
+            std::unique_lock lock(free_buffers_mutex_);
+            if (!free_buffers_.empty())
+            {
+                buffer = std::move(free_buffers_.back());
+                free_buffers_.pop_back();
+            }
+        }
+        if (!buffer)
+        {
+            buffer = std::make_unique<DeliveryBuffer>();
+        }
+
+        // The only copy of the delivery, the message doesn't outlive this callback
+        buffer->body_.assign(message.body(), static_cast<size_t>(message.bodySize()));
+        buffer->routing_key_.assign(message.routingKey());
+        readEventTypeName(message, buffer->event_type_name_);
+        buffer->content_encoding_.assign(contentEncoding(message));
+
+        buffer->delivery_.body_ = buffer->body_;
+        buffer->delivery_.routing_key_ = buffer->routing_key_;
+        buffer->delivery_.event_type_name_ = buffer->event_type_name_;
+        buffer->delivery_.content_encoding_ = buffer->content_encoding_;
+        buffer->delivery_.is_container_ = MessageContainer::isContainer(message);
+        buffer->delivery_.is_redelivered_ = is_redelivered;
+        buffer->delivery_.delivery_tag_ = delivery_tag;
+
+        boost::asio::post(*worker_strand_, [self = shared_from_this(), buffer = std::move(buffer)]() mutable
+        {
+            const bool is_handled = self->handle(buffer->delivery_);
+            const uint64_t handled_tag = buffer->delivery_.delivery_tag_;
+            {
+                // At most a prefetch worth of buffers is in use at once
+                std::unique_lock lock(self->free_buffers_mutex_);
+                if (self->free_buffers_.size() < std::max<size_t>(self->prefetch_count_, 1))
+                {
+                    self->free_buffers_.push_back(std::move(buffer));
+                }
+            }
+
+            self->postToIoThread([self, handled_tag, is_handled]()
+            {
+                self->onDeliveryHandled(handled_tag, is_handled);
+            });
+        });
+    }
+
+    void ConsumerChannel::postToIoThread(std::function<void()> function)
+    {
+        std::unique_lock lock(io_service_mutex_);
+        if (!is_stopped_)
+        {
+            io_service_.post(std::move(function));
+        }
+    }
+
+    void ConsumerChannel::onDeliveryHandled(uint64_t delivery_tag, bool is_handled)
+    {
+        if (!channel_)
+        {
+            return;
+        }
+
+        if (!is_handled)
+        {
+            // The previous deliveries are acked first, the multiple flag must not cover the rejected one
+            sendAck();
+            channel_->reject(delivery_tag, AMQP::requeue);
+            metrics_.delivery_rejections_.add(1);
+            return;
+        }
+
+        last_handled_tag_ = delivery_tag;
+        ++unacked_deliveries_;
+        if (unacked_deliveries_ >= ack_batch_size_)
+        {
+            sendAck();
+        }
+        else if (!is_ack_timer_armed_)
+        {
+            is_ack_timer_armed_ = true;
+            ack_timer_->expires_after(ack_interval_);
+            ack_timer_->async_wait([this](const boost::system::error_code& error)
+            {
+                if (!error)
+                {
+                    is_ack_timer_armed_ = false;
+                    sendAck();
+                }
+            });
+        }
+    }
+
+    void ConsumerChannel::sendAck()
+    {
+        if (is_ack_timer_armed_)
+        {
+            ack_timer_->cancel();
+            is_ack_timer_armed_ = false;
+        }
+        if (unacked_deliveries_ == 0 || !channel_)
+        {
+            return;
+        }
+
+        channel_->ack(last_handled_tag_, AMQP::multiple);
+        metrics_.delivery_acks_.add(1);
+        unacked_deliveries_ = 0;
+    }
+
+    void ConsumerChannel::onError(const std::string& message)
+    {
+        is_in_error_state_ = true;
+        if (start_promise_)
+        {
+            start_promise_->set_exception(
+                std::make_exception_ptr(std::runtime_error("ConsumerChannel error: " + message)));
+            start_promise_.reset();
+        }
+    }
+
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "StreamerMetrics.h"
+#include "StreamerOptions.h"
+
+#define NOMINMAX
+#include <amqpcpp.h>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace RabbitMqStreamingPlugin
+{
+    // A message received by a consumer, the views are only valid during the delivery callback
+    struct Delivery
+    {
+        std::string_view body_;
+        std::string_view routing_key_;
+        // "proto" header set by the streamer on the published messages
+        std::string_view event_type_name_;
+        // Empty when the body isn't encoded, see PayloadCompressor
+        std::string_view content_encoding_;
+        // The body is a MessageContainer, see MessageContainer::decode
+        bool is_container_ = false;
+        bool is_redelivered_ = false;
+        uint64_t delivery_tag_ = 0;
+    };
+
+    // The delivery is acked once the callback returns, and rejected to be requeued when it throws
+    using DeliveryCallback = std::function<void(const Delivery& delivery)>;
+
+    /*
+     * ConsumerChannel consumes one queue on its own AMQP::Channel, next to the SynchronousChannel of the same
+     * connection, with the basic.qos prefetch of ConsumerOptions.
+     *
+     * Without worker pool, the callback runs on the IO thread and the body is a view of the message as parsed by
+     * AMQP-CPP, in the receive buffer itself when the body fits in one frame. With a worker pool, the delivery is
+     * copied into a recycled buffer and the callback runs on a strand of the pool, so the deliveries of a queue are
+     * still handled one at a time and in order.
+     *
+     * The deliveries being handled in order, the acks are sent for the last handled delivery with the multiple
+     * flag, by batch of ConsumerOptions::ack_batch_size_ or after ack_interval_.
+     *
+     * The AMQP-CPP objects are only used from the IO thread, start and stop included.
+     */
+    class ConsumerChannel : public std::enable_shared_from_this<ConsumerChannel>
+    {
+    public:
+        ConsumerChannel(
+            boost::asio::io_service& io_service,
+            std::string queue,
+            DeliveryCallback callback,
+            StreamerMetrics& metrics,
+            const ConsumerOptions& options,
+            boost::asio::thread_pool* worker_pool);
+        ~ConsumerChannel();
+
+        ConsumerChannel(const ConsumerChannel&) = delete;
+        ConsumerChannel& operator=(const ConsumerChannel&) = delete;
+
+        // Opens the channel and starts consuming, the future is settled once the broker accepted the consumer
+        std::future<void> start(AMQP::Connection& connection);
+        // Destroys the channel, the deliveries still handled by the workers are then neither acked nor rejected
+        void stop();
+
+        const std::string& queue() const;
+        bool isInErrorState() const;
+
+    private:
+        // Delivery copied for the worker pool, recycled once handled
+        struct DeliveryBuffer
+        {
+            std::string body_;
+            std::string routing_key_;
+            std::string event_type_name_;
+            std::string content_encoding_;
+            Delivery delivery_;
+        };
+
+        void onMessage(const AMQP::Message& message, uint64_t delivery_tag, bool is_redelivered);
+        // Runs the callback, returns false when it threw
+        bool handle(const Delivery& delivery);
+        void handOffToWorker(const AMQP::Message& message, uint64_t delivery_tag, bool is_redelivered);
+        void postToIoThread(std::function<void()> function);
+
+        void onDeliveryHandled(uint64_t delivery_tag, bool is_handled);
+        void sendAck();
+        void onError(const std::string& message);
+
+        boost::asio::io_service& io_service_;
+        const std::string queue_;
+        const DeliveryCallback callback_;
+        StreamerMetrics& metrics_;
+        const uint16_t prefetch_count_;
+        const size_t ack_batch_size_;
+        const std::chrono::microseconds ack_interval_;
+
+        // Only used on the IO thread
+        std::unique_ptr<AMQP::Channel> channel_;
+        std::unique_ptr<boost::asio::steady_timer> ack_timer_;
+        std::optional<std::promise<void>> start_promise_;
+        uint64_t last_handled_tag_;
+        size_t unacked_deliveries_;
+        bool is_ack_timer_armed_;
+        // Event type name of the inline delivery, kept to reuse its capacity
+        std::string event_type_name_;
+
+        std::optional<boost::asio::strand<boost::asio::thread_pool::executor_type>> worker_strand_;
+        std::mutex free_buffers_mutex_;
+        std::vector<std::unique_ptr<DeliveryBuffer>> free_buffers_;
+        // Cleared by stop, the workers finishing afterwards don't post anything
+        std::mutex io_service_mutex_;
+        bool is_stopped_;
+        std::atomic<bool> is_in_error_state_;
+    };
+
+}  // namespace RabbitMqStreamingPlugin
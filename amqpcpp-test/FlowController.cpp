@@ -0,0 +1,163 @@
+#include "FlowController.h"
+
+#include "Logging.h"
+
+#include <stdexcept>
+
+namespace RabbitMqStreamingPlugin
+{
+    FlowController::FlowController(const FlowControlOptions& options, StreamerMetrics& metrics)
+        : options_(options)
+        , metrics_(metrics)
+        , pending_messages_(0)
+        , pending_bytes_(0)
+        , is_paused_(false)
+        , blocked_connections_(0)
+    {
+    }
+
+    void FlowController::acquire(size_t message_count, size_t bytes)
+    {
+        if (is_paused_.load() && options_.policy_ != FlowControlPolicy::Callback)
+        {
+            if (options_.policy_ == FlowControlPolicy::Reject)
+            {
+                metrics_.flow_control_rejections_.add(static_cast<int64_t>(message_count));
+                throw std::runtime_error("FlowController error: Publishing is paused.");
+            }
+
+            STREAMER_LOG_DEBUG("FlowController::acquire blocked");
+            std::unique_lock lock(state_mutex_);
+            const bool has_resumed = resumed_cv_.wait_for(lock, options_.max_block_time_, [this]()
+            {
+                return !is_paused_.load();
+            });
+            if (!has_resumed)
+            {
+                metrics_.flow_control_rejections_.add(static_cast<int64_t>(message_count));
+                throw std::runtime_error("FlowController error: Publishing paused for longer than the maximum block time.");
+            }
+        }
+
+        add(message_count, bytes);
+    }
+
+    bool FlowController::tryAcquire(size_t message_count, size_t bytes)
+    {
+        if (is_paused_.load() && options_.policy_ != FlowControlPolicy::Callback)
+        {
+            metrics_.flow_control_rejections_.add(static_cast<int64_t>(message_count));
+            return false;
+        }
+
+        add(message_count, bytes);
+        return true;
+    }
+
+    void FlowController::release(size_t message_count, size_t bytes)
+    {
+        pending_messages_.fetch_sub(message_count);
+        pending_bytes_.fetch_sub(bytes);
+        if (is_paused_.load())
+        {
+            updatePausedState();
+        }
+    }
+
+    void FlowController::onBrokerBlocked(const std::string& reason)
+    {
+        STREAMER_LOG_WARNING("FlowController::onBrokerBlocked: ", reason);
+        {
+            std::unique_lock lock(state_mutex_);
+            ++blocked_connections_;
+        }
+        updatePausedState();
+    }
+
+    void FlowController::onBrokerUnblocked()
+    {
+        STREAMER_LOG_INFO("FlowController::onBrokerUnblocked");
+        {
+            std::unique_lock lock(state_mutex_);
+            if (blocked_connections_ > 0)
+            {
+                --blocked_connections_;
+            }
+        }
+        updatePausedState();
+    }
+
+    bool FlowController::isPaused() const
+    {
+        return is_paused_.load();
+    }
+
+    FlowController::Statistics FlowController::statistics() const
+    {
+        Statistics statistics;
+        statistics.pending_messages_ = pending_messages_.load();
+        statistics.pending_bytes_ = pending_bytes_.load();
+        statistics.is_paused_ = is_paused_.load();
+        {
+            std::unique_lock lock(state_mutex_);
+            statistics.blocked_connections_ = blocked_connections_;
+        }
+        return statistics;
+    }
+
+    bool FlowController::isAboveHighWatermark() const
+    {
+        return (options_.high_watermark_messages_ > 0
+                && pending_messages_.load() >= options_.high_watermark_messages_)
+            || (options_.high_watermark_bytes_ > 0
+                && pending_bytes_.load() >= options_.high_watermark_bytes_);
+    }
+
+    bool FlowController::isAtOrBelowLowWatermark() const
+    {
+        return (options_.high_watermark_messages_ == 0
+                || pending_messages_.load() <= options_.low_watermark_messages_)
+            && (options_.high_watermark_bytes_ == 0
+                || pending_bytes_.load() <= options_.low_watermark_bytes_);
+    }
+
+    void FlowController::updatePausedState()
+    {
+        std::unique_lock lock(state_mutex_);
+        if (!is_paused_.load() && (blocked_connections_ > 0 || isAboveHighWatermark()))
+        {
+            STREAMER_LOG_DEBUG("FlowController paused");
+            is_paused_.store(true);
+            metrics_.flow_control_pauses_.add(1);
+            if (options_.on_flow_change_)
+            {
+                options_.on_flow_change_(true);
+            }
+        }
+
+        // Checked again after pausing, a release that didn't see the pause yet doesn't check for the resume
+        if (is_paused_.load() && blocked_connections_ == 0 && isAtOrBelowLowWatermark())
+        {
+            STREAMER_LOG_DEBUG("FlowController resumed");
+            is_paused_.store(false);
+            resumed_cv_.notify_all();
+            if (options_.on_flow_change_)
+            {
+                options_.on_flow_change_(false);
+            }
+        }
+    }
+
+    void FlowController::add(size_t message_count, size_t bytes)
+    {
+        pending_messages_.fetch_add(message_count);
+        pending_bytes_.fetch_add(bytes);
+        // Admitted while running even when it crosses the watermark, so a batch larger than the watermark can't block
+        // forever
+        if (!is_paused_.load() && isAboveHighWatermark())
+        {
+            updatePausedState();
+        }
+    }
+
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "StreamerMetrics.h"
+#include "StreamerOptions.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+namespace RabbitMqStreamingPlugin
+{
+    /*
+     * FlowController bounds the memory used by the messages in the streamer. Every message is accounted for when a
+     * producer hands it over and until its channel settles it (confirmed, lost or failed), and the flow is paused
+     * between the high and low watermarks of FlowControlOptions, or while the broker blocks any connection
+     * (connection.blocked, e.g. on a memory or disk alarm).
+     *
+     * While paused, producers are blocked or rejected depending on the policy. The counters are atomics so the
+     * accounting of a message doesn't take any lock while the flow runs, the mutex is only used around the pause
+     * transitions.
+     */
+    class FlowController
+    {
+    public:
+        struct Statistics
+        {
+            size_t pending_messages_ = 0;
+            size_t pending_bytes_ = 0;
+            size_t blocked_connections_ = 0;
+            bool is_paused_ = false;
+        };
+
+        FlowController(const FlowControlOptions& options, StreamerMetrics& metrics);
+
+        FlowController(const FlowController&) = delete;
+        FlowController& operator=(const FlowController&) = delete;
+
+        // Accounts for messages handed over by a producer. While paused, blocks until the flow resumes with the Block
+        // policy and throws with the Reject policy, or when blocked for longer than max_block_time_.
+        void acquire(size_t message_count, size_t bytes);
+        // Never blocks, returns false instead of blocking or throwing
+        bool tryAcquire(size_t message_count, size_t bytes);
+        // Messages settled by their channel
+        void release(size_t message_count, size_t bytes);
+
+        // connection.blocked and connection.unblocked notifications of the broker, per connection
+        void onBrokerBlocked(const std::string& reason);
+        void onBrokerUnblocked();
+
+        bool isPaused() const;
+        Statistics statistics() const;
+
+    private:
+        bool isAboveHighWatermark() const;
+        bool isAtOrBelowLowWatermark() const;
+        void updatePausedState();
+        void add(size_t message_count, size_t bytes);
+
+        const FlowControlOptions options_;
+        StreamerMetrics& metrics_;
+
+        std::atomic<size_t> pending_messages_;
+        std::atomic<size_t> pending_bytes_;
+        std::atomic<bool> is_paused_;
+
+        mutable std::mutex state_mutex_;
+        std::condition_variable resumed_cv_;
+        size_t blocked_connections_;
+    };
+
+}  // namespace RabbitMqStreamingPlugin
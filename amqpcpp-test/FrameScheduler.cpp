@@ -0,0 +1,461 @@
+#include "FrameScheduler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace RabbitMqStreamingPlugin
+{
+    namespace FrameSchedulerPrivate
+    {
+        constexpr uint8_t method_frame__ = 1;
+        // Type, channel and payload size, the payload is followed by the frame end octet
+        constexpr size_t frame_header_size__ = 7;
+        constexpr size_t frame_end_size__ = 1;
+        const char protocol_header__[] = { 'A', 'M', 'Q', 'P', 0, 0, 9, 1 };
+
+        // Bytes a lane gets per round and per unit of weight
+        constexpr size_t quantum__ = 4 * 1024;
+        // The control and high priority lanes only carry small frames, they keep fewer chunks for reuse
+        constexpr size_t small_lane_free_chunks__ = 4;
+
+        uint16_t readUint16(const char* data)
+        {
+            const auto bytes = reinterpret_cast<const uint8_t*>(data);
+            return static_cast<uint16_t>((bytes[0] << 8) | bytes[1]);
+        }
+
+        uint32_t readUint32(const char* data)
+        {
+            const auto bytes = reinterpret_cast<const uint8_t*>(data);
+            return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | bytes[3];
+        }
+
+        size_t laneIndex(FramePriority priority)
+        {
+            return static_cast<size_t>(priority);
+        }
+
+        /*
+         * Frames of a lane: their bytes in an OutputBufferPool and their sizes in a ring buffer, oldest first.
+         * The last frame may be incomplete while AMQP-CPP hands it over in pieces.
+         */
+        class Lane
+        {
+        public:
+            Lane(size_t chunk_size, size_t max_free_chunks) :
+                buffer_(chunk_size, max_free_chunks),
+                frame_sizes_(64),
+                first_frame_(0),
+                frame_count_(0),
+                incomplete_bytes_(0),
+                has_pending_frames_(false)
+            {
+            }
+
+            // Appends the first size bytes of a frame of frame_size bytes
+            void startFrame(const char* data, size_t size, size_t frame_size)
+            {
+                assert(incomplete_bytes_ == 0);
+                if (frame_count_ == frame_sizes_.size())
+                {
+                    growFrameSizes();
+                }
+                frame_sizes_[(first_frame_ + frame_count_) & (frame_sizes_.size() - 1)] = frame_size;
+                ++frame_count_;
+
+                if (!has_pending_frames_)
+                {
+                    pending_since_ = MetricsClock::now();
+                    has_pending_frames_ = true;
+                }
+                incomplete_bytes_ = frame_size;
+                continueFrame(data, size);
+            }
+
+            void continueFrame(const char* data, size_t size)
+            {
+                assert(size <= incomplete_bytes_);
+                buffer_.append(data, size);
+                incomplete_bytes_ -= size;
+            }
+
+            size_t completeFrameCount() const
+            {
+                return frame_count_ - (incomplete_bytes_ > 0 ? 1 : 0);
+            }
+
+            // Size of a pending frame, index 0 is the oldest
+            size_t frameSize(size_t index) const
+            {
+                return frame_sizes_[(first_frame_ + index) & (frame_sizes_.size() - 1)];
+            }
+
+            // The frames not taken by a gather are pending from now on
+            void onGathered(size_t frame_count, MetricsClock::time_point now)
+            {
+                if (frame_count < frame_count_)
+                {
+                    pending_since_ = now;
+                }
+                else
+                {
+                    has_pending_frames_ = false;
+                }
+            }
+
+            void consume(size_t frame_count, size_t size)
+            {
+                assert(frame_count <= completeFrameCount());
+                buffer_.consume(size);
+                first_frame_ = (first_frame_ + frame_count) & (frame_sizes_.size() - 1);
+                frame_count_ -= frame_count;
+            }
+
+            MetricsClock::time_point pendingSince() const
+            {
+                return pending_since_;
+            }
+
+            OutputBufferPool buffer_;
+
+        private:
+            void growFrameSizes()
+            {
+                std::vector<size_t> frame_sizes(frame_sizes_.size() * 2);
+                for (size_t index = 0; index < frame_count_; ++index)
+                {
+                    frame_sizes[index] = frameSize(index);
+                }
+                frame_sizes_ = std::move(frame_sizes);
+                first_frame_ = 0;
+            }
+
+            // Power of two ring
+            std::vector<size_t> frame_sizes_;
+            size_t first_frame_;
+            size_t frame_count_;
+            size_t incomplete_bytes_;
+            // When the oldest frame not gathered yet was queued
+            MetricsClock::time_point pending_since_;
+            bool has_pending_frames_;
+        };
+
+        // Shortens the buffers appended from first_buffer so they cover size bytes
+        void truncateBuffers(std::vector<boost::asio::const_buffer>& buffers, size_t first_buffer, size_t size)
+        {
+            size_t index = first_buffer;
+            for (; index < buffers.size() && size > 0; ++index)
+            {
+                if (buffers[index].size() > size)
+                {
+                    buffers[index] = boost::asio::buffer(buffers[index].data(), size);
+                }
+                size -= buffers[index].size();
+            }
+            buffers.resize(index);
+        }
+    }  // namespace FrameSchedulerPrivate
+
+    FrameScheduler::FrameScheduler(
+        size_t chunk_size, size_t max_free_chunks, size_t high_priority_weight, size_t normal_priority_weight)
+        : weights_{ 0, std::max<size_t>(high_priority_weight, 1), std::max<size_t>(normal_priority_weight, 1) }
+        , deficits_{}
+        , opening_channel_priority_(FramePriority::Normal)
+        , partial_lane_(0)
+        , partial_frame_remaining_(0)
+        , is_draining_(false)
+        , planned_frames_{}
+        , planned_bytes_{}
+        , planned_total_bytes_(0)
+        , gathered_frames_{}
+        , gathered_bytes_{}
+    {
+        using namespace FrameSchedulerPrivate;
+
+        const size_t small_lane_free_chunks = std::min(max_free_chunks, small_lane_free_chunks__);
+        lanes_[laneIndex(FramePriority::Control)] = std::make_unique<Lane>(chunk_size, small_lane_free_chunks);
+        lanes_[laneIndex(FramePriority::High)] = std::make_unique<Lane>(chunk_size, small_lane_free_chunks);
+        lanes_[laneIndex(FramePriority::Normal)] = std::make_unique<Lane>(chunk_size, max_free_chunks);
+    }
+
+    FrameScheduler::~FrameScheduler() = default;
+
+    void FrameScheduler::setOpeningChannelPriority(FramePriority priority)
+    {
+        opening_channel_priority_ = priority;
+    }
+
+    void FrameScheduler::append(const char* data, size_t size)
+    {
+        using namespace FrameSchedulerPrivate;
+
+        while (size > 0)
+        {
+            size_t length = 0;
+            if (partial_frame_remaining_ > 0)
+            {
+                length = std::min(size, partial_frame_remaining_);
+                lanes_[partial_lane_]->continueFrame(data, length);
+                partial_frame_remaining_ -= length;
+            }
+            else
+            {
+                size_t frame_size = 0;
+                if (size >= sizeof(protocol_header__) && std::memcmp(data, protocol_header__, 4) == 0)
+                {
+                    frame_size = sizeof(protocol_header__);
+                    partial_lane_ = laneIndex(FramePriority::Control);
+                }
+                else
+                {
+                    if (size < frame_header_size__)
+                    {
+                        throw std::runtime_error("FrameScheduler error: Truncated frame header.");
+                    }
+                    frame_size = frame_header_size__ + readUint32(data + 3) + frame_end_size__;
+                    partial_lane_ = laneIndex(frameLane(data, size));
+                }
+
+                length = std::min(size, frame_size);
+                lanes_[partial_lane_]->startFrame(data, length, frame_size);
+                partial_frame_remaining_ = frame_size - length;
+            }
+            data += length;
+            size -= length;
+        }
+    }
+
+    bool FrameScheduler::empty() const
+    {
+        return std::all_of(lanes_.begin(), lanes_.end(), [](const auto& lane)
+        {
+            return lane->completeFrameCount() == 0;
+        });
+    }
+
+    size_t FrameScheduler::pendingBytes() const
+    {
+        size_t pending_bytes = 0;
+        for (const auto& lane : lanes_)
+        {
+            pending_bytes += lane->buffer_.pendingBytes();
+        }
+        return pending_bytes;
+    }
+
+    size_t FrameScheduler::gather(
+        std::vector<boost::asio::const_buffer>& buffers, size_t max_bytes, size_t max_buffers)
+    {
+        using namespace FrameSchedulerPrivate;
+
+        const size_t control = laneIndex(FramePriority::Control);
+        const size_t high = laneIndex(FramePriority::High);
+        const size_t normal = laneIndex(FramePriority::Normal);
+
+        // Plans the frames of the write first, they are then gathered lane by lane
+        planned_frames_.fill(0);
+        planned_bytes_.fill(0);
+        planned_total_bytes_ = 0;
+        planFrames(control, max_bytes, nullptr);
+        if (is_draining_)
+        {
+            planFrames(high, max_bytes, nullptr);
+            planFrames(normal, max_bytes, nullptr);
+        }
+        else
+        {
+            bool is_full = false;
+            bool has_waiting_frames = true;
+            while (!is_full && has_waiting_frames)
+            {
+                has_waiting_frames = false;
+                for (const size_t lane_index : { high, normal })
+                {
+                    const auto& lane = *lanes_[lane_index];
+                    if (planned_frames_[lane_index] < lane.completeFrameCount())
+                    {
+                        has_waiting_frames = true;
+                        deficits_[lane_index] += weights_[lane_index] * quantum__;
+                        is_full = !planFrames(lane_index, max_bytes, &deficits_[lane_index]);
+                    }
+                    // An idle lane doesn't save its share for later
+                    if (planned_frames_[lane_index] == lane.completeFrameCount())
+                    {
+                        deficits_[lane_index] = 0;
+                    }
+                    if (is_full)
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+
+        size_t gathered = 0;
+        gathered_frames_.fill(0);
+        gathered_bytes_.fill(0);
+        gathered_since_.fill(std::nullopt);
+        const auto now = MetricsClock::now();
+        for (size_t lane_index = 0; lane_index < lane_count__; ++lane_index)
+        {
+            if (planned_frames_[lane_index] == 0)
+            {
+                continue;
+            }
+
+            auto& lane = *lanes_[lane_index];
+            const size_t first_buffer = buffers.size();
+            size_t frames = planned_frames_[lane_index];
+            size_t bytes = lane.buffer_.gather(buffers, planned_bytes_[lane_index], max_buffers);
+            const bool is_out_of_buffers = bytes < planned_bytes_[lane_index];
+            if (is_out_of_buffers)
+            {
+                // The write ends with the last whole frame that fits in the buffers
+                size_t whole_frames_bytes = 0;
+                frames = 0;
+                while (whole_frames_bytes + lane.frameSize(frames) <= bytes)
+                {
+                    whole_frames_bytes += lane.frameSize(frames++);
+                }
+
+                if (frames == 0 && gathered == 0)
+                {
+                    // A single frame spread over more chunks than max_buffers
+                    buffers.resize(first_buffer);
+                    whole_frames_bytes =
+                        lane.buffer_.gather(buffers, lane.frameSize(0), std::numeric_limits<size_t>::max());
+                    frames = 1;
+                }
+                else
+                {
+                    truncateBuffers(buffers, first_buffer, whole_frames_bytes);
+                }
+
+                if (lane_index != control)
+                {
+                    deficits_[lane_index] += planned_bytes_[lane_index] - whole_frames_bytes;
+                }
+                bytes = whole_frames_bytes;
+            }
+
+            if (frames > 0)
+            {
+                gathered_frames_[lane_index] = frames;
+                gathered_bytes_[lane_index] = bytes;
+                gathered_since_[lane_index] = lane.pendingSince();
+                lane.onGathered(frames, now);
+                gathered += bytes;
+            }
+            if (is_out_of_buffers)
+            {
+                break;
+            }
+        }
+        return gathered;
+    }
+
+    void FrameScheduler::consume(size_t size)
+    {
+        size_t consumed = 0;
+        for (size_t lane_index = 0; lane_index < lane_count__; ++lane_index)
+        {
+            if (gathered_frames_[lane_index] > 0)
+            {
+                lanes_[lane_index]->consume(gathered_frames_[lane_index], gathered_bytes_[lane_index]);
+                consumed += gathered_bytes_[lane_index];
+            }
+        }
+        assert(consumed == size);
+
+        gathered_frames_.fill(0);
+        gathered_bytes_.fill(0);
+        gathered_since_.fill(std::nullopt);
+    }
+
+    std::optional<MetricsClock::time_point> FrameScheduler::gatheredSince(FramePriority priority) const
+    {
+        return gathered_since_[FrameSchedulerPrivate::laneIndex(priority)];
+    }
+
+    OutputBufferPool::Statistics FrameScheduler::statistics() const
+    {
+        OutputBufferPool::Statistics statistics;
+        for (const auto& lane : lanes_)
+        {
+            const auto lane_statistics = lane->buffer_.statistics();
+            statistics.chunk_size_ = lane_statistics.chunk_size_;
+            statistics.allocated_chunks_ += lane_statistics.allocated_chunks_;
+            statistics.free_chunks_ += lane_statistics.free_chunks_;
+            statistics.peak_allocated_chunks_ += lane_statistics.peak_allocated_chunks_;
+            statistics.pending_bytes_ += lane_statistics.pending_bytes_;
+            statistics.chunk_allocations_ += lane_statistics.chunk_allocations_;
+        }
+        return statistics;
+    }
+
+    bool FrameScheduler::planFrames(size_t lane_index, size_t max_bytes, size_t* deficit)
+    {
+        const auto& lane = *lanes_[lane_index];
+        auto& frames = planned_frames_[lane_index];
+        while (frames < lane.completeFrameCount())
+        {
+            const size_t frame_size = lane.frameSize(frames);
+            if (deficit != nullptr && frame_size > *deficit)
+            {
+                return true;
+            }
+            // The first frame of a write is taken whatever its size
+            if (planned_total_bytes_ > 0 && planned_total_bytes_ + frame_size > max_bytes)
+            {
+                return false;
+            }
+
+            ++frames;
+            planned_bytes_[lane_index] += frame_size;
+            planned_total_bytes_ += frame_size;
+            if (deficit != nullptr)
+            {
+                *deficit -= frame_size;
+            }
+        }
+        return true;
+    }
+
+    FramePriority FrameScheduler::frameLane(const char* frame, size_t size)
+    {
+        using namespace FrameSchedulerPrivate;
+
+        const uint16_t channel = readUint16(frame + 1);
+        if (static_cast<uint8_t>(frame[0]) == method_frame__ && size >= frame_header_size__ + 4)
+        {
+            const uint16_t class_id = readUint16(frame + frame_header_size__);
+            const uint16_t method_id = readUint16(frame + frame_header_size__ + 2);
+            if (channel == 0 && class_id == 10 && method_id == 50)
+            {
+                // connection.close, behind everything already queued
+                is_draining_ = true;
+                return FramePriority::Normal;
+            }
+            if (class_id == 20 && method_id == 10)
+            {
+                // channel.open, the control lane is written before any later frame of the channel whatever its lane
+                if (channel >= channel_lanes_.size())
+                {
+                    channel_lanes_.resize(size_t(channel) + 1, FramePriority::Normal);
+                }
+                channel_lanes_[channel] = opening_channel_priority_;
+                return FramePriority::Control;
+            }
+        }
+
+        if (channel == 0)
+        {
+            return FramePriority::Control;
+        }
+        return channel < channel_lanes_.size() ? channel_lanes_[channel] : FramePriority::Normal;
+    }
+
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "OutputBufferPool.h"
+#include "StreamerMetrics.h"
+
+#include <boost/asio/buffer.hpp>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace RabbitMqStreamingPlugin
+{
+    namespace FrameSchedulerPrivate
+    {
+        class Lane;
+    }
+
+    enum class FramePriority : uint8_t
+    {
+        // Channel 0 (heartbeats and connection methods) and channel.open, always written first
+        Control,
+        High,
+        Normal,
+    };
+
+    /*
+     * FrameScheduler stores the frames waiting to be written on the socket in one lane per FramePriority, each lane
+     * an OutputBufferPool, instead of a single FIFO. Every frame of a channel goes to the lane of that channel so
+     * their order is kept, and a write gathers whole frames from the lanes: the control lane first, then the high and
+     * normal lanes by deficit round robin on their weights. Heartbeats and connection methods never wait behind queued
+     * body frames, and bulk channels still get their share of every write under high priority traffic.
+     *
+     * Frames are split on their AMQP header, AMQP-CPP hands them over whole or in consecutive pieces. The lane of a
+     * channel is chosen when its channel.open is appended, from setOpeningChannelPriority. Once a connection.close is
+     * appended, the lanes are drained in priority order so it is written after every frame queued before it.
+     *
+     * The scheduler itself must only be used from the IO thread, statistics can be read from any thread.
+     */
+    class FrameScheduler
+    {
+    public:
+        // A lane gets weight times 4 KiB of its frames per round while the other one has frames waiting
+        FrameScheduler(
+            size_t chunk_size, size_t max_free_chunks, size_t high_priority_weight, size_t normal_priority_weight);
+        ~FrameScheduler();
+
+        FrameScheduler(const FrameScheduler&) = delete;
+        FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+        // Lane of the channels opened from now on, Normal by default
+        void setOpeningChannelPriority(FramePriority priority);
+
+        // Throws when the data doesn't start with a frame header or the rest of a frame
+        void append(const char* data, size_t size);
+
+        // No whole frame waiting to be gathered
+        bool empty() const;
+        size_t pendingBytes() const;
+
+        // Appends to buffers whole frames from the lanes, up to max_bytes and max_buffers entries in buffers, or a
+        // single frame when the first one is larger. Returns the number of bytes gathered, they stay pending until
+        // consume is called.
+        size_t gather(std::vector<boost::asio::const_buffer>& buffers, size_t max_bytes, size_t max_buffers);
+
+        // Releases the frames of the last gather once written, size is what gather returned
+        void consume(size_t size);
+
+        // When the oldest frame of the lane taken by the last gather was queued, empty when it took none
+        std::optional<MetricsClock::time_point> gatheredSince(FramePriority priority) const;
+
+        // Summed over the lanes
+        OutputBufferPool::Statistics statistics() const;
+
+    private:
+        static constexpr size_t lane_count__ = 3;
+
+        // Lane of a frame from its header, records the lane of the channel on channel.open
+        FramePriority frameLane(const char* frame, size_t size);
+        // Plans whole frames of the lane while they fit in the write and, when given, in the deficit of the lane
+        bool planFrames(size_t lane_index, size_t max_bytes, size_t* deficit);
+
+        std::array<std::unique_ptr<FrameSchedulerPrivate::Lane>, lane_count__> lanes_;
+        std::array<size_t, lane_count__> weights_;
+        std::array<size_t, lane_count__> deficits_;
+
+        // Lane of every channel id that was opened, Normal for the others
+        std::vector<FramePriority> channel_lanes_;
+        FramePriority opening_channel_priority_;
+        // Lane receiving the rest of a frame appended in pieces, and the bytes still expected
+        size_t partial_lane_;
+        size_t partial_frame_remaining_;
+        bool is_draining_;
+
+        // Frames and bytes of every lane taken by the plan then by the last gather
+        std::array<size_t, lane_count__> planned_frames_;
+        std::array<size_t, lane_count__> planned_bytes_;
+        size_t planned_total_bytes_;
+        std::array<size_t, lane_count__> gathered_frames_;
+        std::array<size_t, lane_count__> gathered_bytes_;
+        std::array<std::optional<MetricsClock::time_point>, lane_count__> gathered_since_;
+    };
+
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,105 @@
+#include "HandlerAllocator.h"
+
+#include <algorithm>
+#include <new>
+
+namespace RabbitMqStreamingPlugin
+{
+    void HandlerMemory::Release::operator()(HandlerMemory* memory) const
+    {
+        memory->release();
+    }
+
+    HandlerMemory::Handle HandlerMemory::create(size_t block_size, size_t max_free_blocks)
+    {
+        return Handle(new HandlerMemory(block_size, max_free_blocks));
+    }
+
+    HandlerMemory::HandlerMemory(size_t block_size, size_t max_free_blocks)
+        : block_size_(std::max<size_t>(block_size, sizeof(void*)))
+        , max_free_blocks_(max_free_blocks)
+        , outstanding_allocations_(0)
+        , heap_allocations_(0)
+        , is_released_(false)
+    {
+        // Giving a block back never allocates
+        free_blocks_.reserve(max_free_blocks_);
+    }
+
+    HandlerMemory::~HandlerMemory()
+    {
+        for (void* block : free_blocks_)
+        {
+            ::operator delete(block);
+        }
+    }
+
+    void* HandlerMemory::allocate(size_t size)
+    {
+        {
+            std::unique_lock lock(mutex_);
+            ++outstanding_allocations_;
+            if (size <= block_size_ && !free_blocks_.empty())
+            {
+                void* block = free_blocks_.back();
+                free_blocks_.pop_back();
+                return block;
+            }
+            ++heap_allocations_;
+        }
+
+        try
+        {
+            return ::operator new(std::max(size, block_size_));
+        }
+        catch (const std::bad_alloc&)
+        {
+            std::unique_lock lock(mutex_);
+            --outstanding_allocations_;
+            throw;
+        }
+    }
+
+    void HandlerMemory::deallocate(void* pointer, size_t size)
+    {
+        std::unique_lock lock(mutex_);
+        if (size <= block_size_ && free_blocks_.size() < max_free_blocks_)
+        {
+            free_blocks_.push_back(pointer);
+        }
+        else
+        {
+            ::operator delete(pointer);
+        }
+
+        --outstanding_allocations_;
+        if (is_released_ && outstanding_allocations_ == 0)
+        {
+            lock.unlock();
+            delete this;
+        }
+    }
+
+    size_t HandlerMemory::blockSize() const
+    {
+        return block_size_;
+    }
+
+    uint64_t HandlerMemory::heapAllocations() const
+    {
+        std::unique_lock lock(mutex_);
+        return heap_allocations_;
+    }
+
+    void HandlerMemory::release()
+    {
+        std::unique_lock lock(mutex_);
+        is_released_ = true;
+        if (outstanding_allocations_ == 0)
+        {
+            lock.unlock();
+            delete this;
+        }
+    }
+
+}  // namespace RabbitMqStreamingPlugin
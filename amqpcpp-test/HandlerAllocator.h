@@ -0,0 +1,175 @@
+#pragma once
+
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace RabbitMqStreamingPlugin
+{
+    /*
+     * HandlerMemory recycles the memory asio allocates for the handlers of an object: the completion handlers of its
+     * socket operations, or the closures it posts to the IO thread. An allocation up to the block size takes a block
+     * from the free list, asio gives it back before invoking the handler, so the next operation started by the
+     * handler reuses it. Blocks are allocated on the heap only while the free list is empty, and larger handlers
+     * always are.
+     *
+     * A block may be allocated on one thread and given back on another (a closure posted by a publishing thread and
+     * run by the IO thread), the free list is protected by a mutex.
+     *
+     * Handlers still queued in an io_service are only destroyed with it, possibly after their object. The memory is
+     * therefore released through its Handle and deletes itself once every block has been given back.
+     */
+    class HandlerMemory
+    {
+    public:
+        struct Release
+        {
+            void operator()(HandlerMemory* memory) const;
+        };
+        using Handle = std::unique_ptr<HandlerMemory, Release>;
+
+        static Handle create(size_t block_size, size_t max_free_blocks);
+
+        HandlerMemory(const HandlerMemory&) = delete;
+        HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+        void* allocate(size_t size);
+        void deallocate(void* pointer, size_t size);
+
+        size_t blockSize() const;
+        // Blocks and larger handlers allocated on the heap since the creation
+        uint64_t heapAllocations() const;
+
+    private:
+        HandlerMemory(size_t block_size, size_t max_free_blocks);
+        ~HandlerMemory();
+
+        void release();
+
+        const size_t block_size_;
+        const size_t max_free_blocks_;
+
+        mutable std::mutex mutex_;
+        std::vector<void*> free_blocks_;
+        size_t outstanding_allocations_;
+        uint64_t heap_allocations_;
+        bool is_released_;
+    };
+
+    // Standard allocator over a HandlerMemory, the associated allocator of the handlers bound to it
+    template <typename T>
+    class HandlerAllocator
+    {
+    public:
+        using value_type = T;
+
+        explicit HandlerAllocator(HandlerMemory& memory) noexcept
+            : memory_(&memory)
+        {
+        }
+
+        template <typename U>
+        HandlerAllocator(const HandlerAllocator<U>& other) noexcept
+            : memory_(other.memory_)
+        {
+        }
+
+        T* allocate(size_t count)
+        {
+            static_assert(alignof(T) <= alignof(std::max_align_t), "HandlerMemory blocks are not over-aligned");
+            return static_cast<T*>(memory_->allocate(sizeof(T) * count));
+        }
+
+        void deallocate(T* pointer, size_t count)
+        {
+            memory_->deallocate(pointer, sizeof(T) * count);
+        }
+
+        template <typename U>
+        bool operator==(const HandlerAllocator<U>& other) const noexcept
+        {
+            return memory_ == other.memory_;
+        }
+
+        template <typename U>
+        bool operator!=(const HandlerAllocator<U>& other) const noexcept
+        {
+            return memory_ != other.memory_;
+        }
+
+    private:
+        template <typename U>
+        friend class HandlerAllocator;
+
+        HandlerMemory* memory_;
+    };
+
+    // Handler whose associated allocator is a HandlerAllocator, its associated executor is the one of the wrapped
+    // handler
+    template <typename Handler>
+    class AllocatingHandler
+    {
+    public:
+        using allocator_type = HandlerAllocator<Handler>;
+
+        AllocatingHandler(HandlerMemory& memory, Handler handler)
+            : memory_(&memory)
+            , handler_(std::move(handler))
+        {
+        }
+
+        allocator_type get_allocator() const noexcept
+        {
+            return allocator_type(*memory_);
+        }
+
+        const Handler& handler() const noexcept
+        {
+            return handler_;
+        }
+
+        template <typename... Args>
+        void operator()(Args&&... args)
+        {
+            handler_(std::forward<Args>(args)...);
+        }
+
+    private:
+        HandlerMemory* memory_;
+        Handler handler_;
+    };
+
+    template <typename Handler>
+    AllocatingHandler<std::decay_t<Handler>> bindHandlerMemory(HandlerMemory& memory, Handler&& handler)
+    {
+        return AllocatingHandler<std::decay_t<Handler>>(memory, std::forward<Handler>(handler));
+    }
+
+}  // namespace RabbitMqStreamingPlugin
+
+namespace boost
+{
+    namespace asio
+    {
+        template <typename Handler, typename Executor>
+        struct associated_executor<RabbitMqStreamingPlugin::AllocatingHandler<Handler>, Executor>
+        {
+            using type = associated_executor_t<Handler, Executor>;
+
+            static type get(
+                const RabbitMqStreamingPlugin::AllocatingHandler<Handler>& handler,
+                const Executor& executor = Executor()) noexcept
+            {
+                return associated_executor<Handler, Executor>::get(handler.handler(), executor);
+            }
+        };
+
+    }  // namespace asio
+}  // namespace boost
@@ -0,0 +1,152 @@
+#include "Logging.h"
+
+#include <iomanip>
+#include <iostream>
+
+namespace RabbitMqStreamingPlugin
+{
+    namespace Logging
+    {
+        namespace LoggingPrivate
+        {
+            const char* levelName(LogLevel level)
+            {
+                switch (level)
+                {
+                case LogLevel::Trace:
+                    return "TRACE";
+                case LogLevel::Debug:
+                    return "DEBUG";
+                case LogLevel::Info:
+                    return "INFO";
+                case LogLevel::Warning:
+                    return "WARNING";
+                case LogLevel::Error:
+                    return "ERROR";
+                default:
+                    return "";
+                }
+            }
+        }  // namespace LoggingPrivate
+
+        Logger& Logger::instance()
+        {
+            static Logger logger;
+            return logger;
+        }
+
+        Logger::Logger()
+            : slots_(std::make_unique<Slot[]>(capacity__))
+            , push_position_(0)
+            , pop_position_(0)
+            , dropped_records_(0)
+            , should_quit_(false)
+        {
+            for (size_t index = 0; index < capacity__; ++index)
+            {
+                slots_[index].sequence_.store(index, std::memory_order_relaxed);
+            }
+
+            sink_thread_ = std::thread([this]()
+            {
+                runSink();
+            });
+        }
+
+        Logger::~Logger()
+        {
+            should_quit_ = true;
+            sink_thread_.join();
+        }
+
+        uint64_t Logger::droppedRecords() const
+        {
+            return dropped_records_.load(std::memory_order_relaxed);
+        }
+
+        void Logger::flush()
+        {
+            const uint64_t position = push_position_.load(std::memory_order_acquire);
+            while (pop_position_.load(std::memory_order_acquire) < position)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        // Bounded multi-producer queue: a slot is free for the producer claiming position p when its sequence is p,
+        // and ready for the consumer when its sequence is p + 1.
+        void Logger::push(const LogRecord& record)
+        {
+            uint64_t position = push_position_.load(std::memory_order_relaxed);
+            while (true)
+            {
+                Slot& slot = slots_[position % capacity__];
+                const uint64_t sequence = slot.sequence_.load(std::memory_order_acquire);
+                if (sequence == position)
+                {
+                    if (push_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        slot.record_ = record;
+                        slot.sequence_.store(position + 1, std::memory_order_release);
+                        return;
+                    }
+                }
+                else if (sequence < position)
+                {
+                    dropped_records_.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                else
+                {
+                    position = push_position_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool Logger::pop(LogRecord& record)
+        {
+            const uint64_t position = pop_position_.load(std::memory_order_relaxed);
+            Slot& slot = slots_[position % capacity__];
+            if (slot.sequence_.load(std::memory_order_acquire) != position + 1)
+            {
+                return false;
+            }
+
+            record = slot.record_;
+            slot.sequence_.store(position + capacity__, std::memory_order_release);
+            pop_position_.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        void Logger::runSink()
+        {
+            LogRecord record;
+            while (true)
+            {
+                bool has_written = false;
+                while (pop(record))
+                {
+                    const auto time = std::chrono::duration_cast<std::chrono::microseconds>(
+                        record.time_.time_since_epoch()).count();
+                    std::cout << time << " " << record.thread_id_ << " " << LoggingPrivate::levelName(record.level_)
+                        << ": " << std::string_view(record.text_.data(), record.size_) << "\n";
+                    has_written = true;
+                }
+
+                if (has_written)
+                {
+                    std::cout.flush();
+                }
+                else if (should_quit_)
+                {
+                    return;
+                }
+                else
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+        }
+
+    }  // namespace Logging
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+// Lowest log level compiled in: 0 trace, 1 debug, 2 info, 3 warning, 4 error, 5 off.
+// The calls below that level are discarded at compile time, their arguments aren't even evaluated.
+#ifndef AMQPCPP_STREAMER_LOG_LEVEL
+#define AMQPCPP_STREAMER_LOG_LEVEL 2
+#endif
+
+namespace RabbitMqStreamingPlugin
+{
+    namespace Logging
+    {
+        enum class LogLevel
+        {
+            Trace = 0,
+            Debug = 1,
+            Info = 2,
+            Warning = 3,
+            Error = 4,
+            Off = 5,
+        };
+
+        constexpr bool isCompiled(LogLevel level)
+        {
+            return static_cast<int>(level) >= AMQPCPP_STREAMER_LOG_LEVEL && level != LogLevel::Off;
+        }
+
+        struct LogRecord
+        {
+            static constexpr size_t max_text_size__ = 240;
+
+            LogLevel level_;
+            std::thread::id thread_id_;
+            std::chrono::system_clock::time_point time_;
+            size_t size_;
+            std::array<char, max_text_size__> text_;
+
+            void append(std::string_view text)
+            {
+                const size_t length = std::min(text.size(), text_.size() - size_);
+                std::memcpy(text_.data() + size_, text.data(), length);
+                size_ += length;
+            }
+
+            void append(const char* text)
+            {
+                append(std::string_view(text != nullptr ? text : "(null)"));
+            }
+
+            void append(const std::string& text)
+            {
+                append(std::string_view(text));
+            }
+
+            void append(char character)
+            {
+                append(std::string_view(&character, 1));
+            }
+
+            void append(bool value)
+            {
+                append(std::string_view(value ? "true" : "false"));
+            }
+
+            // bool has its own overload, to_chars doesn't take it
+            template <typename Number,
+                typename = std::enable_if_t<std::is_arithmetic_v<Number> && !std::is_same_v<Number, bool>>>
+            void append(Number number)
+            {
+                if constexpr (std::is_floating_point_v<Number>)
+                {
+                    // Log with a fixed precision, printf style, to avoid depending on floating point to_chars
+                    char buffer[32];
+                    const int length = std::snprintf(buffer, sizeof(buffer), "%.3f", static_cast<double>(number));
+                    append(std::string_view(buffer, length > 0 ? static_cast<size_t>(length) : 0));
+                }
+                else
+                {
+                    char buffer[24];
+                    const auto result = std::to_chars(std::begin(buffer), std::end(buffer), number);
+                    append(std::string_view(buffer, result.ptr - buffer));
+                }
+            }
+        };
+
+        /*
+         * Logger formats the records on the calling thread into a fixed size record and pushes it in a bounded
+         * lock-free ring buffer. A background thread drains the ring buffer into std::cout, so neither the IO
+         * thread nor the publishers ever wait on the console. When the ring buffer is full, the record is dropped
+         * and counted instead of blocking.
+         */
+        class Logger
+        {
+        public:
+            static Logger& instance();
+
+            template <typename... Args>
+            void log(LogLevel level, const Args&... args)
+            {
+                LogRecord record;
+                record.level_ = level;
+                record.thread_id_ = std::this_thread::get_id();
+                record.time_ = std::chrono::system_clock::now();
+                record.size_ = 0;
+                (record.append(args), ...);
+                push(record);
+            }
+
+            // Number of records dropped because the ring buffer was full
+            uint64_t droppedRecords() const;
+
+            // Blocks until every record pushed so far has been written
+            void flush();
+
+        private:
+            Logger();
+            ~Logger();
+
+            struct Slot
+            {
+                std::atomic<uint64_t> sequence_;
+                LogRecord record_;
+            };
+
+            void push(const LogRecord& record);
+            bool pop(LogRecord& record);
+            void runSink();
+
+            static constexpr size_t capacity__ = 4096;
+
+            std::unique_ptr<Slot[]> slots_;
+            std::atomic<uint64_t> push_position_;
+            std::atomic<uint64_t> pop_position_;
+            std::atomic<uint64_t> dropped_records_;
+            std::atomic<bool> should_quit_;
+            std::thread sink_thread_;
+        };
+
+    }  // namespace Logging
+}  // namespace RabbitMqStreamingPlugin
+
+#define STREAMER_LOG(level, ...)                                                            \
+    do                                                                                      \
+    {                                                                                       \
+        if constexpr (::RabbitMqStreamingPlugin::Logging::isCompiled(level))               \
+        {                                                                                   \
+            ::RabbitMqStreamingPlugin::Logging::Logger::instance().log(level, __VA_ARGS__); \
+        }                                                                                   \
+    } while (false)
+
+#define STREAMER_LOG_TRACE(...) STREAMER_LOG(::RabbitMqStreamingPlugin::Logging::LogLevel::Trace, __VA_ARGS__)
+#define STREAMER_LOG_DEBUG(...) STREAMER_LOG(::RabbitMqStreamingPlugin::Logging::LogLevel::Debug, __VA_ARGS__)
+#define STREAMER_LOG_INFO(...) STREAMER_LOG(::RabbitMqStreamingPlugin::Logging::LogLevel::Info, __VA_ARGS__)
+#define STREAMER_LOG_WARNING(...) STREAMER_LOG(::RabbitMqStreamingPlugin::Logging::LogLevel::Warning, __VA_ARGS__)
+#define STREAMER_LOG_ERROR(...) STREAMER_LOG(::RabbitMqStreamingPlugin::Logging::LogLevel::Error, __VA_ARGS__)
@@ -0,0 +1,196 @@
+#include "MessageAggregator.h"
+
+#include "MessageContainer.h"
+
+#include <boost/asio/bind_executor.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+namespace RabbitMqStreamingPlugin
+{
+    MessageAggregator::Container::Container(boost::asio::io_context& io_context)
+        : message_bytes_(0)
+        , linger_timer_(io_context)
+        , generation_(0)
+        , is_submitting_(false)
+    {
+    }
+
+    MessageAggregator::MessageAggregator(
+        const AggregationOptions& options, FlowController& flow_controller, SubmitContainer submit_container)
+        : max_messages_(std::max<size_t>(options.max_messages_, 1))
+        , max_bytes_(options.max_bytes_)
+        , linger_(options.linger_)
+        , flow_controller_(flow_controller)
+        , submit_container_(std::move(submit_container))
+        , work_(boost::asio::make_work_guard(io_context_))
+    {
+        thread_ = std::thread([this]()
+        {
+            io_context_.run();
+        });
+    }
+
+    MessageAggregator::~MessageAggregator()
+    {
+        flush();
+        // Returns once the completions of the submitted containers have run
+        work_.reset();
+        thread_.join();
+    }
+
+    void MessageAggregator::add(OutgoingMessage message, PublishCompletion completion)
+    {
+        const size_t body_size = message.message_.size();
+        if (!flow_controller_.tryAcquire(1, body_size))
+        {
+            completion.complete(
+                std::make_exception_ptr(std::runtime_error("FlowController error: Publishing is paused.")),
+                io_context_.get_executor());
+            return;
+        }
+
+        Container& container = containerFor(message);
+        std::unique_lock lock(container.mutex_);
+
+        const size_t added_bytes = MessageContainer::size_prefix_bytes__ + message.message_.size();
+        if (!container.completions_.empty() && container.body_.size() + added_bytes > max_bytes_)
+        {
+            seal(container);
+        }
+
+        if (container.completions_.empty())
+        {
+            container.linger_timer_.expires_after(linger_);
+            container.linger_timer_.async_wait(
+                [this, &container, generation = container.generation_](const boost::system::error_code& error)
+            {
+                if (!error)
+                {
+                    onLingerTimeout(container, generation);
+                }
+            });
+        }
+
+        MessageContainer::append(container.body_, message.message_.view());
+        container.completions_.push_back(std::move(completion));
+        container.message_bytes_ += body_size;
+
+        if (container.completions_.size() >= max_messages_ || container.body_.size() >= max_bytes_)
+        {
+            seal(container);
+        }
+        submitSealed(container, lock);
+    }
+
+    void MessageAggregator::flush()
+    {
+        std::vector<Container*> containers;
+        {
+            std::unique_lock lock(containers_mutex_);
+            for (const auto& [key, container] : containers_)
+            {
+                containers.push_back(container.get());
+            }
+        }
+
+        for (Container* container : containers)
+        {
+            std::unique_lock lock(container->mutex_);
+            if (!container->completions_.empty())
+            {
+                seal(*container);
+            }
+            submitSealed(*container, lock);
+            // The containers sealed before are still submitted by another thread
+            container->submitted_cv_.wait(lock, [container]()
+            {
+                return !container->is_submitting_;
+            });
+        }
+    }
+
+    MessageAggregator::Container& MessageAggregator::containerFor(const OutgoingMessage& message)
+    {
+        // Reused by the thread, building the key doesn't allocate once it is large enough
+        thread_local std::string key;
+        key.assign(message.topic_).push_back('\0');
+        key.append(message.partition_key_).push_back('\0');
+        key.append(message.event_type_name_);
+
+        std::unique_lock lock(containers_mutex_);
+        auto& container = containers_[key];
+        if (!container)
+        {
+            container = std::make_unique<Container>(io_context_);
+            container->topic_ = message.topic_;
+            container->partition_key_ = message.partition_key_;
+            container->event_type_name_ = message.event_type_name_;
+        }
+        return *container;
+    }
+
+    void MessageAggregator::seal(Container& container)
+    {
+        container.sealed_.push_back(SealedContainer{
+            OutgoingMessage{
+                container.topic_,
+                container.partition_key_,
+                container.event_type_name_,
+                MessageBody(std::move(container.body_)),
+                true },
+            std::move(container.completions_),
+            container.message_bytes_ });
+        container.body_ = std::string();
+        container.completions_.clear();
+        container.message_bytes_ = 0;
+        container.linger_timer_.cancel();
+        ++container.generation_;
+    }
+
+    void MessageAggregator::submitSealed(Container& container, std::unique_lock<std::mutex>& lock)
+    {
+        if (container.is_submitting_)
+        {
+            return;
+        }
+
+        container.is_submitting_ = true;
+        while (!container.sealed_.empty())
+        {
+            SealedContainer sealed = std::move(container.sealed_.front());
+            container.sealed_.pop_front();
+            lock.unlock();
+
+            // The credit of the messages is handed over to their container
+            flow_controller_.release(sealed.completions_.size(), sealed.message_bytes_);
+            // Every message of the container is settled by its confirm
+            submit_container_(std::move(sealed.message_), PublishCompletion(boost::asio::bind_executor(io_context_,
+                [this, completions = std::move(sealed.completions_)](std::exception_ptr exception) mutable
+            {
+                for (auto& completion : completions)
+                {
+                    completion.complete(exception, io_context_.get_executor());
+                }
+            })));
+
+            lock.lock();
+        }
+        container.is_submitting_ = false;
+        container.submitted_cv_.notify_all();
+    }
+
+    void MessageAggregator::onLingerTimeout(Container& container, uint64_t generation)
+    {
+        std::unique_lock lock(container.mutex_);
+        if (container.generation_ == generation && !container.completions_.empty())
+        {
+            seal(container);
+        }
+        submitSealed(container, lock);
+    }
+
+}  // namespace RabbitMqStreamingPlugin
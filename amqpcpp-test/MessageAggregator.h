@@ -0,0 +1,114 @@
+#pragma once
+
+#include "FlowController.h"
+#include "OutgoingMessage.h"
+#include "PublishCompletion.h"
+#include "StreamerOptions.h"
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace RabbitMqStreamingPlugin
+{
+    /*
+     * MessageAggregator packs the small messages with the same topic, partition key and event type into a
+     * MessageContainer, published as a single AMQP message when it is full (AggregationOptions) or when its linger
+     * time is over. The broker then confirms, routes and stores one message per container.
+     *
+     * Each message keeps its own completion, settled with the confirm of its container. The aggregator thread runs
+     * the linger timers and, for the handlers without executor of their own, the completion handlers.
+     *
+     * The messages held in the containers are accounted for by the FlowController, their credit is handed over to the
+     * container when it is submitted.
+     *
+     * A sealed container is queued under the lock of its key and submitted after that lock is released, by a single
+     * thread at a time for each key, so the ordering within a partition key is kept without blocking the producers
+     * of that key during the submission. A container is kept for every key seen, they are expected to be a bounded
+     * set.
+     */
+    class MessageAggregator
+    {
+    public:
+        // Publishes a sealed container, must not block
+        using SubmitContainer = std::function<void(OutgoingMessage container, PublishCompletion completion)>;
+
+        MessageAggregator(
+            const AggregationOptions& options, FlowController& flow_controller, SubmitContainer submit_container);
+        // Publishes the containers still open
+        ~MessageAggregator();
+
+        MessageAggregator(const MessageAggregator&) = delete;
+        MessageAggregator& operator=(const MessageAggregator&) = delete;
+
+        void add(OutgoingMessage message, PublishCompletion completion);
+
+        // Publishes every container right away, without waiting for their linger time, returns once they are submitted
+        void flush();
+
+    private:
+        struct SealedContainer
+        {
+            OutgoingMessage message_;
+            std::vector<PublishCompletion> completions_;
+            // Flow control credit of the messages
+            size_t message_bytes_;
+        };
+
+        struct Container
+        {
+            explicit Container(boost::asio::io_context& io_context);
+
+            std::mutex mutex_;
+            std::string topic_;
+            std::string partition_key_;
+            std::string event_type_name_;
+
+            std::string body_;
+            std::vector<PublishCompletion> completions_;
+            size_t message_bytes_;
+            boost::asio::steady_timer linger_timer_;
+            // Incremented when sealed, a linger timer of a previous generation is ignored
+            uint64_t generation_;
+
+            // Sealed containers waiting for their submission, in order
+            std::deque<SealedContainer> sealed_;
+            bool is_submitting_;
+            std::condition_variable submitted_cv_;
+        };
+
+        Container& containerFor(const OutgoingMessage& message);
+        // Queues the container content for its submission and starts a new generation, the container mutex must be
+        // held
+        void seal(Container& container);
+        // Submits the sealed containers unless another thread already does, the lock is released during each
+        // submission
+        void submitSealed(Container& container, std::unique_lock<std::mutex>& lock);
+        void onLingerTimeout(Container& container, uint64_t generation);
+
+        const size_t max_messages_;
+        const size_t max_bytes_;
+        const std::chrono::microseconds linger_;
+        FlowController& flow_controller_;
+        const SubmitContainer submit_container_;
+
+        boost::asio::io_context io_context_;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_;
+
+        std::mutex containers_mutex_;
+        std::unordered_map<std::string, std::unique_ptr<Container>> containers_;
+
+        std::thread thread_;
+    };
+
+}  // namespace RabbitMqStreamingPlugin
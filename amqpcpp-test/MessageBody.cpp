@@ -0,0 +1,64 @@
+#include "MessageBody.h"
+
+#include <utility>
+
+namespace RabbitMqStreamingPlugin
+{
+    MessageBody::MessageBody()
+        : content_encoding_(nullptr)
+    {
+    }
+
+    MessageBody::MessageBody(std::string body)
+        : MessageBody(std::make_shared<const std::string>(std::move(body)))
+    {
+    }
+
+    MessageBody::MessageBody(std::shared_ptr<const std::string> body)
+        : view_(body != nullptr ? std::string_view(*body) : std::string_view())
+        , content_encoding_(nullptr)
+    {
+        owner_ = std::move(body);
+    }
+
+    MessageBody::MessageBody(std::shared_ptr<const void> owner, std::string_view body, const char* content_encoding)
+        : owner_(std::move(owner))
+        , view_(body)
+        , content_encoding_(content_encoding)
+    {
+    }
+
+    MessageBody MessageBody::borrow(std::string_view body, ReleaseCallback on_released)
+    {
+        // The deleter of an empty owner still runs when the last copy of the body is dropped
+        std::shared_ptr<const void> owner(nullptr, [on_released = std::move(on_released)](const void*)
+        {
+            if (on_released)
+            {
+                on_released();
+            }
+        });
+        return MessageBody(std::move(owner), body);
+    }
+
+    const char* MessageBody::data() const
+    {
+        return view_.data();
+    }
+
+    size_t MessageBody::size() const
+    {
+        return view_.size();
+    }
+
+    std::string_view MessageBody::view() const
+    {
+        return view_;
+    }
+
+    const char* MessageBody::contentEncoding() const
+    {
+        return content_encoding_;
+    }
+
+}  // namespace RabbitMqStreamingPlugin
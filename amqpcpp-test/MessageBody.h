@@ -0,0 +1,52 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace RabbitMqStreamingPlugin
+{
+    /*
+     * MessageBody is an immutable view of a message payload that keeps its storage alive until the message has been
+     * handed to AMQP-CPP on the IO thread. Copying a MessageBody never copies the payload, so it travels from the
+     * publishing thread to the channel by reference count only.
+     *
+     * The storage is either:
+     * - a std::string moved (or copied, for an lvalue) into the body,
+     * - a buffer shared with the caller through a std::shared_ptr,
+     * - a buffer owned by the caller, borrowed until the release callback is called.
+     *
+     * AMQP-CPP serializes the body into its content frames when the message is published, the storage is released
+     * right after that, before the broker confirm.
+     *
+     * A body compressed by the PayloadCompressor carries its content encoding, set in the envelope when published.
+     */
+    class MessageBody
+    {
+    public:
+        using ReleaseCallback = std::function<void()>;
+
+        MessageBody();
+        MessageBody(std::string body);
+        MessageBody(std::shared_ptr<const std::string> body);
+        // Any ref-counted buffer, body must stay valid as long as owner is alive. The content encoding must be a
+        // string literal, nullptr when the body isn't encoded.
+        MessageBody(std::shared_ptr<const void> owner, std::string_view body, const char* content_encoding = nullptr);
+
+        // The caller keeps body valid until on_released is called. It is called once, on the IO thread after the
+        // body has been serialized or on whichever thread drops the message when it can't be published.
+        static MessageBody borrow(std::string_view body, ReleaseCallback on_released);
+
+        const char* data() const;
+        size_t size() const;
+        std::string_view view() const;
+        const char* contentEncoding() const;
+
+    private:
+        std::shared_ptr<const void> owner_;
+        std::string_view view_;
+        const char* content_encoding_;
+    };
+
+}  // namespace RabbitMqStreamingPlugin
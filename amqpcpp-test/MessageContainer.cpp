@@ -0,0 +1,68 @@
+#include "MessageContainer.h"
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+namespace RabbitMqStreamingPlugin
+{
+    void MessageContainer::append(std::string& container, std::string_view message)
+    {
+        if (message.size() > std::numeric_limits<uint32_t>::max())
+        {
+            throw std::runtime_error("MessageContainer error: Message too large.");
+        }
+
+        const auto size = static_cast<uint32_t>(message.size());
+        const char prefix[size_prefix_bytes__] = {
+            static_cast<char>(size & 0xFF),
+            static_cast<char>((size >> 8) & 0xFF),
+            static_cast<char>((size >> 16) & 0xFF),
+            static_cast<char>((size >> 24) & 0xFF),
+        };
+        container.append(prefix, size_prefix_bytes__);
+        container.append(message.data(), message.size());
+    }
+
+    std::vector<std::string_view> MessageContainer::decode(std::string_view container)
+    {
+        std::vector<std::string_view> messages;
+        while (!container.empty())
+        {
+            if (container.size() < size_prefix_bytes__)
+            {
+                throw std::runtime_error("MessageContainer error: Truncated size prefix.");
+            }
+
+            const auto* prefix = reinterpret_cast<const unsigned char*>(container.data());
+            const size_t size = size_t(prefix[0]) | (size_t(prefix[1]) << 8) | (size_t(prefix[2]) << 16)
+                | (size_t(prefix[3]) << 24);
+            container.remove_prefix(size_prefix_bytes__);
+            if (container.size() < size)
+            {
+                throw std::runtime_error("MessageContainer error: Truncated message.");
+            }
+
+            messages.push_back(container.substr(0, size));
+            container.remove_prefix(size);
+        }
+        return messages;
+    }
+
+    bool MessageContainer::isContainer(const AMQP::MetaData& meta_data)
+    {
+        if (!meta_data.hasHeaders() || !meta_data.headers().contains(header__))
+        {
+            return false;
+        }
+
+        const std::string format = meta_data.headers().get(header__);
+        return format == format__;
+    }
+
+    void MessageContainer::setMetaData(AMQP::Table& header_table)
+    {
+        header_table.set(header__, format__);
+    }
+
+}  // namespace RabbitMqStreamingPlugin
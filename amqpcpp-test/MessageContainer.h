@@ -0,0 +1,37 @@
+#pragma once
+
+#define NOMINMAX
+#include <amqpcpp.h>
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace RabbitMqStreamingPlugin
+{
+    /*
+     * MessageContainer is the body format of the aggregated messages: the messages one after the other, each one
+     * preceded by its size as a 4 bytes little endian unsigned integer. A container is marked by the "container"
+     * header set to format__, next to the "proto" header naming the type of every message it holds.
+     *
+     * Consumers check isContainer on the received message and split its body with decode, after decompressing it
+     * when it has a content encoding.
+     */
+    class MessageContainer
+    {
+    public:
+        static constexpr const char* header__ = "container";
+        static constexpr const char* format__ = "length-prefixed-v1";
+        static constexpr size_t size_prefix_bytes__ = 4;
+
+        static void append(std::string& container, std::string_view message);
+
+        // Views of the messages in the container, throws when the container is truncated
+        static std::vector<std::string_view> decode(std::string_view container);
+
+        static bool isContainer(const AMQP::MetaData& meta_data);
+        static void setMetaData(AMQP::Table& header_table);
+    };
+
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,458 @@
+#include "MessageSpool.h"
+
+#include "Logging.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+
+namespace RabbitMqStreamingPlugin
+{
+    namespace MessageSpoolPrivate
+    {
+        constexpr uint64_t magic__ = 0x4C4F4F5053514D41;  // "AMQSPOOL"
+        constexpr uint32_t version__ = 1;
+
+        struct FileHeader
+        {
+            uint64_t magic_;
+            uint32_t version_;
+            uint32_t reserved_;
+            uint64_t capacity_;
+            // Offset of the oldest record and of the end of the newest one, equal when the spool is empty
+            uint64_t head_;
+            uint64_t tail_;
+            uint64_t head_sequence_;
+            uint64_t padding_[2];
+        };
+        static_assert(sizeof(FileHeader) == 64, "The records start on a cache line");
+
+        enum RecordState : uint32_t
+        {
+            Writing = 0,
+            Live = 1,
+            Released = 2,
+            // The rest of the file is unused, the next record is at the start of the data
+            Wrap = 3,
+        };
+
+        struct RecordHeader
+        {
+            uint32_t state_;
+            // Record size including this header, a multiple of 8
+            uint32_t size_;
+            uint64_t sequence_;
+            uint32_t topic_size_;
+            uint32_t partition_key_size_;
+            uint32_t event_type_name_size_;
+            uint32_t body_size_;
+        };
+        static_assert(sizeof(RecordHeader) == 32, "Records are 8 bytes aligned");
+
+        constexpr size_t data_begin__ = sizeof(FileHeader);
+        // The header and one empty record
+        constexpr size_t min_capacity__ = data_begin__ + sizeof(RecordHeader);
+
+        size_t alignRecordSize(size_t size)
+        {
+            return (size + 7) & ~size_t(7);
+        }
+
+        void throwSystemError(const std::string& what)
+        {
+            throw std::runtime_error("MessageSpool error: " + what + " failed.");
+        }
+    }  // namespace MessageSpoolPrivate
+
+    using namespace MessageSpoolPrivate;
+
+    MessageSpool::MessageSpool(const std::string& path, size_t capacity)
+        : data_(nullptr)
+        , capacity_(0)
+#if defined(_WIN32)
+        , file_(INVALID_HANDLE_VALUE)
+        , mapping_(nullptr)
+#else
+        , file_(-1)
+#endif
+        , next_sequence_(0)
+    {
+        // Checked before the file is created, the header would overlap the data or the mapping fail. An existing
+        // file keeps its own capacity.
+        const size_t aligned_capacity = capacity & ~size_t(7);
+        if (aligned_capacity < min_capacity__ && !std::filesystem::exists(path))
+        {
+            throw std::runtime_error("MessageSpool error: Capacity of " + std::to_string(capacity)
+                + " bytes is below the minimum of " + std::to_string(min_capacity__) + " bytes.");
+        }
+
+        map(path, aligned_capacity);
+        recover();
+    }
+
+    MessageSpool::~MessageSpool()
+    {
+        unmap();
+    }
+
+    uint64_t MessageSpool::append(const OutgoingMessage& message)
+    {
+        const size_t payload_size = message.topic_.size() + message.partition_key_.size()
+            + message.event_type_name_.size() + message.message_.size();
+        const size_t record_size = alignRecordSize(sizeof(RecordHeader) + payload_size);
+        if (record_size > std::numeric_limits<uint32_t>::max())
+        {
+            throw std::runtime_error("MessageSpool error: Message too large.");
+        }
+
+        std::unique_lock lock(mutex_);
+        auto* file_header = reinterpret_cast<FileHeader*>(data_);
+        const size_t offset = reserve(record_size);
+
+        auto* record_header = reinterpret_cast<RecordHeader*>(data_ + offset);
+        record_header->state_ = Writing;
+        record_header->size_ = static_cast<uint32_t>(record_size);
+        record_header->sequence_ = next_sequence_;
+        record_header->topic_size_ = static_cast<uint32_t>(message.topic_.size());
+        record_header->partition_key_size_ = static_cast<uint32_t>(message.partition_key_.size());
+        record_header->event_type_name_size_ = static_cast<uint32_t>(message.event_type_name_.size());
+        record_header->body_size_ = static_cast<uint32_t>(message.message_.size());
+
+        char* payload = data_ + offset + sizeof(RecordHeader);
+        for (const auto part : { std::string_view(message.topic_), std::string_view(message.partition_key_),
+            std::string_view(message.event_type_name_), message.message_.view() })
+        {
+            std::memcpy(payload, part.data(), part.size());
+            payload += part.size();
+        }
+        record_header->state_ = Live;
+
+        if (entries_.empty())
+        {
+            file_header->head_ = offset;
+            file_header->head_sequence_ = next_sequence_;
+        }
+        entries_.push_back(Entry{ next_sequence_, offset, false });
+        file_header->tail_ = offset + record_size;
+        return next_sequence_++;
+    }
+
+    void MessageSpool::release(uint64_t sequence)
+    {
+        std::unique_lock lock(mutex_);
+        if (entries_.empty() || sequence < entries_.front().sequence_ || sequence >= next_sequence_)
+        {
+            return;
+        }
+
+        auto& entry = entries_[static_cast<size_t>(sequence - entries_.front().sequence_)];
+        entry.is_released_ = true;
+        reinterpret_cast<RecordHeader*>(data_ + entry.offset_)->state_ = Released;
+        reclaimReleasedRecords();
+    }
+
+    std::vector<MessageSpool::Record> MessageSpool::read(uint64_t sequence, size_t max_count) const
+    {
+        std::vector<Record> records;
+        std::unique_lock lock(mutex_);
+        if (entries_.empty())
+        {
+            return records;
+        }
+
+        const uint64_t first_sequence = std::max(sequence, entries_.front().sequence_);
+        for (size_t index = static_cast<size_t>(first_sequence - entries_.front().sequence_);
+            index < entries_.size() && records.size() < max_count;
+            ++index)
+        {
+            if (!entries_[index].is_released_)
+            {
+                records.push_back(readRecord(entries_[index]));
+            }
+        }
+        return records;
+    }
+
+    uint64_t MessageSpool::firstSequence() const
+    {
+        std::unique_lock lock(mutex_);
+        return entries_.empty() ? next_sequence_ : entries_.front().sequence_;
+    }
+
+    uint64_t MessageSpool::endSequence() const
+    {
+        std::unique_lock lock(mutex_);
+        return next_sequence_;
+    }
+
+    MessageSpool::Statistics MessageSpool::statistics() const
+    {
+        std::unique_lock lock(mutex_);
+        const auto* file_header = reinterpret_cast<const FileHeader*>(data_);
+
+        Statistics statistics;
+        statistics.capacity_ = capacity_ - data_begin__;
+        statistics.records_ = entries_.size();
+        statistics.unreleased_records_ = static_cast<size_t>(
+            std::count_if(entries_.begin(), entries_.end(), [](const Entry& entry)
+        {
+            return !entry.is_released_;
+        }));
+        if (!entries_.empty())
+        {
+            statistics.used_bytes_ = file_header->tail_ > file_header->head_
+                ? file_header->tail_ - file_header->head_
+                : statistics.capacity_ - (file_header->head_ - file_header->tail_);
+        }
+        return statistics;
+    }
+
+    void MessageSpool::map(const std::string& path, size_t capacity)
+    {
+        bool is_new_file = false;
+#if defined(_WIN32)
+        file_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE)
+        {
+            throwSystemError("CreateFile of " + path);
+        }
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file_, &file_size))
+        {
+            unmap();
+            throwSystemError("GetFileSizeEx");
+        }
+        is_new_file = file_size.QuadPart == 0;
+        capacity_ = is_new_file ? capacity : static_cast<size_t>(file_size.QuadPart);
+        if (capacity_ < min_capacity__)
+        {
+            unmap();
+            throw std::runtime_error("MessageSpool error: " + path + " is not a spool file.");
+        }
+
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READWRITE,
+            static_cast<DWORD>(uint64_t(capacity_) >> 32), static_cast<DWORD>(capacity_), nullptr);
+        if (mapping_ == nullptr)
+        {
+            unmap();
+            throwSystemError("CreateFileMapping");
+        }
+        data_ = static_cast<char*>(MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, capacity_));
+        if (data_ == nullptr)
+        {
+            unmap();
+            throwSystemError("MapViewOfFile");
+        }
+#else
+        file_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (file_ < 0)
+        {
+            throwSystemError("open of " + path);
+        }
+
+        struct stat file_stat;
+        if (::fstat(file_, &file_stat) != 0)
+        {
+            unmap();
+            throwSystemError("fstat");
+        }
+        is_new_file = file_stat.st_size == 0;
+        capacity_ = is_new_file ? capacity : static_cast<size_t>(file_stat.st_size);
+        if (capacity_ < min_capacity__)
+        {
+            unmap();
+            throw std::runtime_error("MessageSpool error: " + path + " is not a spool file.");
+        }
+        if (is_new_file && ::ftruncate(file_, static_cast<off_t>(capacity_)) != 0)
+        {
+            unmap();
+            throwSystemError("ftruncate");
+        }
+
+        void* data = ::mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, file_, 0);
+        if (data == MAP_FAILED)
+        {
+            unmap();
+            throwSystemError("mmap");
+        }
+        data_ = static_cast<char*>(data);
+#endif
+
+        auto* file_header = reinterpret_cast<FileHeader*>(data_);
+        if (is_new_file)
+        {
+            std::memset(file_header, 0, sizeof(FileHeader));
+            file_header->magic_ = magic__;
+            file_header->version_ = version__;
+            file_header->capacity_ = capacity_;
+            file_header->head_ = data_begin__;
+            file_header->tail_ = data_begin__;
+        }
+        else if (file_header->magic_ != magic__ || file_header->version_ != version__
+            || file_header->capacity_ != capacity_)
+        {
+            unmap();
+            throw std::runtime_error("MessageSpool error: " + path + " is not a spool file.");
+        }
+    }
+
+    void MessageSpool::unmap()
+    {
+#if defined(_WIN32)
+        if (data_ != nullptr)
+        {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_ != nullptr)
+        {
+            CloseHandle(mapping_);
+        }
+        if (file_ != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file_);
+        }
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_ != nullptr)
+        {
+            ::munmap(data_, capacity_);
+        }
+        if (file_ >= 0)
+        {
+            ::close(file_);
+        }
+        file_ = -1;
+#endif
+        data_ = nullptr;
+    }
+
+    void MessageSpool::recover()
+    {
+        auto* file_header = reinterpret_cast<FileHeader*>(data_);
+        next_sequence_ = file_header->head_sequence_;
+
+        size_t offset = static_cast<size_t>(file_header->head_);
+        const size_t tail = static_cast<size_t>(file_header->tail_);
+        while (offset != tail)
+        {
+            if (offset + sizeof(RecordHeader) > capacity_
+                || reinterpret_cast<const RecordHeader*>(data_ + offset)->state_ == Wrap)
+            {
+                offset = data_begin__;
+                continue;
+            }
+
+            const auto* record_header = reinterpret_cast<const RecordHeader*>(data_ + offset);
+            const bool is_valid = (record_header->state_ == Live || record_header->state_ == Released)
+                && record_header->size_ >= sizeof(RecordHeader)
+                && offset + record_header->size_ <= capacity_
+                && record_header->sequence_ == next_sequence_;
+            if (!is_valid)
+            {
+                // A record interrupted while being written, the tail is set after the record is complete
+                STREAMER_LOG_ERROR("MessageSpool::recover invalid record at offset ", offset, ", spool truncated");
+                file_header->tail_ = offset;
+                break;
+            }
+
+            entries_.push_back(Entry{ next_sequence_, offset, record_header->state_ == Released });
+            ++next_sequence_;
+            offset += record_header->size_;
+        }
+
+        reclaimReleasedRecords();
+        STREAMER_LOG_INFO("MessageSpool recovered ", entries_.size(), " record(s)");
+    }
+
+    size_t MessageSpool::reserve(size_t record_size)
+    {
+        auto* file_header = reinterpret_cast<FileHeader*>(data_);
+        const size_t head = static_cast<size_t>(file_header->head_);
+        const size_t tail = static_cast<size_t>(file_header->tail_);
+
+        // The tail never reaches the head from behind, head == tail always means an empty spool
+        if (entries_.empty())
+        {
+            if (data_begin__ + record_size > capacity_)
+            {
+                throw std::runtime_error("MessageSpool error: Message larger than the spool.");
+            }
+            return data_begin__;
+        }
+        if (tail > head)
+        {
+            if (tail + record_size <= capacity_)
+            {
+                return tail;
+            }
+            if (data_begin__ + record_size < head)
+            {
+                if (tail + sizeof(RecordHeader) <= capacity_)
+                {
+                    reinterpret_cast<RecordHeader*>(data_ + tail)->state_ = Wrap;
+                }
+                return data_begin__;
+            }
+        }
+        else if (tail + record_size < head)
+        {
+            return tail;
+        }
+        throw std::runtime_error("MessageSpool error: Spool is full.");
+    }
+
+    void MessageSpool::reclaimReleasedRecords()
+    {
+        while (!entries_.empty() && entries_.front().is_released_)
+        {
+            entries_.pop_front();
+        }
+
+        auto* file_header = reinterpret_cast<FileHeader*>(data_);
+        if (entries_.empty())
+        {
+            file_header->head_sequence_ = next_sequence_;
+            file_header->head_ = data_begin__;
+            file_header->tail_ = data_begin__;
+        }
+        else
+        {
+            file_header->head_sequence_ = entries_.front().sequence_;
+            file_header->head_ = entries_.front().offset_;
+        }
+    }
+
+    MessageSpool::Record MessageSpool::readRecord(const Entry& entry) const
+    {
+        const auto* record_header = reinterpret_cast<const RecordHeader*>(data_ + entry.offset_);
+        const char* payload = data_ + entry.offset_ + sizeof(RecordHeader);
+
+        Record record{ entry.sequence_, OutgoingMessage() };
+        record.message_.topic_.assign(payload, record_header->topic_size_);
+        payload += record_header->topic_size_;
+        record.message_.partition_key_.assign(payload, record_header->partition_key_size_);
+        payload += record_header->partition_key_size_;
+        record.message_.event_type_name_.assign(payload, record_header->event_type_name_size_);
+        payload += record_header->event_type_name_size_;
+        // The body stays in the mapping, it can't be overwritten before the record is released
+        record.message_.message_ =
+            MessageBody(std::shared_ptr<const void>(), std::string_view(payload, record_header->body_size_));
+        return record;
+    }
+
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "OutgoingMessage.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace RabbitMqStreamingPlugin
+{
+    /*
+     * MessageSpool is an append-only log of the messages not confirmed yet, stored in a memory-mapped file used as a
+     * ring buffer. A message is appended before it is handed to a channel and released once the broker confirmed it,
+     * the space of the oldest released messages is reused by the next appends.
+     *
+     * The records and the head and tail offsets live in the mapping, so a spool reopened after a crash of the process
+     * recovers every message that was not released. Nothing is flushed to the disk explicitly, the records are only
+     * lost if the machine itself goes down before the system writes them back.
+     *
+     * The bodies of the records returned by read are views of the mapping, valid until the record is released.
+     */
+    class MessageSpool
+    {
+    public:
+        struct Record
+        {
+            uint64_t sequence_;
+            OutgoingMessage message_;
+        };
+
+        struct Statistics
+        {
+            size_t capacity_ = 0;
+            size_t used_bytes_ = 0;
+            size_t records_ = 0;
+            size_t unreleased_records_ = 0;
+        };
+
+        // Opens the spool file or creates it with the given capacity, the capacity of an existing file is kept
+        MessageSpool(const std::string& path, size_t capacity);
+        ~MessageSpool();
+
+        MessageSpool(const MessageSpool&) = delete;
+        MessageSpool& operator=(const MessageSpool&) = delete;
+
+        // Returns the sequence of the record, throws when the spool is full
+        uint64_t append(const OutgoingMessage& message);
+        void release(uint64_t sequence);
+
+        // The unreleased records from sequence on, in order, at most max_count of them
+        std::vector<Record> read(uint64_t sequence, size_t max_count) const;
+
+        // Sequence of the oldest unreleased record, endSequence when there is none
+        uint64_t firstSequence() const;
+        // Sequence of the next appended record
+        uint64_t endSequence() const;
+
+        Statistics statistics() const;
+
+    private:
+        struct Entry
+        {
+            uint64_t sequence_;
+            size_t offset_;
+            bool is_released_;
+        };
+
+        void map(const std::string& path, size_t capacity);
+        void unmap();
+        void recover();
+        // Offset where a record of that size can be written, the tail is wrapped when needed. Throws when full.
+        size_t reserve(size_t record_size);
+        void reclaimReleasedRecords();
+        Record readRecord(const Entry& entry) const;
+
+        char* data_;
+        size_t capacity_;
+#if defined(_WIN32)
+        void* file_;
+        void* mapping_;
+#else
+        int file_;
+#endif
+
+        mutable std::mutex mutex_;
+        // Every record between the head and the tail, released ones included until they reach the head
+        std::deque<Entry> entries_;
+        uint64_t next_sequence_;
+    };
+
+}  // namespace RabbitMqStreamingPlugin
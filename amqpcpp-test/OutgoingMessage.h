@@ -0,0 +1,33 @@
+#pragma once
+
+#include "MessageBody.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace RabbitMqStreamingPlugin
+{
+    struct OutgoingMessage
+    {
+        std::string topic_;
+        std::string partition_key_;
+        std::string event_type_name_;
+        MessageBody message_;
+        // The body is a MessageContainer of aggregated messages
+        bool is_container_ = false;
+    };
+
+    struct BatchPublishReport
+    {
+        size_t published_count_ = 0;
+        // Index in the published batch and error message of every message that was not confirmed
+        std::vector<std::pair<size_t, std::string>> failures_;
+
+        bool succeeded() const
+        {
+            return failures_.empty();
+        }
+    };
+
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,148 @@
+#include "OutputBufferPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace RabbitMqStreamingPlugin
+{
+    OutputBufferPool::OutputBufferPool(size_t chunk_size, size_t max_free_chunks)
+        : chunk_size_(std::max<size_t>(chunk_size, 1))
+        , max_free_chunks_(max_free_chunks)
+        , pending_bytes_(0)
+        , allocated_chunks_(0)
+        , free_chunk_count_(0)
+        , peak_allocated_chunks_(0)
+        , published_pending_bytes_(0)
+        , chunk_allocations_(0)
+    {
+    }
+
+    void OutputBufferPool::append(const char* data, size_t size)
+    {
+        while (size > 0)
+        {
+            if (pending_chunks_.empty() || pending_chunks_.back().end_ == chunk_size_)
+            {
+                pending_chunks_.push_back(acquireChunk());
+            }
+
+            auto& chunk = pending_chunks_.back();
+            const size_t length = std::min(size, chunk_size_ - chunk.end_);
+            std::memcpy(chunk.data_.get() + chunk.end_, data, length);
+            chunk.end_ += length;
+            data += length;
+            size -= length;
+            pending_bytes_ += length;
+        }
+        published_pending_bytes_.store(pending_bytes_, std::memory_order_relaxed);
+    }
+
+    bool OutputBufferPool::empty() const
+    {
+        return pending_bytes_ == 0;
+    }
+
+    size_t OutputBufferPool::pendingBytes() const
+    {
+        return pending_bytes_;
+    }
+
+    size_t OutputBufferPool::gather(
+        std::vector<boost::asio::const_buffer>& buffers, size_t max_bytes, size_t max_buffers) const
+    {
+        size_t gathered = 0;
+        for (const auto& chunk : pending_chunks_)
+        {
+            if (gathered >= max_bytes || buffers.size() >= max_buffers)
+            {
+                break;
+            }
+
+            const size_t length = std::min(chunk.end_ - chunk.begin_, max_bytes - gathered);
+            if (length > 0)
+            {
+                buffers.push_back(boost::asio::buffer(chunk.data_.get() + chunk.begin_, length));
+                gathered += length;
+            }
+        }
+        return gathered;
+    }
+
+    void OutputBufferPool::consume(size_t size)
+    {
+        assert(size <= pending_bytes_);
+
+        size_t written_chunks = 0;
+        for (auto& chunk : pending_chunks_)
+        {
+            const size_t length = std::min(size, chunk.end_ - chunk.begin_);
+            chunk.begin_ += length;
+            size -= length;
+            pending_bytes_ -= length;
+
+            // The last chunk is kept while it has room, new frames are still appended into it
+            if (chunk.begin_ == chunk.end_ && (chunk.end_ == chunk_size_ || pending_bytes_ == 0))
+            {
+                ++written_chunks;
+            }
+            if (size == 0)
+            {
+                break;
+            }
+        }
+
+        for (size_t index = 0; index < written_chunks; ++index)
+        {
+            releaseChunk(std::move(pending_chunks_[index]));
+        }
+        pending_chunks_.erase(pending_chunks_.begin(), pending_chunks_.begin() + written_chunks);
+        published_pending_bytes_.store(pending_bytes_, std::memory_order_relaxed);
+    }
+
+    OutputBufferPool::Statistics OutputBufferPool::statistics() const
+    {
+        Statistics statistics;
+        statistics.chunk_size_ = chunk_size_;
+        statistics.allocated_chunks_ = allocated_chunks_.load(std::memory_order_relaxed);
+        statistics.free_chunks_ = free_chunk_count_.load(std::memory_order_relaxed);
+        statistics.peak_allocated_chunks_ = peak_allocated_chunks_.load(std::memory_order_relaxed);
+        statistics.pending_bytes_ = published_pending_bytes_.load(std::memory_order_relaxed);
+        statistics.chunk_allocations_ = chunk_allocations_.load(std::memory_order_relaxed);
+        return statistics;
+    }
+
+    OutputBufferPool::Chunk OutputBufferPool::acquireChunk()
+    {
+        if (!free_chunks_.empty())
+        {
+            Chunk chunk = std::move(free_chunks_.back());
+            free_chunks_.pop_back();
+            free_chunk_count_.store(free_chunks_.size(), std::memory_order_relaxed);
+            return chunk;
+        }
+
+        const size_t allocated_chunks = allocated_chunks_.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (allocated_chunks > peak_allocated_chunks_.load(std::memory_order_relaxed))
+        {
+            peak_allocated_chunks_.store(allocated_chunks, std::memory_order_relaxed);
+        }
+        chunk_allocations_.fetch_add(1, std::memory_order_relaxed);
+        return Chunk{ std::make_unique<char[]>(chunk_size_), 0, 0 };
+    }
+
+    void OutputBufferPool::releaseChunk(Chunk chunk)
+    {
+        if (free_chunks_.size() >= max_free_chunks_)
+        {
+            allocated_chunks_.fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
+
+        chunk.begin_ = 0;
+        chunk.end_ = 0;
+        free_chunks_.push_back(std::move(chunk));
+        free_chunk_count_.store(free_chunks_.size(), std::memory_order_relaxed);
+    }
+
+}  // namespace RabbitMqStreamingPlugin
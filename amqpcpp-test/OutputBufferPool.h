@@ -0,0 +1,79 @@
+#pragma once
+
+#include <boost/asio/buffer.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace RabbitMqStreamingPlugin
+{
+    /*
+     * OutputBufferPool stores the frames waiting to be written on the socket in fixed size chunks.
+     * Frames are appended back to back, a frame larger than the free space of the last chunk continues in the next one.
+     * Chunks entirely written are recycled in a free list instead of being released, so once the pool has grown to the
+     * working set of the connection, appending and writing frames doesn't allocate anymore.
+     *
+     * The pool itself must only be used from the IO thread, statistics can be read from any thread.
+     */
+    class OutputBufferPool
+    {
+    public:
+        struct Statistics
+        {
+            size_t chunk_size_ = 0;
+            size_t allocated_chunks_ = 0;
+            size_t free_chunks_ = 0;
+            size_t peak_allocated_chunks_ = 0;
+            size_t pending_bytes_ = 0;
+            // Number of chunks allocated on the heap since the pool creation
+            uint64_t chunk_allocations_ = 0;
+        };
+
+        OutputBufferPool(size_t chunk_size, size_t max_free_chunks);
+
+        OutputBufferPool(const OutputBufferPool&) = delete;
+        OutputBufferPool& operator=(const OutputBufferPool&) = delete;
+
+        void append(const char* data, size_t size);
+
+        bool empty() const;
+        size_t pendingBytes() const;
+
+        // Appends to buffers the oldest pending bytes, up to max_bytes and max_buffers entries in buffers.
+        // Returns the number of bytes gathered, they stay pending until consume is called.
+        size_t gather(std::vector<boost::asio::const_buffer>& buffers, size_t max_bytes, size_t max_buffers) const;
+
+        // Releases the oldest size pending bytes once they have been written.
+        void consume(size_t size);
+
+        Statistics statistics() const;
+
+    private:
+        struct Chunk
+        {
+            std::unique_ptr<char[]> data_;
+            size_t begin_;
+            size_t end_;
+        };
+
+        Chunk acquireChunk();
+        void releaseChunk(Chunk chunk);
+
+        const size_t chunk_size_;
+        const size_t max_free_chunks_;
+
+        // Front is the oldest chunk, only the last one receives new data
+        std::vector<Chunk> pending_chunks_;
+        std::vector<Chunk> free_chunks_;
+        size_t pending_bytes_;
+
+        std::atomic<size_t> allocated_chunks_;
+        std::atomic<size_t> free_chunk_count_;
+        std::atomic<size_t> peak_allocated_chunks_;
+        std::atomic<size_t> published_pending_bytes_;
+        std::atomic<uint64_t> chunk_allocations_;
+    };
+
+}  // namespace RabbitMqStreamingPlugin
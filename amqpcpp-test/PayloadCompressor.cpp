@@ -0,0 +1,256 @@
+#include "PayloadCompressor.h"
+
+#if defined(AMQPCPP_STREAMER_WITH_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(AMQPCPP_STREAMER_WITH_ZSTD)
+#include <zstd.h>
+#endif
+
+#include <stdexcept>
+#include <utility>
+
+namespace RabbitMqStreamingPlugin
+{
+    namespace PayloadCompressorPrivate
+    {
+#if defined(AMQPCPP_STREAMER_WITH_ZLIB)
+        // Deflate stream reused by every compression of the thread, reset between messages
+        class ZlibContext
+        {
+        public:
+            ~ZlibContext()
+            {
+                if (is_initialized_)
+                {
+                    deflateEnd(&stream_);
+                }
+            }
+
+            z_stream& stream(int level)
+            {
+                if (is_initialized_ && level_ != level)
+                {
+                    deflateEnd(&stream_);
+                    is_initialized_ = false;
+                }
+                if (!is_initialized_)
+                {
+                    stream_ = z_stream();
+                    if (deflateInit(&stream_, level) != Z_OK)
+                    {
+                        throw std::runtime_error("PayloadCompressor error: deflateInit failed.");
+                    }
+                    is_initialized_ = true;
+                    level_ = level;
+                }
+                else
+                {
+                    deflateReset(&stream_);
+                }
+                return stream_;
+            }
+
+        private:
+            z_stream stream_ = z_stream();
+            bool is_initialized_ = false;
+            int level_ = 0;
+        };
+
+        thread_local ZlibContext zlib_context__;
+#endif
+
+#if defined(AMQPCPP_STREAMER_WITH_ZSTD)
+        class ZstdContext
+        {
+        public:
+            ~ZstdContext()
+            {
+                ZSTD_freeCCtx(context_);
+            }
+
+            ZSTD_CCtx* context()
+            {
+                if (context_ == nullptr)
+                {
+                    context_ = ZSTD_createCCtx();
+                    if (context_ == nullptr)
+                    {
+                        throw std::runtime_error("PayloadCompressor error: ZSTD_createCCtx failed.");
+                    }
+                }
+                return context_;
+            }
+
+        private:
+            ZSTD_CCtx* context_ = nullptr;
+        };
+
+        thread_local ZstdContext zstd_context__;
+#endif
+    }  // namespace PayloadCompressorPrivate
+
+    using namespace PayloadCompressorPrivate;
+
+    struct PayloadCompressor::Dictionary
+    {
+        std::string data_;
+#if defined(AMQPCPP_STREAMER_WITH_ZSTD)
+        // Digested once with the compression level
+        ZSTD_CDict* zstd_dictionary_ = nullptr;
+
+        ~Dictionary()
+        {
+            ZSTD_freeCDict(zstd_dictionary_);
+        }
+#endif
+    };
+
+    PayloadCompressor::PayloadCompressor(const CompressionOptions& options, StreamerMetrics& metrics)
+        : algorithm_(options.algorithm_)
+        , min_size_(options.min_size_)
+        , level_(options.level_)
+        , metrics_(metrics)
+    {
+#if !defined(AMQPCPP_STREAMER_WITH_ZLIB)
+        if (algorithm_ == CompressionAlgorithm::Zlib)
+        {
+            throw std::runtime_error("PayloadCompressor error: Built without zlib.");
+        }
+#endif
+#if !defined(AMQPCPP_STREAMER_WITH_ZSTD)
+        if (algorithm_ == CompressionAlgorithm::Zstd)
+        {
+            throw std::runtime_error("PayloadCompressor error: Built without zstd.");
+        }
+#endif
+
+        for (const auto& [event_type_name, data] : options.dictionaries_)
+        {
+            auto dictionary = std::make_unique<Dictionary>();
+            dictionary->data_ = data;
+#if defined(AMQPCPP_STREAMER_WITH_ZSTD)
+            if (algorithm_ == CompressionAlgorithm::Zstd)
+            {
+                dictionary->zstd_dictionary_ = ZSTD_createCDict(data.data(), data.size(), level_);
+                if (dictionary->zstd_dictionary_ == nullptr)
+                {
+                    throw std::runtime_error("PayloadCompressor error: Invalid dictionary for " + event_type_name + ".");
+                }
+            }
+#endif
+            dictionaries_.emplace(event_type_name, std::move(dictionary));
+        }
+    }
+
+    PayloadCompressor::~PayloadCompressor()
+    {
+    }
+
+    bool PayloadCompressor::isEnabled() const
+    {
+        return algorithm_ != CompressionAlgorithm::None;
+    }
+
+    MessageBody PayloadCompressor::compress(const std::string& event_type_name, MessageBody body) const
+    {
+        if (!isEnabled() || body.size() < min_size_ || body.contentEncoding() != nullptr)
+        {
+            return body;
+        }
+
+        const auto started_at = MetricsClock::now();
+
+        const auto dictionary = dictionaries_.find(event_type_name);
+        const Dictionary* const event_dictionary =
+            dictionary != dictionaries_.end() ? dictionary->second.get() : nullptr;
+
+        auto output = std::make_shared<std::string>();
+        const bool is_compressed = algorithm_ == CompressionAlgorithm::Zlib
+            ? compressZlib(event_dictionary, body, *output)
+            : compressZstd(event_dictionary, body, *output);
+
+        metrics_.compression_.recordSince(started_at);
+        metrics_.compression_input_bytes_.add(static_cast<int64_t>(body.size()));
+        if (!is_compressed || output->size() >= body.size())
+        {
+            metrics_.compression_output_bytes_.add(static_cast<int64_t>(body.size()));
+            return body;
+        }
+
+        metrics_.compressed_messages_.add(1);
+        metrics_.compression_output_bytes_.add(static_cast<int64_t>(output->size()));
+        const std::string_view view(*output);
+        return MessageBody(std::move(output), view, contentEncoding(algorithm_));
+    }
+
+    const char* PayloadCompressor::contentEncoding(CompressionAlgorithm algorithm)
+    {
+        switch (algorithm)
+        {
+        case CompressionAlgorithm::Zlib:
+            return "deflate";
+        case CompressionAlgorithm::Zstd:
+            return "zstd";
+        default:
+            return nullptr;
+        }
+    }
+
+    bool PayloadCompressor::compressZlib(
+        [[maybe_unused]] const Dictionary* dictionary,
+        [[maybe_unused]] const MessageBody& body,
+        [[maybe_unused]] std::string& output) const
+    {
+#if defined(AMQPCPP_STREAMER_WITH_ZLIB)
+        z_stream& stream = zlib_context__.stream(level_ == 0 ? Z_DEFAULT_COMPRESSION : level_);
+        if (dictionary != nullptr)
+        {
+            if (deflateSetDictionary(&stream,
+                    reinterpret_cast<const Bytef*>(dictionary->data_.data()),
+                    static_cast<uInt>(dictionary->data_.size())) != Z_OK)
+            {
+                throw std::runtime_error("PayloadCompressor error: deflateSetDictionary failed.");
+            }
+        }
+
+        output.resize(deflateBound(&stream, static_cast<uLong>(body.size())));
+        stream.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(body.data()));
+        stream.avail_in = static_cast<uInt>(body.size());
+        stream.next_out = reinterpret_cast<Bytef*>(output.data());
+        stream.avail_out = static_cast<uInt>(output.size());
+        if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+        {
+            return false;
+        }
+        output.resize(stream.total_out);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool PayloadCompressor::compressZstd(
+        [[maybe_unused]] const Dictionary* dictionary,
+        [[maybe_unused]] const MessageBody& body,
+        [[maybe_unused]] std::string& output) const
+    {
+#if defined(AMQPCPP_STREAMER_WITH_ZSTD)
+        ZSTD_CCtx* context = zstd_context__.context();
+        output.resize(ZSTD_compressBound(body.size()));
+        const size_t result = dictionary != nullptr
+            ? ZSTD_compress_usingCDict(
+                context, output.data(), output.size(), body.data(), body.size(), dictionary->zstd_dictionary_)
+            : ZSTD_compressCCtx(context, output.data(), output.size(), body.data(), body.size(), level_);
+        if (ZSTD_isError(result))
+        {
+            return false;
+        }
+        output.resize(result);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "MessageBody.h"
+#include "StreamerMetrics.h"
+#include "StreamerOptions.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace RabbitMqStreamingPlugin
+{
+    /*
+     * PayloadCompressor compresses the message bodies on the publishing side, before they are handed to a channel,
+     * so the IO threads only see the compressed bytes. A compressed body is tagged with its content encoding, which
+     * the channel sets in the envelope next to the application/protobuf content type.
+     *
+     * The compression contexts are kept per thread and reused, the dictionaries per event type are prepared once.
+     * zlib and zstd are optional dependencies, an algorithm the streamer was built without is rejected when the
+     * compressor is created.
+     */
+    class PayloadCompressor
+    {
+    public:
+        PayloadCompressor(const CompressionOptions& options, StreamerMetrics& metrics);
+        ~PayloadCompressor();
+
+        PayloadCompressor(const PayloadCompressor&) = delete;
+        PayloadCompressor& operator=(const PayloadCompressor&) = delete;
+
+        bool isEnabled() const;
+
+        // Returns the compressed body, or the body itself when it is too small or doesn't shrink.
+        // Can be called from any thread.
+        MessageBody compress(const std::string& event_type_name, MessageBody body) const;
+
+        // Content encoding set on the messages compressed with that algorithm, nullptr for None
+        static const char* contentEncoding(CompressionAlgorithm algorithm);
+
+    private:
+        struct Dictionary;
+
+        bool compressZlib(const Dictionary* dictionary, const MessageBody& body, std::string& output) const;
+        bool compressZstd(const Dictionary* dictionary, const MessageBody& body, std::string& output) const;
+
+        const CompressionAlgorithm algorithm_;
+        const size_t min_size_;
+        const int level_;
+        StreamerMetrics& metrics_;
+
+        std::unordered_map<std::string, std::unique_ptr<Dictionary>> dictionaries_;
+    };
+
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/system_executor.hpp>
+
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <variant>
+
+namespace RabbitMqStreamingPlugin
+{
+    // Completion signature of the asynchronous publishes, the exception is null once the broker confirmed the message
+    using PublishSignature = void(std::exception_ptr exception);
+
+    /*
+     * PublishWaiter is the completion of a blocking publish: the publishing thread waits on it, on its own stack,
+     * instead of allocating the shared state of a promise for every message.
+     */
+    class PublishWaiter
+    {
+    public:
+        // Returns the exception the publish completed with, null once the broker confirmed it
+        std::exception_ptr wait()
+        {
+            std::unique_lock lock(mutex_);
+            completed_cv_.wait(lock, [this]()
+            {
+                return is_completed_;
+            });
+            return exception_;
+        }
+
+        void complete(std::exception_ptr exception)
+        {
+            // Notified under the lock, the waiter may destroy this as soon as it is released
+            std::unique_lock lock(mutex_);
+            exception_ = exception;
+            is_completed_ = true;
+            completed_cv_.notify_all();
+        }
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable completed_cv_;
+        bool is_completed_ = false;
+        std::exception_ptr exception_;
+    };
+
+    /*
+     * PublishCompletion settles one published message, either through the std::promise of the future based publishes,
+     * a PublishWaiter, or through the completion handler of an asio initiating function (plain callback, use_future,
+     * use_awaitable...).
+     *
+     * A handler is invoked as if by post on its associated executor, or on the IO thread of the channel when it has
+     * none, and keeps its executor from running out of work until then. The handler is stored, then posted, with its
+     * associated allocator: a handler bound to a HandlerMemory completes without allocating.
+     */
+    class PublishCompletion
+    {
+    public:
+        // Completes nothing
+        PublishCompletion() = default;
+
+        explicit PublishCompletion(std::promise<void> promise)
+            : completion_(std::move(promise))
+        {
+        }
+
+        // The waiter must outlive the completion
+        explicit PublishCompletion(PublishWaiter& waiter)
+            : completion_(&waiter)
+        {
+        }
+
+        template <typename Handler>
+        explicit PublishCompletion(Handler handler)
+            : completion_(CompletionPointer(HandlerCompletion<Handler>::create(std::move(handler))))
+        {
+        }
+
+        // io_executor runs the handlers without associated executor, can be called once
+        void complete(std::exception_ptr exception, const boost::asio::any_io_executor& io_executor)
+        {
+            if (auto* promise = std::get_if<std::promise<void>>(&completion_))
+            {
+                if (exception != nullptr)
+                {
+                    promise->set_exception(exception);
+                }
+                else
+                {
+                    promise->set_value();
+                }
+            }
+            else if (auto* waiter = std::get_if<PublishWaiter*>(&completion_))
+            {
+                (*waiter)->complete(exception);
+            }
+            else if (auto* completion = std::get_if<CompletionPointer>(&completion_))
+            {
+                // The handler completion destroys itself
+                completion->release()->complete(exception, io_executor);
+            }
+        }
+
+    private:
+        class Completion
+        {
+        public:
+            // Posts the handler and destroys the completion
+            virtual void complete(std::exception_ptr exception, const boost::asio::any_io_executor& io_executor) = 0;
+            // Destroys the completion without calling the handler
+            virtual void destroy() = 0;
+
+        protected:
+            ~Completion() = default;
+        };
+
+        struct DestroyCompletion
+        {
+            void operator()(Completion* completion) const
+            {
+                completion->destroy();
+            }
+        };
+        using CompletionPointer = std::unique_ptr<Completion, DestroyCompletion>;
+
+        template <typename Handler>
+        class HandlerCompletion : public Completion
+        {
+        public:
+            // system_executor is what handlers without executor of their own are associated with
+            using Executor = boost::asio::associated_executor_t<Handler>;
+            using Allocator = typename std::allocator_traits<
+                boost::asio::associated_allocator_t<Handler>>::template rebind_alloc<HandlerCompletion>;
+
+            static HandlerCompletion* create(Handler handler)
+            {
+                Allocator allocator(boost::asio::get_associated_allocator(handler));
+                HandlerCompletion* completion = std::allocator_traits<Allocator>::allocate(allocator, 1);
+                try
+                {
+                    return new (completion) HandlerCompletion(std::move(handler));
+                }
+                catch (...)
+                {
+                    std::allocator_traits<Allocator>::deallocate(allocator, completion, 1);
+                    throw;
+                }
+            }
+
+            void complete(std::exception_ptr exception, const boost::asio::any_io_executor& io_executor) override
+            {
+                // Like an asio operation, the memory is given back before the handler is posted, so the post can
+                // reuse it
+                auto work = std::move(work_);
+                PostedHandler posted_handler{ std::move(handler_), exception };
+                destroy();
+
+                if constexpr (std::is_same_v<Executor, boost::asio::system_executor>)
+                {
+                    // The type erased executor would allocate the operation with the default allocator. target()
+                    // doesn't check the type of the executor with every Boost version, target_type() does.
+                    if (io_executor.target_type() == typeid(boost::asio::io_context::executor_type))
+                    {
+                        boost::asio::post(
+                            *io_executor.target<boost::asio::io_context::executor_type>(), std::move(posted_handler));
+                    }
+                    else
+                    {
+                        boost::asio::post(io_executor, std::move(posted_handler));
+                    }
+                }
+                else
+                {
+                    boost::asio::post(work.get_executor(), std::move(posted_handler));
+                }
+                work.reset();
+            }
+
+            void destroy() override
+            {
+                Allocator allocator(allocator_);
+                this->~HandlerCompletion();
+                std::allocator_traits<Allocator>::deallocate(allocator, this, 1);
+            }
+
+        private:
+            // The handler bound to its exception, with the allocator of the handler
+            struct PostedHandler
+            {
+                using allocator_type = boost::asio::associated_allocator_t<Handler>;
+
+                allocator_type get_allocator() const noexcept
+                {
+                    return boost::asio::get_associated_allocator(handler_);
+                }
+
+                void operator()()
+                {
+                    handler_(exception_);
+                }
+
+                Handler handler_;
+                std::exception_ptr exception_;
+            };
+
+            explicit HandlerCompletion(Handler handler)
+                : allocator_(boost::asio::get_associated_allocator(handler))
+                , work_(boost::asio::get_associated_executor(handler))
+                , handler_(std::move(handler))
+            {
+            }
+
+            ~HandlerCompletion() = default;
+
+            const Allocator allocator_;
+            boost::asio::executor_work_guard<Executor> work_;
+            Handler handler_;
+        };
+
+        std::variant<std::monostate, std::promise<void>, PublishWaiter*, CompletionPointer> completion_;
+    };
+
+}  // namespace RabbitMqStreamingPlugin
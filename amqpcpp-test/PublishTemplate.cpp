@@ -0,0 +1,83 @@
+#include "PublishTemplate.h"
+
+#include "MessageContainer.h"
+
+#include <functional>
+#include <utility>
+
+namespace RabbitMqStreamingPlugin
+{
+    PublishTemplate::TemplateEnvelope::TemplateEnvelope()
+        : AMQP::Envelope(nullptr, 0)
+    {
+    }
+
+    void PublishTemplate::TemplateEnvelope::setBody(const char* body, uint64_t body_size)
+    {
+        _body = body;
+        _bodySize = body_size;
+    }
+
+    PublishTemplate::PublishTemplate(std::string topic, std::string partition_key, std::string event_type_name)
+        : topic_(std::move(topic))
+        , partition_key_(std::move(partition_key))
+        , event_type_name_(std::move(event_type_name))
+        , partition_key_hash_(std::hash<std::string>()(partition_key_))
+    {
+        setProtobufMetaData(event_type_name_, envelope_);
+        setProtobufMetaData(event_type_name_, encoded_envelope_);
+    }
+
+    const std::string& PublishTemplate::topic() const
+    {
+        return topic_;
+    }
+
+    const std::string& PublishTemplate::partitionKey() const
+    {
+        return partition_key_;
+    }
+
+    const std::string& PublishTemplate::eventTypeName() const
+    {
+        return event_type_name_;
+    }
+
+    size_t PublishTemplate::partitionKeyHash() const
+    {
+        return partition_key_hash_;
+    }
+
+    bool PublishTemplate::publish(
+        AMQP::Channel& channel, const char* body, uint64_t body_size, const char* content_encoding) const
+    {
+        std::unique_lock lock(envelope_mutex_);
+        TemplateEnvelope& envelope = content_encoding != nullptr ? encoded_envelope_ : envelope_;
+        if (content_encoding != nullptr && envelope.contentEncoding() != content_encoding)
+        {
+            envelope.setContentEncoding(content_encoding);
+        }
+
+        envelope.setBody(body, body_size);
+        const bool is_published = channel.publish(topic_, partition_key_, envelope);
+        // The body belongs to the caller, don't keep pointing at it
+        envelope.setBody(nullptr, 0);
+        return is_published;
+    }
+
+    void PublishTemplate::setProtobufMetaData(
+        const std::string& event_type_name, AMQP::MetaData& meta_data, bool is_container)
+    {
+        meta_data.setContentType("application/protobuf");
+        meta_data.setPersistent(true);
+
+        AMQP::Table header_table;
+        header_table.set("proto", event_type_name.c_str());
+        if (is_container)
+        {
+            MessageContainer::setMetaData(header_table);
+        }
+        meta_data.setHeaders(header_table);
+    }
+
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,76 @@
+#pragma once
+
+#define NOMINMAX
+#include <amqpcpp.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace RabbitMqStreamingPlugin
+{
+    /*
+     * PublishTemplate holds what every message published with the same topic, partition key and event type has in
+     * common: the exchange and routing key, the hash routing the key to a channel, and the envelope metadata
+     * (content type, persistence and the "proto" header table). They are built once when the template is created,
+     * publishing with it only points the cached envelope at the message body.
+     *
+     * AMQP-CPP doesn't accept pre-encoded frames, it still serializes the basic.publish method and the content
+     * header when the channel publishes. The template removes the per-message header table, metadata strings and
+     * routing hash.
+     *
+     * A template is immutable once created and can be shared by every thread and every channel.
+     */
+    class PublishTemplate
+    {
+    public:
+        PublishTemplate(std::string topic, std::string partition_key, std::string event_type_name);
+
+        PublishTemplate(const PublishTemplate&) = delete;
+        PublishTemplate& operator=(const PublishTemplate&) = delete;
+
+        const std::string& topic() const;
+        const std::string& partitionKey() const;
+        const std::string& eventTypeName() const;
+        size_t partitionKeyHash() const;
+
+        // Publishes the body with the template metadata on the channel, can be called from several IO threads.
+        // The content encoding is nullptr for a body that isn't encoded. Returns false when the channel refused it.
+        bool publish(
+            AMQP::Channel& channel,
+            const char* body,
+            uint64_t body_size,
+            const char* content_encoding = nullptr) const;
+
+        // Metadata of the messages published by the streamer, also used for the messages published without template
+        static void setProtobufMetaData(
+            const std::string& event_type_name, AMQP::MetaData& meta_data, bool is_container = false);
+
+    private:
+        // Envelope whose body is replaced for every publish, the metadata stays untouched
+        class TemplateEnvelope : public AMQP::Envelope
+        {
+        public:
+            TemplateEnvelope();
+
+            void setBody(const char* body, uint64_t body_size);
+        };
+
+        const std::string topic_;
+        const std::string partition_key_;
+        const std::string event_type_name_;
+        const size_t partition_key_hash_;
+
+        // Only held while the envelope is serialized, contended only when the template is published on several
+        // connections at once
+        mutable std::mutex envelope_mutex_;
+        mutable TemplateEnvelope envelope_;
+        // Same metadata with the content encoding of the last compressed body, the same for every compressed body of
+        // a streamer
+        mutable TemplateEnvelope encoded_envelope_;
+    };
+
+    using PublishTemplateHandle = std::shared_ptr<const PublishTemplate>;
+
+}  // namespace RabbitMqStreamingPlugin
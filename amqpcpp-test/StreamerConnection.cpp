@@ -0,0 +1,394 @@
+#include "StreamerConnection.h"
+
+#include "AsioHandler.h"
+#include "Logging.h"
+#include "SynchronousChannel.h"
+
+#define NOMINMAX
+
+#include <amqpcpp.h>
+#include <boost/asio/io_service.hpp>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+
+namespace RabbitMqStreamingPlugin
+{
+    namespace StreamerConnectionPrivate
+    {
+        void pinCurrentThreadToCpu(int cpu)
+        {
+#if defined(_WIN32)
+            if (SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) == 0)
+            {
+                STREAMER_LOG_WARNING("StreamerConnection failed to pin the IO thread to CPU ", cpu);
+            }
+#elif defined(__linux__)
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(cpu, &cpu_set);
+            if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0)
+            {
+                STREAMER_LOG_WARNING("StreamerConnection failed to pin the IO thread to CPU ", cpu);
+            }
+#else
+            STREAMER_LOG_WARNING("StreamerConnection can't pin the IO thread on this platform");
+#endif
+        }
+    }  // namespace StreamerConnectionPrivate
+
+    StreamerConnection::StreamerConnection(
+        const RabbitMqServerConfig& server_config,
+        const StreamerOptions& options,
+        const OnErrorCallback error_callback,
+        StreamerMetrics& metrics,
+        FlowController& flow_controller,
+        TlsContext* tls_context,
+        int io_thread_cpu)
+        : server_config_(server_config)
+        , options_(options)
+        , error_callback_(error_callback)
+        , metrics_(metrics)
+        , flow_controller_(flow_controller)
+        , tls_context_(tls_context)
+        , io_thread_cpu_(io_thread_cpu)
+        , is_io_service_running_(false)
+    {
+    }
+
+    StreamerConnection::~StreamerConnection()
+    {
+        stop();
+    }
+
+    void StreamerConnection::start()
+    {
+        stop();
+
+        io_service_ = std::make_unique<boost::asio::io_service>();
+
+        connection_handler_ = std::make_unique<AsioHandler>(
+            *io_service_,
+            server_config_.ip_address_,
+            server_config_.port_,
+            metrics_,
+            flow_controller_,
+            tls_context_,
+            options_.handler_);
+
+        connection_ = std::make_unique<AMQP::Connection>(
+            connection_handler_.get(),
+            AMQP::Login(server_config_.username_, server_config_.password_),
+            server_config_.vhost_);
+
+        const size_t channel_count = std::max<size_t>(options_.channel_count_, 1);
+        for (size_t index = 0; index < channel_count; ++index)
+        {
+            channels_.push_back(makeChannel());
+        }
+
+        is_io_service_running_ = true;
+        io_service_thread_ = std::thread([this]()
+        {
+            if (io_thread_cpu_ >= 0)
+            {
+                StreamerConnectionPrivate::pinCurrentThreadToCpu(io_thread_cpu_);
+            }
+            runConnectionService();
+        });
+    }
+
+    size_t StreamerConnection::channelCount() const
+    {
+        return channels_.size();
+    }
+
+    void StreamerConnection::waitUntilChannelReady(size_t index, MetricsClock::time_point deadline)
+    {
+        std::atomic_load(&channels_[index])->waitUntilReady(deadline);
+    }
+
+    std::shared_ptr<SynchronousChannel> StreamerConnection::channel(size_t index)
+    {
+        auto channel = std::atomic_load(&channels_[index]);
+        if (channel->isInErrorState())
+        {
+            channel = recreateChannel(index, channel);
+        }
+        return channel;
+    }
+
+    void StreamerConnection::flush()
+    {
+        for (const auto& channel : channels_)
+        {
+            std::atomic_load(&channel)->flush();
+        }
+    }
+
+    void StreamerConnection::consume(
+        const std::string& queue, DeliveryCallback callback, boost::asio::thread_pool* worker_pool)
+    {
+        STREAMER_LOG_INFO("StreamerConnection::consume ", queue);
+
+        auto consumer = std::make_shared<ConsumerChannel>(
+            *io_service_, queue, std::move(callback), metrics_, options_.consumer_, worker_pool);
+
+        // AMQP-CPP objects are only used from the IO thread once it is running
+        auto promise = std::make_shared<std::promise<std::future<void>>>();
+        auto started = promise->get_future();
+        io_service_->post([this, consumer, promise]()
+        {
+            try
+            {
+                if (!connection_->usable())
+                {
+                    throw std::runtime_error("Connection is not usable.");
+                }
+                // The acks and the basic.qos of the consumer aren't queued behind the bulk publishes
+                connection_handler_->setOpeningChannelPriority(FramePriority::High);
+                auto consuming = consumer->start(*connection_);
+                connection_handler_->setOpeningChannelPriority(FramePriority::Normal);
+                promise->set_value(std::move(consuming));
+            }
+            catch (const std::exception&)
+            {
+                connection_handler_->setOpeningChannelPriority(FramePriority::Normal);
+                promise->set_exception(std::current_exception());
+            }
+        });
+
+        {
+            std::unique_lock lock(consumers_mutex_);
+            consumers_.push_back(consumer);
+        }
+
+        const auto waitForIoThread = [this](auto& future)
+        {
+            while (future.wait_for(std::chrono::milliseconds(10)) == std::future_status::timeout)
+            {
+                if (!is_io_service_running_)
+                {
+                    throw std::runtime_error("StreamerConnection error: Connection service is not running.");
+                }
+            }
+        };
+        // A consumer that failed to start is destroyed by stop, along with the other consumers
+        waitForIoThread(started);
+        auto consuming = started.get();
+        waitForIoThread(consuming);
+        consuming.get();
+    }
+
+    OutputBufferPool::Statistics StreamerConnection::outputBufferStatistics() const
+    {
+        if (connection_handler_ == nullptr)
+        {
+            return OutputBufferPool::Statistics();
+        }
+        return connection_handler_->outputBufferStatistics();
+    }
+
+    void StreamerConnection::runConnectionService()
+    {
+        try
+        {
+            STREAMER_LOG_INFO("StreamerConnection::runConnectionService begin");
+            if (options_.io_spin_budget_.count() > 0)
+            {
+                runSpinning();
+            }
+            else
+            {
+                io_service_->run();
+            }
+            STREAMER_LOG_INFO("StreamerConnection::runConnectionService success");
+        }
+        catch (const std::exception& e)
+        {
+            STREAMER_LOG_ERROR("StreamerConnection::runConnectionService error: ", e.what());
+            error_callback_(std::current_exception());
+        }
+        is_io_service_running_ = false;
+        for (const auto& channel : channels_)
+        {
+            std::atomic_load(&channel)->stop();
+        }
+    }
+
+    void StreamerConnection::runSpinning()
+    {
+        // poll runs the ready handlers without blocking, the io_service is stopped once it runs out of work as with
+        // run
+        auto last_completion = MetricsClock::now();
+        while (!io_service_->stopped())
+        {
+            if (io_service_->poll() > 0)
+            {
+                last_completion = MetricsClock::now();
+            }
+            else if (MetricsClock::now() - last_completion >= options_.io_spin_budget_)
+            {
+                metrics_.io_thread_waits_.add(1);
+                io_service_->run_one();
+                last_completion = MetricsClock::now();
+            }
+        }
+    }
+
+    std::shared_ptr<SynchronousChannel> StreamerConnection::recreateChannel(
+        size_t index, const std::shared_ptr<SynchronousChannel>& failed_channel)
+    {
+        std::unique_lock lock(recreate_channel_mutex_);
+
+        // Another publisher may already have replaced the failed channel
+        auto channel = std::atomic_load(&channels_[index]);
+        if (channel != failed_channel)
+        {
+            return channel;
+        }
+
+        STREAMER_LOG_INFO("StreamerConnection::recreateChannel ", index);
+
+        // AMQP-CPP objects are only used from the IO thread once it is running
+        auto promise = std::make_shared<std::promise<std::shared_ptr<SynchronousChannel>>>();
+        auto future = promise->get_future();
+        io_service_->post([this, promise]()
+        {
+            try
+            {
+                if (!connection_->usable())
+                {
+                    throw std::runtime_error("Connection is not usable.");
+                }
+                promise->set_value(makeChannel());
+            }
+            catch (const std::exception&)
+            {
+                promise->set_exception(std::current_exception());
+            }
+        });
+
+        while (future.wait_for(std::chrono::milliseconds(10)) == std::future_status::timeout)
+        {
+            if (!is_io_service_running_)
+            {
+                throw std::runtime_error("StreamerConnection error: Connection service is not running.");
+            }
+        }
+
+        channel = future.get();
+        metrics_.channel_recreations_.add(1);
+        // The failed channel is destroyed on the IO thread once the publishers still using it let it go
+        std::atomic_store(&channels_[index], channel);
+        return channel;
+    }
+
+    void StreamerConnection::pollStoppedService()
+    {
+        // Called from the destructor, a handler throwing is reported like a failure of the IO thread and the
+        // remaining ones still run
+        for (;;)
+        {
+            try
+            {
+                io_service_->poll();
+                return;
+            }
+            catch (const std::exception& e)
+            {
+                STREAMER_LOG_ERROR("StreamerConnection::pollStoppedService error: ", e.what());
+                error_callback_(std::current_exception());
+            }
+        }
+    }
+
+    std::shared_ptr<SynchronousChannel> StreamerConnection::makeChannel()
+    {
+        // Whoever releases the channel last, a publisher or stop, the channel unregisters from the AMQP::Connection
+        // on the IO thread. stop polls the io_service once the IO thread is joined, before it is destroyed.
+        return std::shared_ptr<SynchronousChannel>(
+            new SynchronousChannel(*io_service_, *connection_, connection_handler_->writeTimeline(), metrics_,
+                flow_controller_, options_.channel_),
+            [io_service = io_service_.get()](SynchronousChannel* channel)
+        {
+            io_service->post([channel]()
+            {
+                delete channel;
+            });
+        });
+    }
+
+    void StreamerConnection::close()
+    {
+        if (!is_io_service_running_)
+        {
+            return;
+        }
+
+        // AMQP-CPP objects are only used from the IO thread once it is running
+        io_service_->post([this]()
+        {
+            connection_->close();
+        });
+
+        const auto deadline = MetricsClock::now() + options_.handler_.close_timeout_;
+        while (is_io_service_running_ && !connection_handler_->isClosed() && MetricsClock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    void StreamerConnection::stop()
+    {
+        STREAMER_LOG_INFO("StreamerConnection::stop begin");
+        if (io_service_thread_.joinable())
+        {
+            close();
+            io_service_->stop();
+            io_service_thread_.join();
+        }
+        STREAMER_LOG_INFO("StreamerConnection::stop joined");
+
+        // Handlers left in the stopped io_service would be destroyed without running, among them the completions of
+        // the messages aborted when the IO thread stopped. They run here, before the channels they may refer to are
+        // destroyed, then once more for the messages those channels abort. The socket operations and timers are
+        // aborted first, so their handlers don't fail the connection again.
+        if (connection_handler_)
+        {
+            connection_handler_->abort();
+        }
+        if (io_service_)
+        {
+            io_service_->restart();
+            pollStoppedService();
+        }
+        channels_.clear();
+        {
+            std::unique_lock lock(consumers_mutex_);
+            for (const auto& consumer : consumers_)
+            {
+                consumer->stop();
+            }
+            consumers_.clear();
+        }
+        if (io_service_)
+        {
+            pollStoppedService();
+        }
+        connection_.reset();
+        // destruction order is important between the handler and the service
+        // because some handler's internal objects depends on the service being in a valid state during destruction
+        connection_handler_.reset();
+        io_service_.reset();
+        STREAMER_LOG_INFO("StreamerConnection::stop reset");
+    }
+
+}  // namespace RabbitMqStreamingPlugin
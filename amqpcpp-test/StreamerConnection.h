@@ -0,0 +1,114 @@
+#pragma once
+
+#include "AmqpCppStreamer.h"
+#include "ConsumerChannel.h"
+#include "FlowController.h"
+#include "OutputBufferPool.h"
+#include "StreamerMetrics.h"
+#include "StreamerOptions.h"
+
+#include <boost/asio/io_service.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace AMQP
+{
+    class Connection;
+}  // namespace AMQP
+
+namespace RabbitMqStreamingPlugin
+{
+    class AsioHandler;
+    class SynchronousChannel;
+    class TlsContext;
+
+    /*
+     * StreamerConnection owns one AMQP::Connection with its AsioHandler, the io_service thread running it and the
+     * pool of SynchronousChannel opened on it. AmqpCppStreamer spreads its publishes over one or several of them.
+     * The ConsumerChannel opened by AmqpCppStreamer::consume share the same connection and IO thread.
+     *
+     * Once started, the AMQP-CPP objects are only used from the IO thread, failed channels are recreated and
+     * destroyed there.
+     */
+    class StreamerConnection
+    {
+    public:
+        // tls_context is null for plain TCP connections.
+        // io_thread_cpu is the CPU the IO thread is pinned to, a negative value leaves the thread unpinned
+        StreamerConnection(
+            const RabbitMqServerConfig& server_config,
+            const StreamerOptions& options,
+            const OnErrorCallback error_callback,
+            StreamerMetrics& metrics,
+            FlowController& flow_controller,
+            TlsContext* tls_context,
+            int io_thread_cpu);
+        ~StreamerConnection();
+
+        StreamerConnection(const StreamerConnection&) = delete;
+        StreamerConnection& operator=(const StreamerConnection&) = delete;
+
+        // Opens the connection and its channels and starts the IO thread, throws on failure
+        void start();
+        // Every publish is settled on return, the completion handlers without executor of their own have run on the
+        // calling thread if the IO thread couldn't run them
+        void stop();
+
+        size_t channelCount() const;
+
+        // Blocks until the channel is open and in confirm mode, throws when it fails or on the deadline
+        void waitUntilChannelReady(size_t index, MetricsClock::time_point deadline);
+
+        // Returns the channel in the given slot, the channel is recreated first if it failed
+        std::shared_ptr<SynchronousChannel> channel(size_t index);
+
+        void flush();
+
+        // Opens a consumer of the queue on this connection and waits until the broker accepted it, throws on failure.
+        // The callbacks run on the worker pool when there is one, on the IO thread otherwise.
+        void consume(const std::string& queue, DeliveryCallback callback, boost::asio::thread_pool* worker_pool);
+
+        OutputBufferPool::Statistics outputBufferStatistics() const;
+
+    private:
+        void runConnectionService();
+        // Runs the io_service, polling it for StreamerOptions::io_spin_budget_ before each blocking wait
+        void runSpinning();
+        // Closes the connection with the broker while the IO thread still runs, within the close timeout
+        void close();
+        // Runs the handlers left in the io_service once the IO thread is joined, reporting their failures
+        void pollStoppedService();
+
+        std::shared_ptr<SynchronousChannel> recreateChannel(
+            size_t index, const std::shared_ptr<SynchronousChannel>& failed_channel);
+        // The channel is deleted on the IO thread when its last owner releases it
+        std::shared_ptr<SynchronousChannel> makeChannel();
+
+        const RabbitMqServerConfig server_config_;
+        const StreamerOptions options_;
+        const OnErrorCallback error_callback_;
+        StreamerMetrics& metrics_;
+        FlowController& flow_controller_;
+        TlsContext* tls_context_;
+        const int io_thread_cpu_;
+
+        std::unique_ptr<AsioHandler> connection_handler_;
+        std::unique_ptr<AMQP::Connection> connection_;
+        // The slots are only resized by start and stop, the channels in them are replaced with std::atomic_store
+        // when they fail, so they must be read with std::atomic_load
+        std::vector<std::shared_ptr<SynchronousChannel>> channels_;
+        std::mutex recreate_channel_mutex_;
+        std::atomic<bool> is_io_service_running_;
+
+        std::mutex consumers_mutex_;
+        std::vector<std::shared_ptr<ConsumerChannel>> consumers_;
+
+        std::thread io_service_thread_;
+        std::unique_ptr<boost::asio::io_service> io_service_;
+    };
+
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,191 @@
+#include "StreamerMetrics.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include <algorithm>
+
+namespace RabbitMqStreamingPlugin
+{
+    namespace StreamerMetricsPrivate
+    {
+        size_t currentThreadShard()
+        {
+            static std::atomic<size_t> next_shard(0);
+            thread_local const size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % shard_count__;
+            return shard;
+        }
+
+        // Index of the most significant bit set, value must not be 0
+        size_t mostSignificantBit(uint64_t value)
+        {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanReverse64(&index, value);
+            return index;
+#else
+            return 63 - __builtin_clzll(value);
+#endif
+        }
+    }  // namespace StreamerMetricsPrivate
+
+    ShardedCounter::ShardedCounter()
+    {
+        for (auto& shard : shards_)
+        {
+            shard.value_.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    int64_t ShardedCounter::value() const
+    {
+        int64_t value = 0;
+        for (const auto& shard : shards_)
+        {
+            value += shard.value_.load(std::memory_order_relaxed);
+        }
+        return value;
+    }
+
+    uint64_t HistogramSnapshot::valueAtPercentile(double percentile) const
+    {
+        if (count_ == 0)
+        {
+            return 0;
+        }
+
+        const auto target = static_cast<uint64_t>(std::clamp(percentile, 0.0, 100.0) / 100.0 * count_ + 0.5);
+        uint64_t seen = 0;
+        for (size_t index = 0; index < buckets_.size(); ++index)
+        {
+            seen += buckets_[index];
+            if (seen >= std::max<uint64_t>(target, 1))
+            {
+                return std::min(LatencyHistogram::bucketUpperBound(index), max_);
+            }
+        }
+        return max_;
+    }
+
+    LatencyHistogram::LatencyHistogram()
+        : shards_(StreamerMetricsPrivate::shard_count__)
+    {
+        for (auto& shard : shards_)
+        {
+            for (auto& bucket : shard.buckets_)
+            {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            shard.count_.store(0, std::memory_order_relaxed);
+            shard.sum_.store(0, std::memory_order_relaxed);
+            shard.max_.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void LatencyHistogram::record(MetricsClock::duration duration)
+    {
+        const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        const uint64_t value = nanoseconds > 0 ? static_cast<uint64_t>(nanoseconds) : 0;
+
+        auto& shard = shards_[StreamerMetricsPrivate::currentThreadShard()];
+        shard.buckets_[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        shard.count_.fetch_add(1, std::memory_order_relaxed);
+        shard.sum_.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t max = shard.max_.load(std::memory_order_relaxed);
+        while (value > max && !shard.max_.compare_exchange_weak(max, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    HistogramSnapshot LatencyHistogram::snapshot() const
+    {
+        HistogramSnapshot snapshot;
+        snapshot.buckets_.assign(bucket_count__, 0);
+
+        uint64_t sum = 0;
+        for (const auto& shard : shards_)
+        {
+            for (size_t index = 0; index < bucket_count__; ++index)
+            {
+                snapshot.buckets_[index] += shard.buckets_[index].load(std::memory_order_relaxed);
+            }
+            snapshot.count_ += shard.count_.load(std::memory_order_relaxed);
+            sum += shard.sum_.load(std::memory_order_relaxed);
+            snapshot.max_ = std::max(snapshot.max_, shard.max_.load(std::memory_order_relaxed));
+        }
+
+        snapshot.mean_ = snapshot.count_ > 0 ? static_cast<double>(sum) / snapshot.count_ : 0.0;
+        return snapshot;
+    }
+
+    size_t LatencyHistogram::bucketIndex(uint64_t value)
+    {
+        if (value < sub_bucket_count__)
+        {
+            return static_cast<size_t>(value);
+        }
+
+        const size_t shift = StreamerMetricsPrivate::mostSignificantBit(value) - sub_bucket_bits__;
+        return (shift + 1) * sub_bucket_count__ + static_cast<size_t>((value >> shift) - sub_bucket_count__);
+    }
+
+    uint64_t LatencyHistogram::bucketUpperBound(size_t index)
+    {
+        if (index < sub_bucket_count__)
+        {
+            return index;
+        }
+
+        const size_t shift = index / sub_bucket_count__ - 1;
+        const uint64_t sub_bucket = index % sub_bucket_count__ + sub_bucket_count__;
+        return ((sub_bucket + 1) << shift) - 1;
+    }
+
+    StreamerMetrics::Snapshot StreamerMetrics::snapshot() const
+    {
+        Snapshot snapshot;
+        snapshot.enqueue_to_io_ = enqueue_to_io_.snapshot();
+        snapshot.io_to_socket_write_ = io_to_socket_write_.snapshot();
+        snapshot.io_to_ack_ = io_to_ack_.snapshot();
+        snapshot.socket_write_to_ack_ = socket_write_to_ack_.snapshot();
+        snapshot.control_to_socket_write_ = control_to_socket_write_.snapshot();
+        snapshot.compression_ = compression_.snapshot();
+        snapshot.tls_handshake_ = tls_handshake_.snapshot();
+        snapshot.connect_ = connect_.snapshot();
+        snapshot.messages_published_ = messages_published_.value();
+        snapshot.bytes_published_ = bytes_published_.value();
+        snapshot.messages_acked_ = messages_acked_.value();
+        snapshot.messages_lost_ = messages_lost_.value();
+        snapshot.in_flight_messages_ = in_flight_messages_.value();
+        snapshot.socket_writes_ = socket_writes_.value();
+        snapshot.bytes_written_ = bytes_written_.value();
+        snapshot.reconnects_ = reconnects_.value();
+        snapshot.channel_recreations_ = channel_recreations_.value();
+        snapshot.flow_control_pauses_ = flow_control_pauses_.value();
+        snapshot.flow_control_rejections_ = flow_control_rejections_.value();
+        snapshot.spool_replays_ = spool_replays_.value();
+        snapshot.compressed_messages_ = compressed_messages_.value();
+        snapshot.compression_input_bytes_ = compression_input_bytes_.value();
+        snapshot.compression_output_bytes_ = compression_output_bytes_.value();
+        snapshot.deliveries_ = deliveries_.value();
+        snapshot.delivery_acks_ = delivery_acks_.value();
+        snapshot.delivery_rejections_ = delivery_rejections_.value();
+        snapshot.tls_handshakes_ = tls_handshakes_.value();
+        snapshot.tls_resumed_handshakes_ = tls_resumed_handshakes_.value();
+        snapshot.tls_records_written_ = tls_records_written_.value();
+        snapshot.io_thread_waits_ = io_thread_waits_.value();
+        snapshot.heartbeats_sent_ = heartbeats_sent_.value();
+        snapshot.heartbeats_received_ = heartbeats_received_.value();
+        return snapshot;
+    }
+
+    double StreamerMetrics::Snapshot::compressionRatio() const
+    {
+        return compression_output_bytes_ > 0
+            ? static_cast<double>(compression_input_bytes_) / static_cast<double>(compression_output_bytes_)
+            : 1.0;
+    }
+
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace RabbitMqStreamingPlugin
+{
+    namespace StreamerMetricsPrivate
+    {
+        // Recording threads are spread over the shards so they rarely write to the same cache lines
+        constexpr size_t shard_count__ = 16;
+        size_t currentThreadShard();
+    }  // namespace StreamerMetricsPrivate
+
+    using MetricsClock = std::chrono::steady_clock;
+
+    class ShardedCounter
+    {
+    public:
+        ShardedCounter();
+
+        void add(int64_t value)
+        {
+            shards_[StreamerMetricsPrivate::currentThreadShard()].value_.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        int64_t value() const;
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::atomic<int64_t> value_;
+        };
+
+        std::array<Shard, StreamerMetricsPrivate::shard_count__> shards_;
+    };
+
+    struct HistogramSnapshot
+    {
+        uint64_t count_ = 0;
+        uint64_t max_ = 0;
+        double mean_ = 0.0;
+        // Count per bucket of the histogram, see LatencyHistogram
+        std::vector<uint64_t> buckets_;
+
+        // Upper bound of the bucket holding the requested percentile (0 to 100), in nanoseconds
+        uint64_t valueAtPercentile(double percentile) const;
+    };
+
+    /*
+     * LatencyHistogram records durations in nanoseconds in log-linear buckets, HDR histogram style: every power of
+     * two range is split in 16 buckets, which keeps the relative error under 1/16 from 1 ns to several hours.
+     * Recording is a relaxed atomic increment in the shard of the calling thread, snapshots sum the shards.
+     */
+    class LatencyHistogram
+    {
+    public:
+        static constexpr size_t sub_bucket_bits__ = 4;
+        static constexpr size_t sub_bucket_count__ = size_t(1) << sub_bucket_bits__;
+        static constexpr size_t bucket_count__ = (64 - sub_bucket_bits__ + 1) * sub_bucket_count__;
+
+        LatencyHistogram();
+
+        void record(MetricsClock::duration duration);
+        void recordSince(MetricsClock::time_point start)
+        {
+            record(MetricsClock::now() - start);
+        }
+
+        HistogramSnapshot snapshot() const;
+
+        static size_t bucketIndex(uint64_t value);
+        static uint64_t bucketUpperBound(size_t index);
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::array<std::atomic<uint64_t>, bucket_count__> buckets_;
+            std::atomic<uint64_t> count_;
+            std::atomic<uint64_t> sum_;
+            std::atomic<uint64_t> max_;
+        };
+
+        std::vector<Shard> shards_;
+    };
+
+    /*
+     * StreamerMetrics gathers the histograms and counters recorded by every layer of an AmqpCppStreamer.
+     * It can be recorded and read from any thread.
+     */
+    class StreamerMetrics
+    {
+    public:
+        struct Snapshot
+        {
+            // Caller enqueue to IO thread pickup
+            HistogramSnapshot enqueue_to_io_;
+            // IO thread pickup of the oldest frame of a write to the completion of that socket write
+            HistogramSnapshot io_to_socket_write_;
+            // IO thread pickup to broker confirm, includes the socket write
+            HistogramSnapshot io_to_ack_;
+            // Completion of the socket write sending the end of a message to its broker confirm, the broker round trip
+            HistogramSnapshot socket_write_to_ack_;
+            // Control frame (heartbeat, connection method or channel.open) queued to the completion of its socket write
+            HistogramSnapshot control_to_socket_write_;
+            // Time spent compressing each body on the compressing thread
+            HistogramSnapshot compression_;
+            // TCP connection to the end of the TLS handshake
+            HistogramSnapshot tls_handshake_;
+            // Time spent in AmqpCppStreamer::connect, including the wait for the ready channels
+            HistogramSnapshot connect_;
+
+            int64_t messages_published_ = 0;
+            int64_t bytes_published_ = 0;
+            int64_t messages_acked_ = 0;
+            int64_t messages_lost_ = 0;
+            int64_t in_flight_messages_ = 0;
+            int64_t socket_writes_ = 0;
+            int64_t bytes_written_ = 0;
+            int64_t reconnects_ = 0;
+            int64_t channel_recreations_ = 0;
+            int64_t flow_control_pauses_ = 0;
+            int64_t flow_control_rejections_ = 0;
+            int64_t spool_replays_ = 0;
+            // Bodies published compressed, and body bytes before and after compression of every body considered
+            int64_t compressed_messages_ = 0;
+            int64_t compression_input_bytes_ = 0;
+            int64_t compression_output_bytes_ = 0;
+            // Messages received by the consumers, ack frames sent for them and deliveries requeued
+            int64_t deliveries_ = 0;
+            int64_t delivery_acks_ = 0;
+            int64_t delivery_rejections_ = 0;
+            int64_t tls_handshakes_ = 0;
+            int64_t tls_resumed_handshakes_ = 0;
+            // TLS records written, bytes_written_ / tls_records_written_ is the average plaintext size of a record
+            int64_t tls_records_written_ = 0;
+            // Blocking waits of the spinning IO threads, after their spin budget ran out (StreamerOptions::io_spin_budget_)
+            int64_t io_thread_waits_ = 0;
+            int64_t heartbeats_sent_ = 0;
+            int64_t heartbeats_received_ = 0;
+            // Messages and body bytes accepted by the flow control and not settled when the snapshot was taken
+            size_t pending_messages_ = 0;
+            size_t pending_bytes_ = 0;
+            // Bytes waiting in the output buffers of the connections when the snapshot was taken
+            size_t output_buffer_bytes_ = 0;
+            // Messages of the spool not confirmed yet and bytes they take in the spool file
+            size_t spooled_messages_ = 0;
+            size_t spool_used_bytes_ = 0;
+
+            // Input bytes per output byte of the bodies considered for compression, 1 when none was
+            double compressionRatio() const;
+        };
+
+        Snapshot snapshot() const;
+
+        LatencyHistogram enqueue_to_io_;
+        LatencyHistogram io_to_socket_write_;
+        LatencyHistogram io_to_ack_;
+        LatencyHistogram socket_write_to_ack_;
+        LatencyHistogram control_to_socket_write_;
+        LatencyHistogram compression_;
+        LatencyHistogram tls_handshake_;
+        LatencyHistogram connect_;
+
+        ShardedCounter messages_published_;
+        ShardedCounter bytes_published_;
+        ShardedCounter messages_acked_;
+        ShardedCounter messages_lost_;
+        ShardedCounter in_flight_messages_;
+        ShardedCounter socket_writes_;
+        ShardedCounter bytes_written_;
+        ShardedCounter reconnects_;
+        ShardedCounter channel_recreations_;
+        ShardedCounter flow_control_pauses_;
+        ShardedCounter flow_control_rejections_;
+        ShardedCounter spool_replays_;
+        ShardedCounter compressed_messages_;
+        ShardedCounter compression_input_bytes_;
+        ShardedCounter compression_output_bytes_;
+        ShardedCounter deliveries_;
+        ShardedCounter delivery_acks_;
+        ShardedCounter delivery_rejections_;
+        ShardedCounter tls_handshakes_;
+        ShardedCounter tls_resumed_handshakes_;
+        ShardedCounter tls_records_written_;
+        ShardedCounter io_thread_waits_;
+        ShardedCounter heartbeats_sent_;
+        ShardedCounter heartbeats_received_;
+    };
+
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace RabbitMqStreamingPlugin
+{
+    struct AsioHandlerOptions
+    {
+        // Pending frames are gathered into a single vectored write of at most max_write_bytes_ spread over
+        // max_write_buffers_ buffers
+        size_t max_write_bytes_ = 256 * 1024;
+        size_t max_write_buffers_ = 64;
+
+        // Frames waiting to be written are stored in recycled chunks of that size,
+        // at most max_free_output_chunks_ written chunks are kept for reuse.
+        size_t output_chunk_size_ = 64 * 1024;
+        size_t max_free_output_chunks_ = 64;
+
+        // The receive buffer grows from the initial size to fit the largest frame received, up to the frame_max
+        // negotiated with the broker, or up to the maximum size when the broker sets no limit. A broker negotiating
+        // a frame_max above the maximum size is rejected.
+        size_t initial_receive_buffer_size_ = 16 * 1024;
+        size_t max_receive_buffer_size_ = 4 * 1024 * 1024;
+        // Smallest read requested from the socket, reads are larger when more bytes are already waiting
+        size_t min_read_size_ = 4 * 1024;
+
+        // Host resolution and TCP connection, every resolved address is tried in parallel
+        std::chrono::milliseconds connect_timeout_{ 500 };
+        // From the TCP connection to the end of the AMQP handshake, including the TLS handshake
+        std::chrono::milliseconds handshake_timeout_{ 5000 };
+        // Stopping a connection closes it with the broker (connection.close, then the TLS close_notify) within that
+        // time before dropping the socket
+        std::chrono::milliseconds close_timeout_{ 1000 };
+
+        // TCP_NODELAY, small frames are sent right away instead of waiting for the ack of the previous segment
+        bool tcp_no_delay_ = false;
+        // SO_BUSY_POLL of the socket (Linux only), the kernel polls the device queue for that long on a read instead
+        // of waiting for the interrupt. 0 leaves the system default, larger values may need CAP_NET_ADMIN.
+        std::chrono::microseconds socket_busy_poll_{ 0 };
+
+        // Heartbeat interval requested to the broker, the lower of this one and the broker proposal is used. 0
+        // disables the heartbeats. The IO thread sends a heartbeat when it wrote nothing for half the interval and
+        // fails the connection when it read nothing for two intervals.
+        std::chrono::seconds heartbeat_interval_{ 60 };
+        // Weights of the lanes of the write scheduler (see FrameScheduler): while both lanes have frames waiting,
+        // a write takes about high_priority_weight_ bytes of the high priority channels per normal_priority_weight_
+        // bytes of the others. The consumer channels are high priority. Heartbeats and connection methods always
+        // go first.
+        size_t high_priority_weight_ = 4;
+        size_t normal_priority_weight_ = 1;
+    };
+
+    struct TlsOptions
+    {
+        // Connects with amqps, the broker port is then usually 5671
+        bool is_enabled_ = false;
+        // Verifies the broker certificate against ca_file_, or the default CAs of the system when empty, and its name
+        bool verify_peer_ = true;
+        std::string ca_file_;
+        // Name sent in the SNI extension and verified in the certificate, the broker address when empty
+        std::string server_name_;
+        // Reconnections resume the last session established with the broker, skipping the full handshake
+        bool resume_sessions_ = true;
+        // Size of the TLS records written, 512 to 16384. The frames gathered by a write are coalesced into records
+        // of that size instead of one record per frame.
+        size_t max_record_size_ = 16384;
+    };
+
+    struct SynchronousChannelOptions
+    {
+        // Maximum number of published messages waiting for a broker confirm on the channel.
+        // A value of 1 means one broker round trip per message.
+        size_t max_in_flight_messages_ = 1;
+    };
+
+    struct ConsumerOptions
+    {
+        // basic.qos prefetch of every consumer, 0 leaves the deliveries unbounded
+        uint16_t prefetch_count_ = 256;
+        // Handled deliveries are acked at once with the multiple flag, when ack_batch_size_ of them are waiting or
+        // ack_interval_ after the first one. The batch is capped at half the prefetch so the broker never stalls.
+        size_t ack_batch_size_ = 64;
+        std::chrono::microseconds ack_interval_ = std::chrono::milliseconds(10);
+        // Threads running the delivery callbacks, shared by the consumers of the streamer. The callbacks run on the
+        // IO thread, with the bodies read in place, when 0.
+        size_t worker_threads_ = 0;
+    };
+
+    enum class FlowControlPolicy
+    {
+        // Producers wait until the flow resumes, for at most FlowControlOptions::max_block_time_
+        Block,
+        // Publishes fail right away while the flow is paused
+        Reject,
+        // Publishes are always accepted, the application throttles itself from FlowControlOptions::on_flow_change_
+        Callback,
+    };
+
+    struct FlowControlOptions
+    {
+        // Bounds on the messages accepted by the streamer and not settled yet, wherever they are: queued on a
+        // channel, posted to the IO thread, in the output buffers or waiting for their confirm. The flow pauses when
+        // a high watermark is reached or when the broker blocks a connection, and resumes once every count is at or
+        // below its low watermark. A high watermark of 0 disables that bound.
+        size_t high_watermark_messages_ = 0;
+        size_t low_watermark_messages_ = 0;
+        // Counted on the message bodies
+        size_t high_watermark_bytes_ = 0;
+        size_t low_watermark_bytes_ = 0;
+
+        FlowControlPolicy policy_ = FlowControlPolicy::Block;
+        std::chrono::milliseconds max_block_time_ = std::chrono::seconds(30);
+
+        // Called with true when the flow pauses and with false when it resumes, whatever the policy. It is called
+        // from the publishing or the IO threads and must neither block nor publish.
+        std::function<void(bool is_paused)> on_flow_change_;
+    };
+
+    struct SpoolOptions
+    {
+        // File of the spool, created when missing and recovered otherwise. The spool is disabled when empty.
+        std::string path_;
+        // Size of a new spool file, an existing file keeps its own size
+        size_t capacity_ = 64 * 1024 * 1024;
+        // Delay between two reconnection attempts after the connection to the broker is lost
+        std::chrono::milliseconds reconnect_delay_ = std::chrono::seconds(1);
+        // Spooled messages forwarded to the broker and not confirmed yet
+        size_t max_in_flight_messages_ = 1024;
+    };
+
+    enum class CompressionAlgorithm
+    {
+        None,
+        // zlib format, tagged with the "deflate" content encoding
+        Zlib,
+        // Tagged with the "zstd" content encoding
+        Zstd,
+    };
+
+    struct CompressionOptions
+    {
+        CompressionAlgorithm algorithm_ = CompressionAlgorithm::None;
+        // Smaller bodies are published as they are, as well as the bodies that don't shrink
+        size_t min_size_ = 512;
+        // Level of the algorithm, 0 uses its default level
+        int level_ = 0;
+        // Preset dictionaries per event type name, e.g. trained with zstd --train on samples of the messages.
+        // The consumers need the same dictionary, it is identified by its id in the compressed frame header.
+        std::unordered_map<std::string, std::string> dictionaries_;
+        // Threads compressing the messages of asyncPublish, which then compresses on the calling thread when 0.
+        // The other publish functions always compress on the calling thread.
+        size_t worker_threads_ = 0;
+    };
+
+    struct AggregationOptions
+    {
+        // The messages published with asyncPublishAggregated are packed per topic, partition key and event type into
+        // MessageContainer bodies, published as soon as one of the bounds is reached
+        bool is_enabled_ = false;
+        size_t max_messages_ = 1000;
+        size_t max_bytes_ = 128 * 1024;
+        // Longest time a message waits in its container before the container is published
+        std::chrono::microseconds linger_ = std::chrono::milliseconds(5);
+    };
+
+    enum class PublishRouting
+    {
+        // Messages with the same partition key always go to the same channel, keeping their ordering
+        PartitionKey,
+        // Messages are spread evenly over every channel, without any ordering guarantee
+        RoundRobin,
+    };
+
+    struct StreamerOptions
+    {
+        AsioHandlerOptions handler_;
+        TlsOptions tls_;
+        SynchronousChannelOptions channel_;
+        FlowControlOptions flow_control_;
+        SpoolOptions spool_;
+        CompressionOptions compression_;
+        AggregationOptions aggregation_;
+        ConsumerOptions consumer_;
+
+        // Number of connections, each one with its own IO thread, and of channels opened on each connection
+        size_t connection_count_ = 1;
+        size_t channel_count_ = 1;
+        PublishRouting routing_ = PublishRouting::PartitionKey;
+
+        // AmqpCppStreamer::connect waits until the channels of the first ready_channels_ slots are open and in
+        // confirm mode, so the first publishes don't pay the handshakes. 0 returns once the connections are started.
+        // The wait ends after the connect and handshake timeouts of handler_ plus channel_open_timeout_.
+        size_t ready_channels_ = 0;
+        std::chrono::milliseconds channel_open_timeout_{ 5000 };
+
+        // CPU the IO thread of each connection is pinned to, connection i uses io_thread_cpus_[i % size].
+        // The IO threads aren't pinned when empty.
+        std::vector<int> io_thread_cpus_;
+
+        // The IO threads poll their event loop without sleeping for that long after their last completion, before
+        // waiting in the kernel. 0 always waits in the kernel. Spinning burns the CPU of the IO thread but saves the
+        // wakeup latency, it should be combined with io_thread_cpus_ and the socket options of handler_ (see the
+        // low-latency mode in the README).
+        std::chrono::microseconds io_spin_budget_{ 0 };
+    };
+
+}  // namespace RabbitMqStreamingPlugin
@@ -1,29 +1,146 @@
 #include "SynchronousChannel.h"
 
-#include <iostream>
+#include "Logging.h"
+
+#include <algorithm>
+#include <utility>
+#include <thread>
 
 namespace RabbitMqStreamingPlugin
 {
     namespace SynchronousChannelPrivate
     {
-        void setEnvelopeAsProtobuf(const std::string& event_type_name, AMQP::Envelope& envelope)
+        // Posts of the channel pending at once: one to publish, one to spare
+        constexpr size_t post_memory_blocks__ = 2;
+        constexpr size_t post_memory_block_size__ = 256;
+
+        // Assigning the strings reuses the capacity of the slot
+        void assignMessage(
+            OutgoingMessage& slot,
+            const std::string& topic,
+            const std::string& partition_key,
+            const std::string& event_type_name,
+            MessageBody message,
+            bool is_container)
         {
-            envelope.setContentType("application/protobuf");
-            envelope.setPersistent(true);
+            slot.topic_ = topic;
+            slot.partition_key_ = partition_key;
+            slot.event_type_name_ = event_type_name;
+            slot.message_ = std::move(message);
+            slot.is_container_ = is_container;
+        }
+    }
+
+    bool SynchronousChannel::PublishRequestQueue::empty() const
+    {
+        return size_ == 0;
+    }
+
+    size_t SynchronousChannel::PublishRequestQueue::size() const
+    {
+        return size_;
+    }
+
+    SynchronousChannel::PublishRequest& SynchronousChannel::PublishRequestQueue::operator[](size_t index)
+    {
+        return slots_[index];
+    }
 
-            AMQP::Table header_table;
-            header_table.set("proto", event_type_name.c_str());
-            envelope.setHeaders(header_table);
+    SynchronousChannel::PublishRequest& SynchronousChannel::PublishRequestQueue::push()
+    {
+        if (size_ == slots_.size())
+        {
+            slots_.emplace_back();
         }
-    }  // namespace SynchronousChannelPrivate
+        return slots_[size_++];
+    }
+
+    void SynchronousChannel::PublishRequestQueue::append(PublishRequestQueue& other, size_t count)
+    {
+        if (empty() && count == other.size_)
+        {
+            // Usual case, the IO thread took the previous requests already and the whole group fits in the window
+            std::swap(slots_, other.slots_);
+            std::swap(size_, other.size_);
+            return;
+        }
+
+        // The free slots taken in exchange are moved after the requests left in other
+        for (size_t index = 0; index < count; ++index)
+        {
+            std::swap(push(), other.slots_[index]);
+        }
+        for (size_t index = count; index < other.size_; ++index)
+        {
+            std::swap(other.slots_[index - count], other.slots_[index]);
+        }
+        other.size_ -= count;
+    }
+
+    void SynchronousChannel::PublishRequestQueue::pop(size_t count)
+    {
+        for (; count > 0; --count)
+        {
+            auto& slot = slots_[--size_];
+            slot.message_.message_ = MessageBody();
+            slot.publish_template_.reset();
+            slot.completion_ = PublishCompletion();
+        }
+    }
 
-    SynchronousChannel::SynchronousChannel(boost::asio::io_service& io_service, AMQP::Connection& connection)
+    void SynchronousChannel::PublishRequestQueue::clear()
+    {
+        pop(size_);
+    }
+
+    SynchronousChannel::SynchronousChannel(
+        boost::asio::io_service& io_service,
+        AMQP::Connection& connection,
+        const WriteTimeline& write_timeline,
+        StreamerMetrics& metrics,
+        FlowController& flow_controller,
+        const SynchronousChannelOptions& options)
         : io_service_(io_service)
-        , operation_finished_(false)
+        , write_timeline_(write_timeline)
+        , metrics_(metrics)
+        , flow_controller_(flow_controller)
+        , max_in_flight_messages_(std::max<size_t>(options.max_in_flight_messages_, 1))
         , is_in_error_state_(false)
+        , is_ready_(false)
+        , next_submission_(0)
+        , admitted_submissions_(0)
+        , has_group_leader_(false)
+        , is_publish_posted_(false)
+        , post_memory_(HandlerMemory::create(
+            SynchronousChannelPrivate::post_memory_block_size__, SynchronousChannelPrivate::post_memory_blocks__))
+        , in_flight_messages_(max_in_flight_messages_)
+        , published_messages_(max_in_flight_messages_)
         , channel_(&connection)
-        , reliable_(channel_)
     {
+        settled_messages_.reserve(max_in_flight_messages_);
+
+        // Any error invalidates the whole channel
+        channel_.onError([this](const char* message)
+        {
+            STREAMER_LOG_ERROR("SynchronousChannel onError: ", message);
+            onError(message);
+        });
+
+        channel_.confirmSelect()
+            .onSuccess([this]()
+        {
+            std::unique_lock lock(operation_mutex_);
+            is_ready_ = true;
+            operation_finished_cv_.notify_all();
+        })
+            .onAck([this](uint64_t delivery_tag, bool multiple)
+        {
+            onAck(delivery_tag, multiple);
+        })
+            .onNack([this](uint64_t delivery_tag, bool multiple, bool)
+        {
+            onNack(delivery_tag, multiple);
+        });
     }
 
     SynchronousChannel::~SynchronousChannel()
@@ -40,88 +157,532 @@ namespace RabbitMqStreamingPlugin
         const std::string& topic,
         const std::string& partition_key,
         const std::string& event_type_name,
-        const std::string& message)
+        MessageBody message)
     {
-        std::cout << std::this_thread::get_id() << ": SynchronousChannel::publish begin\n";
+        STREAMER_LOG_TRACE("SynchronousChannel::publish begin");
 
-        std::unique_lock publish_lock(publish_mutex_);
-        std::unique_lock operation_lock(operation_mutex_);
-        operation_finished_ = false;
+        PublishWaiter waiter;
+        bool is_queued = false;
+        try
+        {
+            submitPublishes(1, message.size(), [&](size_t, PublishRequest& request)
+            {
+                SynchronousChannelPrivate::assignMessage(
+                    request.message_, topic, partition_key, event_type_name, std::move(message), false);
+                request.completion_ = PublishCompletion(waiter);
+                is_queued = true;
+            });
+        }
+        catch (...)
+        {
+            // The channel failed after queuing the message, it still completes the waiter
+            if (is_queued)
+            {
+                waiter.wait();
+            }
+            throw;
+        }
 
-        if (!is_in_error_state_)
+        if (const auto exception = waiter.wait())
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+
+    std::future<void> SynchronousChannel::publishAsync(
+        const std::string& topic,
+        const std::string& partition_key,
+        const std::string& event_type_name,
+        MessageBody message)
+    {
+        std::promise<void> promise;
+        auto future = promise.get_future();
+        submitPublishes(1, message.size(), [&](size_t, PublishRequest& request)
+        {
+            SynchronousChannelPrivate::assignMessage(
+                request.message_, topic, partition_key, event_type_name, std::move(message), false);
+            request.completion_ = PublishCompletion(std::move(promise));
+        });
+        return future;
+    }
+
+    void SynchronousChannel::publish(const PublishTemplateHandle& publish_template, MessageBody message)
+    {
+        STREAMER_LOG_TRACE("SynchronousChannel::publish with template begin");
+
+        PublishWaiter waiter;
+        bool is_queued = false;
+        try
+        {
+            submitPublishes(1, message.size(), [&](size_t, PublishRequest& request)
+            {
+                request.message_.message_ = std::move(message);
+                request.publish_template_ = publish_template;
+                request.completion_ = PublishCompletion(waiter);
+                is_queued = true;
+            });
+        }
+        catch (...)
+        {
+            if (is_queued)
+            {
+                waiter.wait();
+            }
+            throw;
+        }
+
+        if (const auto exception = waiter.wait())
         {
-            std::cout << std::this_thread::get_id() << ": SynchronousChannel::publish locked\n";
+            std::rethrow_exception(exception);
+        }
+    }
 
-            io_service_.post([this, topic, partition_key, event_type_name, message]()
+    std::future<void> SynchronousChannel::publishAsync(
+        const PublishTemplateHandle& publish_template, MessageBody message)
+    {
+        std::promise<void> promise;
+        auto future = promise.get_future();
+        submitPublishes(1, message.size(), [&](size_t, PublishRequest& request)
+        {
+            request.message_.message_ = std::move(message);
+            request.publish_template_ = publish_template;
+            request.completion_ = PublishCompletion(std::move(promise));
+        });
+        return future;
+    }
+
+    BatchPublishReport SynchronousChannel::publishBatch(std::vector<OutgoingMessage> messages)
+    {
+        auto futures = publishBatchAsync(std::move(messages));
+
+        BatchPublishReport report;
+        for (size_t index = 0; index < futures.size(); ++index)
+        {
+            try
+            {
+                futures[index].get();
+                ++report.published_count_;
+            }
+            catch (const std::exception& e)
             {
-                AMQP::Envelope envelope(message.data(), message.size());
-                SynchronousChannelPrivate::setEnvelopeAsProtobuf(event_type_name, envelope);
+                report.failures_.emplace_back(index, e.what());
+            }
+        }
+        return report;
+    }
 
-                reliable_.publish(topic, partition_key, envelope)
-                    .onAck([this]()
-                {
-                    std::cout << std::this_thread::get_id() << ": SynchronousChannel::publish onAck\n";
-                    onSuccess();
-                })
-                    .onLost([this]()
+    std::vector<std::future<void>> SynchronousChannel::publishBatchAsync(std::vector<OutgoingMessage> messages)
+    {
+        std::vector<std::promise<void>> promises(messages.size());
+        std::vector<std::future<void>> futures;
+        futures.reserve(messages.size());
+        size_t body_bytes = 0;
+        for (size_t index = 0; index < messages.size(); ++index)
+        {
+            futures.push_back(promises[index].get_future());
+            body_bytes += messages[index].message_.size();
+        }
+
+        submitPublishes(messages.size(), body_bytes, [&](size_t index, PublishRequest& request)
+        {
+            auto& message = messages[index];
+            SynchronousChannelPrivate::assignMessage(request.message_, message.topic_, message.partition_key_,
+                message.event_type_name_, std::move(message.message_), message.is_container_);
+            request.completion_ = PublishCompletion(std::move(promises[index]));
+        });
+        return futures;
+    }
+
+    template <typename FillRequest>
+    void SynchronousChannel::submitPublishes(size_t count, size_t body_bytes, FillRequest fill_request)
+    {
+        flow_controller_.acquire(count, body_bytes);
+
+        std::unique_lock operation_lock(operation_mutex_);
+        if (is_in_error_state_)
+        {
+            flow_controller_.release(count, body_bytes);
+            // Throws the channel error
+            waitForOperationToFinish(operation_lock, []()
+            {
+                return true;
+            });
+        }
+
+        const auto enqueued_at = MetricsClock::now();
+        const size_t first_request = waiting_requests_.size();
+        try
+        {
+            for (size_t index = 0; index < count; ++index)
+            {
+                auto& request = waiting_requests_.push();
+                fill_request(index, request);
+                request.enqueued_at_ = enqueued_at;
+            }
+        }
+        catch (...)
+        {
+            // Nothing of the call is queued, the completions already filled are destroyed without being invoked
+            waiting_requests_.pop(waiting_requests_.size() - first_request);
+            flow_controller_.release(count, body_bytes);
+            throw;
+        }
+        next_submission_ += count;
+        const uint64_t last_submission = next_submission_;
+
+        // Group commit: the caller finding no leader admits what every other caller queued meanwhile, the others
+        // only wait until their messages have been admitted
+        waitForOperationToFinish(operation_lock, [this, last_submission]()
+        {
+            return admitted_submissions_ >= last_submission || !has_group_leader_;
+        });
+        if (admitted_submissions_ < last_submission)
+        {
+            leadGroupCommit(operation_lock, last_submission);
+        }
+    }
+
+    void SynchronousChannel::submitAsyncPublish(OutgoingMessage message, PublishCompletion completion)
+    {
+        const size_t body_size = message.message_.size();
+        if (!flow_controller_.tryAcquire(1, body_size))
+        {
+            completion.complete(
+                std::make_exception_ptr(std::runtime_error("FlowController error: Publishing is paused.")),
+                io_service_.get_executor());
+            return;
+        }
+
+        std::unique_lock operation_lock(operation_mutex_);
+        if (is_in_error_state_)
+        {
+            const auto exception = makeErrorException();
+            operation_lock.unlock();
+            settle(completion, body_size, exception);
+            return;
+        }
+
+        auto& request = waiting_requests_.push();
+        try
+        {
+            SynchronousChannelPrivate::assignMessage(request.message_, message.topic_, message.partition_key_,
+                message.event_type_name_, std::move(message.message_), message.is_container_);
+        }
+        catch (...)
+        {
+            waiting_requests_.pop(1);
+            operation_lock.unlock();
+            settle(completion, body_size, std::current_exception());
+            return;
+        }
+        request.completion_ = std::move(completion);
+        request.enqueued_at_ = MetricsClock::now();
+        ++next_submission_;
+
+        // Without room in the window, the publish waits for a leader or for a confirm freeing some room
+        if (!has_group_leader_ && in_flight_messages_.size() < max_in_flight_messages_)
+        {
+            admitWaitingPublishes();
+        }
+    }
+
+    void SynchronousChannel::leadGroupCommit(std::unique_lock<std::recursive_mutex>& lock, uint64_t last_submission)
+    {
+        has_group_leader_ = true;
+        try
+        {
+            // Batches larger than the window are admitted as the confirms free some room
+            while (admitted_submissions_ < last_submission)
+            {
+                waitForOperationToFinish(lock, [this]()
                 {
-                    std::cout << std::this_thread::get_id() << ": SynchronousChannel::publish onLost\n";
-                    onError("Message failed to publish!");
+                    return in_flight_messages_.size() < max_in_flight_messages_;
                 });
+                admitWaitingPublishes();
+            }
+        }
+        catch (const std::exception&)
+        {
+            has_group_leader_ = false;
+            throw;
+        }
+        // The callers whose publishes didn't fit wake up, one of them leads the next group
+        has_group_leader_ = false;
+        operation_finished_cv_.notify_all();
+    }
 
-                //channel_.confirmSelect()
-            //    .onSuccess([this, &topic, &partition_key, &message]()
-            //{
-            //    std::cout << "SynchronousChannel::publish onSuccess\n";
-            //    channel_.publish(topic, partition_key, message);
-            //})
-            //    .onAck([this](uint64_t /*delivery_tag*/, bool /*multiple*/)
-            //{
-            //    std::cout << "SynchronousChannel::publish onAck\n";
-            //    onSuccess();
-            //})
-            //    .onNack([this](uint64_t /*delivery_tag*/, bool /*multiple*/, bool /*requeue*/)
-            //{
-            //    std::cout << "SynchronousChannel::publish onNAck\n";
-            //    onError("Message failed to publish!");
-            //});
-            
-            });
+    void SynchronousChannel::admitWaitingPublishes()
+    {
+        // Only the oldest requests fitting in the window are admitted, the others wait for the next leader or confirm
+        const size_t free_room = in_flight_messages_.size() < max_in_flight_messages_
+            ? max_in_flight_messages_ - in_flight_messages_.size()
+            : 0;
+        const size_t group_size = std::min(waiting_requests_.size(), free_room);
+        STREAMER_LOG_TRACE("SynchronousChannel::admitWaitingPublishes group of ", group_size);
+        if (group_size == 0)
+        {
+            return;
+        }
+        admitted_submissions_ += group_size;
+
+        // The IO thread publishes the admitted requests in this order, so the broker numbers the messages like the
+        // tracker
+        for (size_t index = 0; index < group_size; ++index)
+        {
+            auto& request = waiting_requests_[index];
+            in_flight_messages_.push(
+                InFlightMessage{ std::move(request.completion_), request.message_.message_.size() });
+        }
+        admitted_requests_.append(waiting_requests_, group_size);
+        metrics_.in_flight_messages_.add(static_cast<int64_t>(group_size));
+        operation_finished_cv_.notify_all();
+
+        // The groups admitted before the IO thread runs the pending post are published by it
+        if (!is_publish_posted_)
+        {
+            is_publish_posted_ = true;
+            io_service_.post(bindHandlerMemory(*post_memory_, [this]()
+            {
+                publishAdmittedRequests();
+            }));
+        }
+    }
+
+    void SynchronousChannel::publishAdmittedRequests()
+    {
+        {
+            std::unique_lock lock(operation_mutex_);
+            is_publish_posted_ = false;
+            std::swap(admitted_requests_, published_requests_);
         }
 
-        waitForOperationToFinish(std::move(operation_lock));
+        for (size_t index = 0; index < published_requests_.size(); ++index)
+        {
+            const auto& request = published_requests_[index];
+            if (request.publish_template_)
+            {
+                publishOnIoThread(*request.publish_template_, request.message_.message_, request.enqueued_at_);
+            }
+            else
+            {
+                publishOnIoThread(request.message_, request.enqueued_at_);
+            }
+        }
+        published_requests_.clear();
     }
 
-    void SynchronousChannel::waitForOperationToFinish(std::unique_lock<std::recursive_mutex> lock)
+    void SynchronousChannel::publishOnIoThread(const OutgoingMessage& message, MetricsClock::time_point enqueued_at)
     {
-        std::cout << std::this_thread::get_id() << ": SynchronousChannel::waitForOperationToFinish begin\n";
-        operation_finished_cv_.wait(lock, [this]()
+        const auto picked_up_at = recordPickUp(message.message_.size(), enqueued_at);
+
+        AMQP::Envelope envelope(message.message_.data(), message.message_.size());
+        PublishTemplate::setProtobufMetaData(message.event_type_name_, envelope, message.is_container_);
+        if (message.message_.contentEncoding() != nullptr)
         {
-            return operation_finished_ || is_in_error_state_;
+            envelope.setContentEncoding(message.message_.contentEncoding());
+        }
+
+        const bool is_published = channel_.publish(message.topic_, message.partition_key_, envelope);
+        recordPublished(picked_up_at);
+        if (!is_published)
+        {
+            onPublishFailed();
+        }
+    }
+
+    void SynchronousChannel::publishOnIoThread(
+        const PublishTemplate& publish_template,
+        const MessageBody& message,
+        MetricsClock::time_point enqueued_at)
+    {
+        const auto picked_up_at = recordPickUp(message.size(), enqueued_at);
+
+        const bool is_published =
+            publish_template.publish(channel_, message.data(), message.size(), message.contentEncoding());
+        recordPublished(picked_up_at);
+        if (!is_published)
+        {
+            onPublishFailed();
+        }
+    }
+
+    MetricsClock::time_point SynchronousChannel::recordPickUp(size_t message_size, MetricsClock::time_point enqueued_at)
+    {
+        const auto picked_up_at = MetricsClock::now();
+        metrics_.enqueue_to_io_.record(picked_up_at - enqueued_at);
+        metrics_.messages_published_.add(1);
+        metrics_.bytes_published_.add(static_cast<int64_t>(message_size));
+        return picked_up_at;
+    }
+
+    void SynchronousChannel::recordPublished(MetricsClock::time_point picked_up_at)
+    {
+        // Same delivery tag as the message in in_flight_messages_, its frames are queued on the connection by now
+        published_messages_.push(PublishedMessage{ picked_up_at, write_timeline_.queuedBytes() });
+    }
+
+    void SynchronousChannel::onPublishFailed()
+    {
+        STREAMER_LOG_WARNING("SynchronousChannel::publish failed");
+        metrics_.messages_lost_.add(1);
+        onError("Message failed to publish!");
+    }
+
+    void SynchronousChannel::flush()
+    {
+        std::unique_lock operation_lock(operation_mutex_);
+        waitForOperationToFinish(operation_lock, [this]()
+        {
+            return in_flight_messages_.empty() && waiting_requests_.empty();
+        });
+    }
+
+    void SynchronousChannel::waitUntilReady(MetricsClock::time_point deadline)
+    {
+        std::unique_lock lock(operation_mutex_);
+        const bool is_done = operation_finished_cv_.wait_until(lock, deadline, [this]()
+        {
+            return is_ready_ || is_in_error_state_;
         });
-        std::cout << std::this_thread::get_id() << ": SynchronousChannel::waitForOperationToFinish finished\n";
+        if (is_in_error_state_)
+        {
+            throw std::runtime_error("SynchronousChannel error: " + error_message_);
+        }
+        if (!is_done)
+        {
+            throw std::runtime_error("SynchronousChannel error: Channel open timed out.");
+        }
+    }
+
+    bool SynchronousChannel::isInErrorState() const
+    {
+        std::unique_lock lock(operation_mutex_);
+        return is_in_error_state_;
+    }
+
+    template <typename Predicate>
+    void SynchronousChannel::waitForOperationToFinish(std::unique_lock<std::recursive_mutex>& lock, Predicate is_finished)
+    {
+        STREAMER_LOG_TRACE("SynchronousChannel::waitForOperationToFinish begin");
+        operation_finished_cv_.wait(lock, [this, &is_finished]()
+        {
+            return is_finished() || is_in_error_state_;
+        });
+        STREAMER_LOG_TRACE("SynchronousChannel::waitForOperationToFinish finished");
         if (is_in_error_state_)
         {
             std::string message("SynchronousChannel error: ");
             message.append(error_message_);
-            std::cout << std::this_thread::get_id() << ": SynchronousChannel::waitForOperationToFinish error: " << message << "\n";
+            STREAMER_LOG_WARNING("SynchronousChannel::waitForOperationToFinish error: ", message);
             throw std::runtime_error(message);
         }
     }
 
-    void SynchronousChannel::onSuccess()
+    void SynchronousChannel::onAck(uint64_t delivery_tag, bool multiple)
     {
+        STREAMER_LOG_TRACE("SynchronousChannel::onAck ", delivery_tag);
+
+        const auto acked_at = MetricsClock::now();
+        const size_t acked_count = published_messages_.settle(delivery_tag, multiple,
+            [this, acked_at](const PublishedMessage& published_message)
+        {
+            metrics_.io_to_ack_.record(acked_at - published_message.picked_up_at_);
+            // Unknown when the write is too old to be kept, or when AMQP-CPP held the frames back until the channel
+            // was open and the write then seems to come before the pickup
+            const auto written_at = write_timeline_.writtenAt(published_message.queued_bytes_);
+            if (written_at && *written_at >= published_message.picked_up_at_)
+            {
+                metrics_.socket_write_to_ack_.record(acked_at - *written_at);
+            }
+        });
+        metrics_.messages_acked_.add(static_cast<int64_t>(acked_count));
+
         std::unique_lock lock(operation_mutex_);
-        operation_finished_ = true;
+        const size_t settled_count = in_flight_messages_.settle(delivery_tag, multiple,
+            [this](InFlightMessage& in_flight_message)
+        {
+            settled_messages_.push_back(std::move(in_flight_message));
+        });
+        if (settled_count == 0)
+        {
+            return;
+        }
+
+        metrics_.in_flight_messages_.add(-static_cast<int64_t>(settled_count));
+        // Asynchronous publishes queued without leader are admitted by the confirms
+        if (!has_group_leader_ && !waiting_requests_.empty() && in_flight_messages_.size() < max_in_flight_messages_)
+        {
+            admitWaitingPublishes();
+        }
         operation_finished_cv_.notify_all();
+        lock.unlock();
+
+        // The completions post their handlers, they can't publish on this channel from here
+        for (auto& settled_message : settled_messages_)
+        {
+            settle(settled_message.completion_, settled_message.body_size_, nullptr);
+        }
+        settled_messages_.clear();
+    }
+
+    void SynchronousChannel::onNack(uint64_t delivery_tag, bool multiple)
+    {
+        STREAMER_LOG_WARNING("SynchronousChannel::onNack ", delivery_tag);
+
+        const size_t nacked_count = published_messages_.settle(delivery_tag, multiple, [](const PublishedMessage&)
+        {
+        });
+        metrics_.messages_lost_.add(static_cast<int64_t>(nacked_count));
+
+        // A lost message leaves the channel in error, like any other channel error, which fails every message in
+        // flight
+        onError("Message failed to publish!");
     }
 
     void SynchronousChannel::onError(const std::string& message)
     {
         std::unique_lock lock(operation_mutex_);
-        operation_finished_ = true;
-        is_in_error_state_ = true;
-        error_message_ = message;
+        if (!is_in_error_state_)
+        {
+            is_in_error_state_ = true;
+            error_message_ = message;
+        }
+
+        std::vector<InFlightMessage> in_flight_messages;
+        in_flight_messages_.settleAll([&in_flight_messages](InFlightMessage& in_flight_message)
+        {
+            in_flight_messages.push_back(std::move(in_flight_message));
+        });
+        metrics_.in_flight_messages_.add(-static_cast<int64_t>(in_flight_messages.size()));
+        for (size_t index = 0; index < waiting_requests_.size(); ++index)
+        {
+            auto& request = waiting_requests_[index];
+            in_flight_messages.push_back(
+                InFlightMessage{ std::move(request.completion_), request.message_.message_.size() });
+        }
+        waiting_requests_.clear();
+        const auto exception = makeErrorException();
         operation_finished_cv_.notify_all();
+        lock.unlock();
+
+        for (auto& in_flight_message : in_flight_messages)
+        {
+            settle(in_flight_message.completion_, in_flight_message.body_size_, exception);
+        }
+    }
+
+    void SynchronousChannel::settle(PublishCompletion& completion, size_t body_size, std::exception_ptr exception)
+    {
+        flow_controller_.release(1, body_size);
+        completion.complete(exception, io_service_.get_executor());
+    }
+
+    std::exception_ptr SynchronousChannel::makeErrorException() const
+    {
+        // error_message_ is written by onError from any thread, the mutex is recursive for the callers holding it
+        std::unique_lock lock(operation_mutex_);
+        std::string message("SynchronousChannel error: ");
+        message.append(error_message_);
+        return std::make_exception_ptr(std::runtime_error(message));
     }
 }  // namespace RabbitMqStreamingPlugin
@@ -1,12 +1,25 @@
 #pragma once
 
+#include "ConfirmTracker.h"
+#include "FlowController.h"
+#include "HandlerAllocator.h"
+#include "OutgoingMessage.h"
+#include "PublishCompletion.h"
+#include "PublishTemplate.h"
+#include "StreamerMetrics.h"
+#include "StreamerOptions.h"
+#include "WriteTimeline.h"
+
 #define NOMINMAX
 #include <amqpcpp.h>
 
+#include <boost/asio/async_result.hpp>
 #include <boost/asio/io_service.hpp>
 
 #include <condition_variable>
+#include <future>
 #include <mutex>
+#include <vector>
 
 namespace RabbitMqStreamingPlugin
 {
@@ -27,12 +40,38 @@ namespace RabbitMqStreamingPlugin
      * Considering that the SynchronousChannel role is to wrap the channel object object, if an error is to happen,
      * a new instance of SynchronousChannel needs to be created to reopen the connection.
      *
+     * Publishing can be pipelined by allowing more than one unconfirmed message on the channel
+     * (SynchronousChannelOptions::max_in_flight_messages_). publishAsync then only blocks until there is room in that
+     * window and returns a future settled when the broker confirms (or loses) the message, while publish keeps
+     * blocking until its own message is confirmed.
+     *
+     * Concurrent publishers are group committed: the caller finding no other caller waiting for the window becomes
+     * the leader, waits for room and hands the messages queued by the other callers meanwhile to the IO thread at
+     * once, as many as fit in the window. The others wait for the next leader, the window is never exceeded. Their
+     * confirms, usually coalesced by the broker with the multiple flag, settle the whole group at once.
+     *
+     * The channel handles the publisher confirms itself instead of using AMQP::Reliable: the messages admitted in the
+     * window are held in a ConfirmTracker, so a publish doesn't allocate once the window is full and a confirm with
+     * the multiple flag settles its whole range at once. Delivery tags are given at admission, in the order the IO
+     * thread publishes the messages.
+     *
+     * Nothing is allocated per message to hand it over: it is copied into a PublishRequest slot reused from one group
+     * to the next, the strings keeping their capacity, and the IO thread is woken by a single post, allocated from a
+     * HandlerMemory, for all the groups admitted until it runs. A blocking publish waits on a PublishWaiter instead of
+     * a promise.
+     *
      */
 
     class SynchronousChannel
     {
     public:
-        SynchronousChannel(boost::asio::io_service& io_service, AMQP::Connection& connection);
+        SynchronousChannel(
+            boost::asio::io_service& io_service,
+            AMQP::Connection& connection,
+            const WriteTimeline& write_timeline,
+            StreamerMetrics& metrics,
+            FlowController& flow_controller,
+            const SynchronousChannelOptions& options = SynchronousChannelOptions());
         ~SynchronousChannel();
 
         void stop();
@@ -40,25 +79,173 @@ namespace RabbitMqStreamingPlugin
         void publish(const std::string& topic,
             const std::string& partition_key,
             const std::string& event_type_name,
-            const std::string& message);
+            MessageBody message);
+
+        // Blocks until there is room in the in-flight window, the returned future is settled once the broker
+        // confirmed the message or holds the error if it has been lost.
+        std::future<void> publishAsync(const std::string& topic,
+            const std::string& partition_key,
+            const std::string& event_type_name,
+            MessageBody message);
+
+        // Same as publish and publishAsync, with the topic, partition key and metadata taken from the template
+        void publish(const PublishTemplateHandle& publish_template, MessageBody message);
+        std::future<void> publishAsync(const PublishTemplateHandle& publish_template, MessageBody message);
+
+        // Asio initiating function, never blocks: the message is queued until there is room in the in-flight window
+        // and the completion handler is called with a null exception_ptr once the broker confirmed it. Accepts any
+        // completion token with the PublishSignature signature, e.g. a callback, use_future or use_awaitable.
+        template <typename CompletionToken>
+        auto asyncPublish(
+            const std::string& topic,
+            const std::string& partition_key,
+            const std::string& event_type_name,
+            MessageBody message,
+            CompletionToken&& token)
+        {
+            return boost::asio::async_initiate<CompletionToken, PublishSignature>(
+                [this](auto handler, OutgoingMessage outgoing)
+                {
+                    submitAsyncPublish(std::move(outgoing), PublishCompletion(std::move(handler)));
+                },
+                token,
+                OutgoingMessage{ topic, partition_key, event_type_name, std::move(message) });
+        }
+
+        // Non-template part of asyncPublish, the completion is settled with the channel error if it is in error
+        void submitAsyncPublish(OutgoingMessage message, PublishCompletion completion);
+
+        // Hands every message to the IO thread at once and blocks until the whole batch is settled.
+        // Failures are reported per message instead of being thrown.
+        BatchPublishReport publishBatch(std::vector<OutgoingMessage> messages);
+
+        // Same hand-off as publishBatch, but only blocks until the batch is admitted in the in-flight window.
+        // The futures are in the order of the messages.
+        std::vector<std::future<void>> publishBatchAsync(std::vector<OutgoingMessage> messages);
+
+        // Blocks until every message published so far has been confirmed.
+        void flush();
+
+        // Blocks until the channel is open and in confirm mode, throws when it fails or on the deadline
+        void waitUntilReady(MetricsClock::time_point deadline);
+
+        // A channel in error state can't publish anymore and needs to be replaced
+        bool isInErrorState() const;
 
     private:
-        void waitForOperationToFinish(std::unique_lock<std::recursive_mutex> lock);
-        void onSuccess();
+        template <typename Predicate>
+        void waitForOperationToFinish(std::unique_lock<std::recursive_mutex>& lock, Predicate is_finished);
+
+        struct PublishRequest
+        {
+            // Only the body is published when there is a template
+            OutgoingMessage message_;
+            PublishTemplateHandle publish_template_;
+            // Moved to in_flight_messages_ on admission
+            PublishCompletion completion_;
+            MetricsClock::time_point enqueued_at_;
+        };
+
+        // The first size() slots hold requests, the others are kept with their string capacity for the next ones
+        class PublishRequestQueue
+        {
+        public:
+            bool empty() const;
+            size_t size() const;
+            PublishRequest& operator[](size_t index);
+
+            // Next free slot, the queue only grows when they are all in use
+            PublishRequest& push();
+            // Moves the first count requests of other after these ones, the others stay in other in their order
+            void append(PublishRequestQueue& other, size_t count);
+            // Releases the last count requests like clear
+            void pop(size_t count);
+            // Releases the bodies, templates and completions, the slots are kept
+            void clear();
+
+        private:
+            std::vector<PublishRequest> slots_;
+            size_t size_ = 0;
+        };
+
+        struct PublishedMessage
+        {
+            MetricsClock::time_point picked_up_at_;
+            // WriteTimeline::queuedBytes once the frames of the message were queued
+            uint64_t queued_bytes_ = 0;
+        };
+
+        struct InFlightMessage
+        {
+            PublishCompletion completion_;
+            size_t body_size_ = 0;
+        };
+
+        // Queues count publishes, fill_request(index, request) sets the message and completion of each one, and
+        // returns once they have been admitted in the in-flight window, by this caller or by the group leader of the
+        // moment. The flow controller may block or reject them first.
+        template <typename FillRequest>
+        void submitPublishes(size_t count, size_t body_bytes, FillRequest fill_request);
+        // Waits for room in the window and admits the queued publishes, until the submission last_submission is
+        void leadGroupCommit(std::unique_lock<std::recursive_mutex>& lock, uint64_t last_submission);
+        // Hands the oldest queued publishes fitting in the window to the IO thread, posting it unless a post is already
+        // pending, operation_mutex_ must be held
+        void admitWaitingPublishes();
+        // Publishes every admitted request, on the IO thread
+        void publishAdmittedRequests();
+        void publishOnIoThread(const OutgoingMessage& message, MetricsClock::time_point enqueued_at);
+        void publishOnIoThread(
+            const PublishTemplate& publish_template,
+            const MessageBody& message,
+            MetricsClock::time_point enqueued_at);
+        // Records the IO pickup of a message, returns its time
+        MetricsClock::time_point recordPickUp(size_t message_size, MetricsClock::time_point enqueued_at);
+        // The message has been handed to the connection, whether or not it failed
+        void recordPublished(MetricsClock::time_point picked_up_at);
+        // The channel refused the message, it failed
+        void onPublishFailed();
+        // Releases the message from the flow control and completes it, operation_mutex_ must not be held
+        void settle(PublishCompletion& completion, size_t body_size, std::exception_ptr exception);
+        // Broker confirms, on the IO thread
+        void onAck(uint64_t delivery_tag, bool multiple);
+        void onNack(uint64_t delivery_tag, bool multiple);
         void onError(const std::string& message);
+        // Exception holding error_message_, read under operation_mutex_
+        std::exception_ptr makeErrorException() const;
 
         boost::asio::io_service& io_service_;
+        const WriteTimeline& write_timeline_;
+        StreamerMetrics& metrics_;
+        FlowController& flow_controller_;
+        const size_t max_in_flight_messages_;
 
-        std::mutex publish_mutex_;
-        std::recursive_mutex operation_mutex_;
+        mutable std::recursive_mutex operation_mutex_;
         std::condition_variable_any operation_finished_cv_;
-        bool operation_finished_;
         bool is_in_error_state_;
         std::string error_message_;
+        // The channel is open and in confirm mode
+        bool is_ready_;
+
+        // Publishes queued by the callers, waiting to be admitted in the in-flight window by the group leader, then
+        // admitted and waiting for the IO thread, which swaps them with its own queue
+        PublishRequestQueue waiting_requests_;
+        uint64_t next_submission_;
+        uint64_t admitted_submissions_;
+        bool has_group_leader_;
+        PublishRequestQueue admitted_requests_;
+        // A post of publishAdmittedRequests is pending
+        bool is_publish_posted_;
+        HandlerMemory::Handle post_memory_;
+
+        // Messages admitted in the window, by delivery tag
+        ConfirmTracker<InFlightMessage> in_flight_messages_;
+        // IO thread only: pickup time and end offset of the published messages by delivery tag, the messages settled by
+        // a confirm and the requests being published
+        ConfirmTracker<PublishedMessage> published_messages_;
+        std::vector<InFlightMessage> settled_messages_;
+        PublishRequestQueue published_requests_;
 
-        // Order is important, as reliable_ is built using channel_
         AMQP::Channel channel_;
-        AMQP::Reliable<> reliable_;
     };
 
 }  // namespace RabbitMqStreamingPlugin
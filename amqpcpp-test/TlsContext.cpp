@@ -0,0 +1,199 @@
+#include "TlsContext.h"
+
+#include "Logging.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace RabbitMqStreamingPlugin
+{
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+    namespace TlsContextPrivate
+    {
+        // Indexes of the TlsContext in the SSL_CTX and of the session key in each SSL
+        int contextIndex()
+        {
+            static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+            return index;
+        }
+
+        int sessionKeyIndex()
+        {
+            static const int index = SSL_get_ex_new_index(
+                0, nullptr, nullptr, nullptr,
+                [](void*, void* key, CRYPTO_EX_DATA*, int, long, void*)
+                {
+                    delete static_cast<std::string*>(key);
+                });
+            return index;
+        }
+    }
+
+    TlsContext::TlsContext(const TlsOptions& options, StreamerMetrics& metrics)
+        : options_(options)
+        , metrics_(metrics)
+        , context_(boost::asio::ssl::context::tls_client)
+    {
+        context_.set_options(boost::asio::ssl::context::default_workarounds
+            | boost::asio::ssl::context::no_sslv2
+            | boost::asio::ssl::context::no_sslv3
+            | boost::asio::ssl::context::no_tlsv1
+            | boost::asio::ssl::context::no_tlsv1_1);
+
+        if (options_.verify_peer_)
+        {
+            if (options_.ca_file_.empty())
+            {
+                context_.set_default_verify_paths();
+            }
+            else
+            {
+                context_.load_verify_file(options_.ca_file_);
+            }
+            context_.set_verify_mode(boost::asio::ssl::verify_peer);
+        }
+        else
+        {
+            context_.set_verify_mode(boost::asio::ssl::verify_none);
+        }
+
+        SSL_CTX* native_context = context_.native_handle();
+        SSL_CTX_set_ex_data(native_context, TlsContextPrivate::contextIndex(), this);
+
+        // Larger writes are split in records of that size by OpenSSL
+        const size_t record_size = maxRecordSize();
+        SSL_CTX_set_max_send_fragment(native_context, static_cast<long>(record_size));
+        SSL_CTX_set_split_send_fragment(native_context, static_cast<long>(record_size));
+        SSL_CTX_set_msg_callback(native_context, &TlsContext::onMessage);
+
+        if (options_.resume_sessions_)
+        {
+            // The sessions are kept per broker by onNewSession instead of the OpenSSL cache, which is server side
+            // only for clients. It is also called for the TLS 1.3 tickets received after the handshake.
+            SSL_CTX_set_session_cache_mode(native_context, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(native_context, &TlsContext::onNewSession);
+        }
+        else
+        {
+            SSL_CTX_set_session_cache_mode(native_context, SSL_SESS_CACHE_OFF);
+            SSL_CTX_set_options(native_context, SSL_OP_NO_TICKET);
+        }
+    }
+
+    TlsContext::~TlsContext()
+    {
+        for (auto& session : sessions_)
+        {
+            SSL_SESSION_free(session.second);
+        }
+    }
+
+    std::unique_ptr<TlsContext::Stream> TlsContext::createStream(
+        boost::asio::ip::tcp::socket& socket, const std::string& host)
+    {
+        auto stream = std::make_unique<Stream>(socket, context_);
+        SSL* ssl = stream->native_handle();
+
+        const std::string& server_name = options_.server_name_.empty() ? host : options_.server_name_;
+        // SNI only carries host names
+        boost::system::error_code not_an_address;
+        boost::asio::ip::make_address(server_name, not_an_address);
+        if (not_an_address)
+        {
+            SSL_set_tlsext_host_name(ssl, server_name.c_str());
+        }
+        if (options_.verify_peer_)
+        {
+            stream->set_verify_callback(boost::asio::ssl::host_name_verification(server_name));
+        }
+
+        if (options_.resume_sessions_)
+        {
+            SSL_set_ex_data(ssl, TlsContextPrivate::sessionKeyIndex(), new std::string(server_name));
+
+            std::lock_guard<std::mutex> lock(sessions_mutex_);
+            const auto session = sessions_.find(server_name);
+            if (session != sessions_.end())
+            {
+                SSL_set_session(ssl, session->second);
+            }
+        }
+
+        return stream;
+    }
+
+    void TlsContext::onHandshake(Stream& stream, MetricsClock::time_point started_at)
+    {
+        metrics_.tls_handshake_.recordSince(started_at);
+        metrics_.tls_handshakes_.add(1);
+        if (SSL_session_reused(stream.native_handle()))
+        {
+            metrics_.tls_resumed_handshakes_.add(1);
+        }
+        STREAMER_LOG_DEBUG("TlsContext::onHandshake: ", SSL_get_version(stream.native_handle()),
+            SSL_session_reused(stream.native_handle()) ? " resumed" : " full handshake");
+    }
+
+    int TlsContext::onNewSession(SSL* ssl, SSL_SESSION* session)
+    {
+        auto* context = static_cast<TlsContext*>(
+            SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), TlsContextPrivate::contextIndex()));
+        const auto* key = static_cast<const std::string*>(SSL_get_ex_data(ssl, TlsContextPrivate::sessionKeyIndex()));
+        if (context == nullptr || key == nullptr)
+        {
+            return 0;
+        }
+
+        // OpenSSL marks the session of a connection closed without close_notify as not resumable, which is how a lost
+        // connection ends, so a copy is kept. The previous session of the broker is replaced.
+        SSL_SESSION* copy = SSL_SESSION_dup(session);
+        if (copy == nullptr)
+        {
+            return 0;
+        }
+
+        std::lock_guard<std::mutex> lock(context->sessions_mutex_);
+        SSL_SESSION*& stored_session = context->sessions_[*key];
+        if (stored_session != nullptr)
+        {
+            SSL_SESSION_free(stored_session);
+        }
+        stored_session = copy;
+        return 0;
+    }
+
+    void TlsContext::onMessage(
+        int write_p, int version, int content_type, const void* buffer, size_t length, SSL* ssl, void* arg)
+    {
+        // Called with the 5 bytes header of every record written, the handshake records aren't counted
+        if (write_p == 1 && content_type == SSL3_RT_HEADER && length > 0
+            && static_cast<const unsigned char*>(buffer)[0] == SSL3_RT_APPLICATION_DATA)
+        {
+            auto* context = static_cast<TlsContext*>(
+                SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), TlsContextPrivate::contextIndex()));
+            if (context != nullptr)
+            {
+                context->metrics_.tls_records_written_.add(1);
+            }
+        }
+    }
+
+#else
+    TlsContext::TlsContext(const TlsOptions&, StreamerMetrics&)
+    {
+        throw std::runtime_error("TlsContext error: Built without TLS.");
+    }
+
+    TlsContext::~TlsContext() = default;
+#endif
+
+    size_t TlsContext::maxRecordSize() const
+    {
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+        return std::min<size_t>(std::max<size_t>(options_.max_record_size_, 512), 16384);
+#else
+        return 0;
+#endif
+    }
+
+}  // namespace RabbitMqStreamingPlugin
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "StreamerMetrics.h"
+#include "StreamerOptions.h"
+
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl.hpp>
+#endif
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace RabbitMqStreamingPlugin
+{
+    /*
+     * TlsContext holds the OpenSSL context shared by every connection of a streamer, and the last session
+     * established with each broker. A new connection offers that session (ticket or session id) in its ClientHello,
+     * so a reconnection skips the full handshake when the broker still knows it.
+     *
+     * It counts the TLS records written through the OpenSSL message callback, and the handshakes with how many of
+     * them were resumed. The streamer must be built with OpenSSL (AMQPCPP_STREAMER_WITH_TLS) to enable TLS.
+     */
+    class TlsContext
+    {
+    public:
+        TlsContext(const TlsOptions& options, StreamerMetrics& metrics);
+        ~TlsContext();
+
+        TlsContext(const TlsContext&) = delete;
+        TlsContext& operator=(const TlsContext&) = delete;
+
+        size_t maxRecordSize() const;
+
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+        using Stream = boost::asio::ssl::stream<boost::asio::ip::tcp::socket&>;
+
+        // Stream over the connected socket, with the SNI, verification and resumed session of the broker
+        std::unique_ptr<Stream> createStream(boost::asio::ip::tcp::socket& socket, const std::string& host);
+        // Records the handshake time and whether the session was resumed
+        void onHandshake(Stream& stream, MetricsClock::time_point started_at);
+
+    private:
+        static int onNewSession(SSL* ssl, SSL_SESSION* session);
+        static void onMessage(
+            int write_p, int version, int content_type, const void* buffer, size_t length, SSL* ssl, void* arg);
+
+        const TlsOptions options_;
+        StreamerMetrics& metrics_;
+        boost::asio::ssl::context context_;
+
+        // Last session per broker name, holding a reference on each
+        std::mutex sessions_mutex_;
+        std::unordered_map<std::string, SSL_SESSION*> sessions_;
+#endif
+    };
+
+}  // namespace RabbitMqStreamingPlugin
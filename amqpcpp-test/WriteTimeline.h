@@ -0,0 +1,108 @@
+#pragma once
+
+#include "StreamerMetrics.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace RabbitMqStreamingPlugin
+{
+    /*
+     * WriteTimeline maps the bytes queued on a connection to the completion time of the socket write that sent them.
+     * AsioHandler counts every byte it queues and records each completed write, a channel notes the byte count once
+     * its message is queued and looks the write of that byte up when the broker confirms the message.
+     *
+     * The last writes are kept in a ring allocated once, the writes older than its capacity are forgotten.
+     *
+     * Not thread safe, used from the IO thread only.
+     */
+    class WriteTimeline
+    {
+    public:
+        explicit WriteTimeline(size_t capacity)
+            : writes_(capacity > 0 ? capacity : 1)
+            , first_(0)
+            , count_(0)
+            , queued_bytes_(0)
+            , written_bytes_(0)
+            , forgotten_bytes_(0)
+        {
+        }
+
+        void onQueued(size_t bytes)
+        {
+            queued_bytes_ += bytes;
+        }
+
+        void onWritten(size_t bytes, MetricsClock::time_point written_at)
+        {
+            written_bytes_ += bytes;
+            if (count_ == writes_.size())
+            {
+                forgotten_bytes_ = writes_[first_].end_;
+                first_ = (first_ + 1) % writes_.size();
+                --count_;
+            }
+            writes_[(first_ + count_) % writes_.size()] = Write{ written_bytes_, written_at };
+            ++count_;
+        }
+
+        // Bytes queued since the connection was created, the end offset of the last frame queued
+        uint64_t queuedBytes() const
+        {
+            return queued_bytes_;
+        }
+
+        // Completion time of the write that sent the byte before end_offset, nothing when that byte isn't written yet
+        // or its write has been forgotten
+        std::optional<MetricsClock::time_point> writtenAt(uint64_t end_offset) const
+        {
+            if (end_offset <= forgotten_bytes_ || end_offset > written_bytes_)
+            {
+                return std::nullopt;
+            }
+
+            // The end offsets grow along the ring, find the first write ending at or after end_offset
+            size_t low = 0;
+            size_t high = count_ - 1;
+            while (low < high)
+            {
+                const size_t middle = low + (high - low) / 2;
+                if (at(middle).end_ < end_offset)
+                {
+                    low = middle + 1;
+                }
+                else
+                {
+                    high = middle;
+                }
+            }
+            return at(low).written_at_;
+        }
+
+    private:
+        struct Write
+        {
+            // Bytes written once this write completed
+            uint64_t end_ = 0;
+            MetricsClock::time_point written_at_;
+        };
+
+        // Write index from the oldest one kept
+        const Write& at(size_t index) const
+        {
+            return writes_[(first_ + index) % writes_.size()];
+        }
+
+        std::vector<Write> writes_;
+        size_t first_;
+        size_t count_;
+        uint64_t queued_bytes_;
+        uint64_t written_bytes_;
+        // End offset of the last write dropped from the ring
+        uint64_t forgotten_bytes_;
+    };
+
+}  // namespace RabbitMqStreamingPlugin
@@ -15,7 +15,7 @@ RabbitMqStreamingPlugin::RabbitMqServerConfig getServerConfig()
     return config;
 }
 
-int main()
+int main(int argc, char* argv[])
 {
     const auto server_config = getServerConfig();
     const std::string topic = "topic";
@@ -28,7 +28,19 @@ int main()
         exception = new_exception;
     };
 
-    RabbitMqStreamingPlugin::AmqpCppStreamer streamer(server_config, error_callback);
+    RabbitMqStreamingPlugin::StreamerOptions options;
+    // The broker certificate is verified against the CA file given as first argument, or the default CAs of the
+    // system, and its name against the broker address
+    if (argc > 1)
+    {
+        options.tls_.ca_file_ = argv[1];
+    }
+#if defined(AMQPCPP_STREAMER_WITH_TLS)
+    // 5671 is the amqps port
+    options.tls_.is_enabled_ = true;
+#endif
+
+    RabbitMqStreamingPlugin::AmqpCppStreamer streamer(server_config, error_callback, options);
 
     try
     {
@@ -0,0 +1,367 @@
+#include "AmqpCppStreamer.h"
+#include "FakeBroker.h"
+#include "HandlerAllocator.h"
+
+#include "StreamerTest.h"
+#include "UnitTest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+
+using namespace RabbitMqStreamingPlugin;
+
+namespace
+{
+    // Every heap allocation of the program is counted, on the thread publishing apart from the others (IO threads),
+    // except on the threads that opted out (the fake broker)
+    std::atomic<uint64_t> producer_allocation_count__(0);
+    std::atomic<uint64_t> allocation_count__(0);
+    thread_local std::atomic<uint64_t>* allocation_counter__ = &allocation_count__;
+    // Allocations of at least this size fail on the thread, to inject an exception in the middle of a publish
+    thread_local std::size_t failing_allocation_size__ = std::numeric_limits<std::size_t>::max();
+
+    void* countedAllocation(std::size_t size)
+    {
+        if (size >= failing_allocation_size__)
+        {
+            throw std::bad_alloc();
+        }
+        if (allocation_counter__ != nullptr)
+        {
+            allocation_counter__->fetch_add(1, std::memory_order_relaxed);
+        }
+        if (void* memory = std::malloc(size > 0 ? size : 1))
+        {
+            return memory;
+        }
+        throw std::bad_alloc();
+    }
+
+    void* countedAlignedAllocation(std::size_t size, std::align_val_t alignment)
+    {
+        if (allocation_counter__ != nullptr)
+        {
+            allocation_counter__->fetch_add(1, std::memory_order_relaxed);
+        }
+        const auto align = static_cast<std::size_t>(alignment);
+#if defined(_WIN32)
+        void* memory = _aligned_malloc(size > 0 ? size : 1, align);
+#else
+        // aligned_alloc takes a multiple of the alignment
+        void* memory = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align);
+#endif
+        if (memory != nullptr)
+        {
+            return memory;
+        }
+        throw std::bad_alloc();
+    }
+
+    void alignedFree(void* memory)
+    {
+#if defined(_WIN32)
+        _aligned_free(memory);
+#else
+        std::free(memory);
+#endif
+    }
+}
+
+void* operator new(std::size_t size)
+{
+    return countedAllocation(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return countedAllocation(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return countedAllocation(size);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return countedAllocation(size);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    return countedAlignedAllocation(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return countedAlignedAllocation(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return countedAlignedAllocation(size, alignment);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+    alignedFree(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept
+{
+    alignedFree(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept
+{
+    alignedFree(memory);
+}
+
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept
+{
+    alignedFree(memory);
+}
+
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    alignedFree(memory);
+}
+
+namespace
+{
+    constexpr uint64_t warm_up_messages__ = 2000;
+    constexpr uint64_t measured_messages__ = 2000;
+
+    // Allocations made on the thread publishing and on the others while it lives
+    class AllocationCount
+    {
+    public:
+        AllocationCount()
+            : producer_allocations_before_(producer_allocation_count__.load())
+            , allocations_before_(allocation_count__.load())
+        {
+            allocation_counter__ = &producer_allocation_count__;
+        }
+
+        ~AllocationCount()
+        {
+            allocation_counter__ = &allocation_count__;
+        }
+
+        uint64_t producerAllocations() const
+        {
+            return producer_allocation_count__.load() - producer_allocations_before_;
+        }
+
+        uint64_t otherAllocations() const
+        {
+            return allocation_count__.load() - allocations_before_;
+        }
+
+    private:
+        const uint64_t producer_allocations_before_;
+        const uint64_t allocations_before_;
+    };
+
+    // A streamer connected to a fake broker, whose thread isn't counted
+    class ConnectedStreamer
+    {
+    public:
+        ConnectedStreamer()
+            : broker_(brokerOptions())
+            , streamer_(UnitTest::serverConfig(broker_), UnitTest::ignoreError)
+        {
+            UNIT_CHECK(streamer_.connect());
+        }
+
+        AmqpCppStreamer& streamer()
+        {
+            return streamer_;
+        }
+
+    private:
+        static Bench::FakeBrokerOptions brokerOptions()
+        {
+            Bench::FakeBrokerOptions options;
+            options.on_thread_start_ = []()
+            {
+                allocation_counter__ = nullptr;
+            };
+            return options;
+        }
+
+        Bench::FakeBroker broker_;
+        AmqpCppStreamer streamer_;
+    };
+
+    // Polls without std::function, which could allocate while counting
+    template <typename Condition>
+    bool waitUntil(Condition condition)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!condition())
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+}
+
+UNIT_TEST(publishesATemplateWithoutAllocatingPerMessage)
+{
+    ConnectedStreamer connected;
+    auto& streamer = connected.streamer();
+    const auto publish_template = streamer.createPublishTemplate("topic", "key", "Event");
+    const auto body = std::make_shared<const std::string>(500, 'a');
+
+    // The slots, buffers and histograms reach their steady size
+    for (uint64_t index = 0; index < warm_up_messages__; ++index)
+    {
+        streamer.publish(publish_template, MessageBody(body));
+    }
+
+    AllocationCount allocations;
+    for (uint64_t index = 0; index < measured_messages__; ++index)
+    {
+        streamer.publish(publish_template, MessageBody(body));
+    }
+    UNIT_CHECK(allocations.producerAllocations() == 0);
+    UNIT_CHECK(allocations.otherAllocations() == 0);
+}
+
+UNIT_TEST(completesTheHandlersBoundToAHandlerMemoryWithoutAllocatingPerMessage)
+{
+    ConnectedStreamer connected;
+    auto& streamer = connected.streamer();
+    const auto body = std::make_shared<const std::string>(500, 'a');
+    const auto handler_memory = HandlerMemory::create(256, 4096);
+
+    std::atomic<uint64_t> confirmed_messages = 0;
+    const auto publish = [&streamer, &body, &handler_memory, &confirmed_messages]()
+    {
+        // Names within the small string buffer, the message is copied by the initiating function
+        streamer.asyncPublish("topic", "key", "Event", MessageBody(body),
+            bindHandlerMemory(*handler_memory, [&confirmed_messages](std::exception_ptr exception)
+        {
+            if (exception == nullptr)
+            {
+                ++confirmed_messages;
+            }
+        }));
+    };
+
+    for (uint64_t index = 0; index < warm_up_messages__; ++index)
+    {
+        publish();
+    }
+    UNIT_CHECK(waitUntil([&confirmed_messages]()
+    {
+        return confirmed_messages == warm_up_messages__;
+    }));
+    const uint64_t heap_allocations = handler_memory->heapAllocations();
+
+    {
+        AllocationCount allocations;
+        for (uint64_t index = 0; index < measured_messages__; ++index)
+        {
+            publish();
+        }
+        UNIT_CHECK(waitUntil([&confirmed_messages]()
+        {
+            return confirmed_messages == warm_up_messages__ + measured_messages__;
+        }));
+        UNIT_CHECK(allocations.producerAllocations() == 0);
+        UNIT_CHECK(allocations.otherAllocations() == 0);
+    }
+    // The completions reused the blocks given back by the previous ones
+    UNIT_CHECK(handler_memory->heapAllocations() == heap_allocations);
+}
+
+UNIT_TEST(dropsAPublishFailingToBeQueued)
+{
+    ConnectedStreamer connected;
+    auto& streamer = connected.streamer();
+    const auto body = std::make_shared<const std::string>(500, 'a');
+    streamer.publish("topic", "key", "Event", MessageBody(body));
+
+    // Copying the topic into the request slot fails, nothing else allocates as much on the way
+    const std::string long_topic(200, 't');
+    failing_allocation_size__ = long_topic.size();
+    bool has_thrown = false;
+    try
+    {
+        streamer.publish(long_topic, "key", "Event", MessageBody(body));
+    }
+    catch (const std::bad_alloc&)
+    {
+        has_thrown = true;
+    }
+    failing_allocation_size__ = std::numeric_limits<std::size_t>::max();
+    UNIT_CHECK(has_thrown);
+
+    // Neither the flow control credit nor the slot is left behind, the channel keeps publishing
+    UNIT_CHECK(streamer.metrics().pending_messages_ == 0);
+    streamer.publish("topic", "key", "Event", MessageBody(body));
+    UNIT_CHECK(streamer.metrics().pending_messages_ == 0);
+}
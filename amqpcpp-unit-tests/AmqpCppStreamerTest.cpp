@@ -0,0 +1,173 @@
+#include "AmqpCppStreamer.h"
+#include "FakeBroker.h"
+
+#include "StreamerTest.h"
+#include "UnitTest.h"
+
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/io_context.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace RabbitMqStreamingPlugin;
+using UnitTest::ignoreError;
+using UnitTest::serverConfig;
+
+namespace
+{
+    // The broker holds the confirms back long enough for the publishes to still be in flight
+    Bench::FakeBrokerOptions slowConfirms()
+    {
+        Bench::FakeBrokerOptions options;
+        options.confirm_latency_ = std::chrono::seconds(30);
+        return options;
+    }
+
+    // Counts the calls of every handler, and those completed with an error
+    struct HandlerCalls
+    {
+        explicit HandlerCalls(size_t count)
+            : calls_(count)
+        {
+        }
+
+        bool calledOnce() const
+        {
+            for (const auto& calls : calls_)
+            {
+                if (calls != 1)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::vector<std::atomic<int>> calls_;
+        std::atomic<size_t> failures_ = 0;
+    };
+}
+
+UNIT_TEST(completesEveryAsyncPublishOnceWhenDestroyed)
+{
+    constexpr size_t message_count = 200;
+
+    Bench::FakeBroker broker(slowConfirms());
+    HandlerCalls calls(message_count);
+    {
+        AmqpCppStreamer streamer(serverConfig(broker), ignoreError);
+        UNIT_CHECK(streamer.connect());
+
+        for (size_t index = 0; index < message_count; ++index)
+        {
+            // Without executor of their own, the handlers run on the IO thread
+            streamer.asyncPublish("topic", "key", "Event", std::string("message"),
+                [&calls, index](std::exception_ptr exception)
+            {
+                ++calls.calls_[index];
+                if (exception != nullptr)
+                {
+                    ++calls.failures_;
+                }
+            });
+        }
+        UNIT_CHECK(UnitTest::waitFor([&broker]()
+        {
+            return broker.receivedMessages() == message_count;
+        }, std::chrono::seconds(10)));
+    }
+    UNIT_CHECK(calls.calledOnce());
+    UNIT_CHECK(calls.failures_ == message_count);
+}
+
+UNIT_TEST(completesTheAsyncPublishesOnTheirExecutorWhenDestroyed)
+{
+    constexpr size_t message_count = 50;
+
+    Bench::FakeBroker broker(slowConfirms());
+    boost::asio::io_context io_context;
+    HandlerCalls calls(message_count);
+    {
+        AmqpCppStreamer streamer(serverConfig(broker), ignoreError);
+        UNIT_CHECK(streamer.connect());
+
+        for (size_t index = 0; index < message_count; ++index)
+        {
+            streamer.asyncPublish("topic", "key", "Event", std::string("message"),
+                boost::asio::bind_executor(io_context, [&calls, index](std::exception_ptr exception)
+            {
+                ++calls.calls_[index];
+                if (exception != nullptr)
+                {
+                    ++calls.failures_;
+                }
+            }));
+        }
+    }
+    // The handlers keep the io_context busy until they have run
+    io_context.run();
+    UNIT_CHECK(calls.calledOnce());
+    UNIT_CHECK(calls.failures_ == message_count);
+}
+
+UNIT_TEST(keepsPublishingWhileTheSpoolThreadReconnects)
+{
+    constexpr uint64_t spooled_count = 100;
+    const std::string spool_path = "AmqpCppStreamerTest.spool";
+    std::remove(spool_path.c_str());
+
+    Bench::FakeBroker broker(Bench::FakeBrokerOptions{});
+    StreamerOptions options;
+    options.connection_count_ = 2;
+    options.spool_.path_ = spool_path;
+    options.spool_.capacity_ = 1024 * 1024;
+    options.spool_.reconnect_delay_ = std::chrono::milliseconds(10);
+    {
+        AmqpCppStreamer streamer(serverConfig(broker), ignoreError, options);
+        UNIT_CHECK(streamer.connect());
+
+        // The publishes racing with the reconnections fail, the connections they use stay alive meanwhile
+        std::atomic<bool> is_publishing = true;
+        std::thread publisher([&streamer, &is_publishing]()
+        {
+            while (is_publishing)
+            {
+                try
+                {
+                    streamer.publish("topic", "key", "Event", std::string("message"));
+                }
+                catch (const std::exception&)
+                {
+                }
+            }
+        });
+
+        for (int drop = 0; drop < 5; ++drop)
+        {
+            const int64_t reconnects = streamer.metrics().reconnects_;
+            broker.dropConnections();
+            UNIT_CHECK(UnitTest::waitFor([&streamer, reconnects]()
+            {
+                return streamer.metrics().reconnects_ > reconnects;
+            }, std::chrono::seconds(10)));
+        }
+
+        for (uint64_t index = 0; index < spooled_count; ++index)
+        {
+            streamer.publishSpooled("topic", "key", "Event", std::string("spooled"));
+        }
+        UNIT_CHECK(UnitTest::waitFor([&streamer]()
+        {
+            return streamer.metrics().spooled_messages_ == 0;
+        }, std::chrono::seconds(10)));
+
+        is_publishing = false;
+        publisher.join();
+    }
+    std::remove(spool_path.c_str());
+}
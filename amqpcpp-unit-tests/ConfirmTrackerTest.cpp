@@ -0,0 +1,136 @@
+#include "ConfirmTracker.h"
+
+#include "UnitTest.h"
+
+#include <cstdint>
+#include <vector>
+
+using namespace RabbitMqStreamingPlugin;
+
+namespace
+{
+    // Settles the tag and returns the settled messages, in the order they were handed over
+    std::vector<uint64_t> settle(ConfirmTracker<uint64_t>& tracker, uint64_t tag, bool multiple)
+    {
+        std::vector<uint64_t> settled;
+        const size_t count = tracker.settle(tag, multiple, [&settled](uint64_t& message)
+        {
+            settled.push_back(message);
+        });
+        UNIT_CHECK(count == settled.size());
+        return settled;
+    }
+
+    // Pushes the messages first to last, each message being its expected tag
+    void pushRange(ConfirmTracker<uint64_t>& tracker, uint64_t first, uint64_t last)
+    {
+        for (uint64_t message = first; message <= last; ++message)
+        {
+            UNIT_CHECK(tracker.push(message) == message);
+        }
+    }
+}
+
+UNIT_TEST(numbersTheMessagesFromOne)
+{
+    ConfirmTracker<uint64_t> tracker(4);
+    UNIT_CHECK(tracker.empty() && tracker.nextTag() == 1);
+    pushRange(tracker, 1, 3);
+    UNIT_CHECK(tracker.size() == 3 && tracker.nextTag() == 4);
+}
+
+UNIT_TEST(settlesContiguousRangesWithTheMultipleFlag)
+{
+    ConfirmTracker<uint64_t> tracker(16);
+    pushRange(tracker, 1, 10);
+
+    UNIT_CHECK((settle(tracker, 4, true) == std::vector<uint64_t>{ 1, 2, 3, 4 }));
+    UNIT_CHECK((settle(tracker, 7, true) == std::vector<uint64_t>{ 5, 6, 7 }));
+    UNIT_CHECK(tracker.size() == 3);
+    // Already settled
+    UNIT_CHECK(settle(tracker, 7, true).empty());
+    UNIT_CHECK((settle(tracker, 10, true) == std::vector<uint64_t>{ 8, 9, 10 }));
+    UNIT_CHECK(tracker.empty());
+}
+
+UNIT_TEST(skipsTheHolesLeftBySingleConfirms)
+{
+    ConfirmTracker<uint64_t> tracker(16);
+    pushRange(tracker, 1, 6);
+
+    UNIT_CHECK((settle(tracker, 3, false) == std::vector<uint64_t>{ 3 }));
+    UNIT_CHECK((settle(tracker, 5, false) == std::vector<uint64_t>{ 5 }));
+    UNIT_CHECK(settle(tracker, 3, false).empty());
+    UNIT_CHECK(tracker.size() == 4);
+
+    // A multiple confirm covers the holes without settling them twice
+    UNIT_CHECK((settle(tracker, 5, true) == std::vector<uint64_t>{ 1, 2, 4 }));
+    UNIT_CHECK((settle(tracker, 6, false) == std::vector<uint64_t>{ 6 }));
+    UNIT_CHECK(tracker.empty());
+}
+
+UNIT_TEST(ignoresTheTagsThatAreNotWaiting)
+{
+    ConfirmTracker<uint64_t> tracker(4);
+    UNIT_CHECK(settle(tracker, 1, true).empty());
+    pushRange(tracker, 1, 2);
+    UNIT_CHECK(settle(tracker, 0, false).empty());
+    UNIT_CHECK(settle(tracker, 3, true).empty());
+    UNIT_CHECK(tracker.size() == 2);
+}
+
+UNIT_TEST(settlesEveryWaitingMessageWhenTheChannelFails)
+{
+    // A nack or a channel error settles the messages the same way, the caller completes them with an error
+    ConfirmTracker<uint64_t> tracker(8);
+    pushRange(tracker, 1, 5);
+    UNIT_CHECK((settle(tracker, 2, false) == std::vector<uint64_t>{ 2 }));
+
+    std::vector<uint64_t> failed;
+    UNIT_CHECK(tracker.settleAll([&failed](uint64_t& message)
+    {
+        failed.push_back(message);
+    }) == 4);
+    UNIT_CHECK((failed == std::vector<uint64_t>{ 1, 3, 4, 5 }));
+    UNIT_CHECK(tracker.empty());
+    UNIT_CHECK(tracker.settleAll([](uint64_t&)
+    {
+    }) == 0);
+
+    // The numbering goes on after the failed messages
+    UNIT_CHECK(tracker.push(6) == 6);
+}
+
+UNIT_TEST(growsPastItsCapacityKeepingTheWaitingMessages)
+{
+    ConfirmTracker<uint64_t> tracker(4);
+    pushRange(tracker, 1, 3);
+    UNIT_CHECK((settle(tracker, 2, false) == std::vector<uint64_t>{ 2 }));
+
+    // The oldest message no longer sits at the start of the ring when it grows
+    pushRange(tracker, 4, 40);
+    UNIT_CHECK(tracker.size() == 39);
+
+    std::vector<uint64_t> expected{ 1 };
+    for (uint64_t message = 3; message <= 40; ++message)
+    {
+        expected.push_back(message);
+    }
+    UNIT_CHECK(settle(tracker, 40, true) == expected);
+}
+
+UNIT_TEST(reusesTheSlotsAsTheTagsWrapAroundTheRing)
+{
+    ConfirmTracker<uint64_t> tracker(4);
+
+    // A window of three messages slides over many times the capacity without growing the ring
+    pushRange(tracker, 1, 3);
+    for (uint64_t tag = 4; tag <= 1000; ++tag)
+    {
+        UNIT_CHECK(tracker.push(tag) == tag);
+        UNIT_CHECK((settle(tracker, tag - 3, tag % 2 == 0) == std::vector<uint64_t>{ tag - 3 }));
+    }
+    UNIT_CHECK(tracker.size() == 3);
+    UNIT_CHECK((settle(tracker, 999, false) == std::vector<uint64_t>{ 999 }));
+    UNIT_CHECK((settle(tracker, 1000, true) == std::vector<uint64_t>{ 998, 1000 }));
+}
@@ -0,0 +1,139 @@
+#include "AmqpCppStreamer.h"
+#include "FakeBroker.h"
+
+#include "StreamerTest.h"
+#include "UnitTest.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace RabbitMqStreamingPlugin;
+using UnitTest::ignoreError;
+using UnitTest::serverConfig;
+
+namespace
+{
+    Bench::FakeBrokerOptions brokerDelivering(uint64_t deliveries_per_consumer)
+    {
+        Bench::FakeBrokerOptions options;
+        options.deliveries_per_consumer_ = deliveries_per_consumer;
+        return options;
+    }
+
+    StreamerOptions consumerOptions(size_t worker_threads)
+    {
+        StreamerOptions options;
+        options.consumer_.prefetch_count_ = 64;
+        options.consumer_.ack_batch_size_ = 16;
+        options.consumer_.ack_interval_ = std::chrono::milliseconds(1);
+        options.consumer_.worker_threads_ = worker_threads;
+        return options;
+    }
+
+    // Consumes every delivery of the broker, returns the bodies in the order the callback received them
+    std::vector<std::string> consumeAll(uint64_t delivery_count, size_t worker_threads)
+    {
+        Bench::FakeBroker broker(brokerDelivering(delivery_count));
+        AmqpCppStreamer streamer(serverConfig(broker), ignoreError, consumerOptions(worker_threads));
+        UNIT_CHECK(streamer.connect());
+
+        std::mutex mutex;
+        std::vector<std::string> bodies;
+        streamer.consume("queue", [&mutex, &bodies](const Delivery& delivery)
+        {
+            std::unique_lock lock(mutex);
+            bodies.emplace_back(delivery.body_);
+        });
+
+        // The prefetch holds the broker back until the deliveries are acked
+        UNIT_CHECK(UnitTest::waitFor([&broker, delivery_count]()
+        {
+            return broker.ackedDeliveries() == delivery_count;
+        }, std::chrono::seconds(10)));
+        UNIT_CHECK(broker.rejectedDeliveries() == 0);
+
+        std::unique_lock lock(mutex);
+        return bodies;
+    }
+
+    std::vector<std::string> expectedBodies(uint64_t delivery_count)
+    {
+        std::vector<std::string> bodies;
+        for (uint64_t index = 0; index < delivery_count; ++index)
+        {
+            bodies.push_back("message " + std::to_string(index));
+        }
+        return bodies;
+    }
+}
+
+UNIT_TEST(handsTheDeliveriesInOrderOnTheIoThreadAndAcksThemAll)
+{
+    UNIT_CHECK(consumeAll(1000, 0) == expectedBodies(1000));
+}
+
+UNIT_TEST(handsTheDeliveriesInOrderOnTheWorkerThreadsAndAcksThemAll)
+{
+    UNIT_CHECK(consumeAll(1000, 2) == expectedBodies(1000));
+}
+
+UNIT_TEST(rejectsTheDeliveriesWhoseCallbackThrows)
+{
+    Bench::FakeBroker broker(brokerDelivering(100));
+    AmqpCppStreamer streamer(serverConfig(broker), ignoreError, consumerOptions(0));
+    UNIT_CHECK(streamer.connect());
+
+    std::atomic<size_t> handled_deliveries = 0;
+    streamer.consume("queue", [&handled_deliveries](const Delivery& delivery)
+    {
+        ++handled_deliveries;
+        if (delivery.body_ == "message 42")
+        {
+            throw std::runtime_error("Unexpected message");
+        }
+    });
+
+    UNIT_CHECK(UnitTest::waitFor([&broker]()
+    {
+        return broker.ackedDeliveries() + broker.rejectedDeliveries() == 100;
+    }, std::chrono::seconds(10)));
+    UNIT_CHECK(broker.rejectedDeliveries() == 1);
+    UNIT_CHECK(handled_deliveries == 100);
+}
+
+UNIT_TEST(refusesToConsumeBeforeConnecting)
+{
+    Bench::FakeBroker broker(brokerDelivering(1));
+    AmqpCppStreamer streamer(serverConfig(broker), ignoreError, consumerOptions(0));
+    UNIT_CHECK_THROWS(streamer.consume("queue", [](const Delivery&)
+    {
+    }));
+}
+
+UNIT_TEST(reopensTheConsumersAfterAReconnection)
+{
+    Bench::FakeBroker broker(brokerDelivering(100));
+    AmqpCppStreamer streamer(serverConfig(broker), ignoreError, consumerOptions(0));
+    UNIT_CHECK(streamer.connect());
+
+    std::atomic<size_t> handled_deliveries = 0;
+    streamer.consume("queue", [&handled_deliveries](const Delivery&)
+    {
+        ++handled_deliveries;
+    });
+    UNIT_CHECK(UnitTest::waitFor([&broker]()
+    {
+        return broker.ackedDeliveries() == 100;
+    }, std::chrono::seconds(10)));
+
+    // The broker delivers its messages again to the consumer opened on the new connection
+    broker.dropConnections();
+    UNIT_CHECK(streamer.connect());
+    UNIT_CHECK(UnitTest::waitFor([&broker]()
+    {
+        return broker.ackedDeliveries() == 200;
+    }, std::chrono::seconds(10)));
+    UNIT_CHECK(handled_deliveries == 200);
+}
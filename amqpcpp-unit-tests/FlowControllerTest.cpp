@@ -0,0 +1,139 @@
+#include "FlowController.h"
+
+#include "UnitTest.h"
+
+#include <atomic>
+#include <future>
+#include <vector>
+
+using namespace RabbitMqStreamingPlugin;
+
+namespace
+{
+    FlowControlOptions messageWatermarks(FlowControlPolicy policy)
+    {
+        FlowControlOptions options;
+        options.high_watermark_messages_ = 10;
+        options.low_watermark_messages_ = 5;
+        options.policy_ = policy;
+        return options;
+    }
+}
+
+UNIT_TEST(pausesAtTheHighWatermarkAndResumesAtTheLowOne)
+{
+    StreamerMetrics metrics;
+    FlowController flow_controller(messageWatermarks(FlowControlPolicy::Reject), metrics);
+
+    flow_controller.acquire(9, 900);
+    UNIT_CHECK(!flow_controller.isPaused());
+    flow_controller.acquire(1, 100);
+    UNIT_CHECK(flow_controller.isPaused());
+
+    flow_controller.release(4, 400);
+    UNIT_CHECK(flow_controller.isPaused());
+    flow_controller.release(1, 100);
+    UNIT_CHECK(!flow_controller.isPaused());
+
+    const auto statistics = flow_controller.statistics();
+    UNIT_CHECK(statistics.pending_messages_ == 5);
+    UNIT_CHECK(statistics.pending_bytes_ == 500);
+    UNIT_CHECK(metrics.snapshot().flow_control_pauses_ == 1);
+}
+
+UNIT_TEST(boundsTheBytes)
+{
+    StreamerMetrics metrics;
+    FlowControlOptions options;
+    options.high_watermark_bytes_ = 1000;
+    options.low_watermark_bytes_ = 200;
+    options.policy_ = FlowControlPolicy::Reject;
+    FlowController flow_controller(options, metrics);
+
+    // A message crossing the watermark is still admitted
+    flow_controller.acquire(1, 5000);
+    UNIT_CHECK(flow_controller.isPaused());
+    flow_controller.release(1, 5000);
+    UNIT_CHECK(!flow_controller.isPaused());
+}
+
+UNIT_TEST(rejectsWhilePausedWithTheRejectPolicy)
+{
+    StreamerMetrics metrics;
+    FlowController flow_controller(messageWatermarks(FlowControlPolicy::Reject), metrics);
+
+    flow_controller.acquire(10, 0);
+    UNIT_CHECK_THROWS(flow_controller.acquire(1, 0));
+    UNIT_CHECK(!flow_controller.tryAcquire(1, 0));
+    UNIT_CHECK(flow_controller.statistics().pending_messages_ == 10);
+    UNIT_CHECK(metrics.snapshot().flow_control_rejections_ == 2);
+}
+
+UNIT_TEST(blocksUntilResumedWithTheBlockPolicy)
+{
+    StreamerMetrics metrics;
+    FlowController flow_controller(messageWatermarks(FlowControlPolicy::Block), metrics);
+    flow_controller.acquire(10, 0);
+
+    auto blocked = std::async(std::launch::async, [&flow_controller]()
+    {
+        flow_controller.acquire(1, 0);
+    });
+    UNIT_CHECK(blocked.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout);
+
+    flow_controller.release(5, 0);
+    UNIT_CHECK(blocked.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    blocked.get();
+    UNIT_CHECK(flow_controller.statistics().pending_messages_ == 6);
+    // tryAcquire never blocks
+    flow_controller.acquire(4, 0);
+    UNIT_CHECK(!flow_controller.tryAcquire(1, 0));
+}
+
+UNIT_TEST(stopsBlockingAfterTheMaximumBlockTime)
+{
+    StreamerMetrics metrics;
+    auto options = messageWatermarks(FlowControlPolicy::Block);
+    options.max_block_time_ = std::chrono::milliseconds(20);
+    FlowController flow_controller(options, metrics);
+
+    flow_controller.acquire(10, 0);
+    UNIT_CHECK_THROWS(flow_controller.acquire(1, 0));
+    UNIT_CHECK(flow_controller.statistics().pending_messages_ == 10);
+}
+
+UNIT_TEST(notifiesAndAcceptsWithTheCallbackPolicy)
+{
+    StreamerMetrics metrics;
+    std::vector<bool> changes;
+    auto options = messageWatermarks(FlowControlPolicy::Callback);
+    options.on_flow_change_ = [&changes](bool is_paused)
+    {
+        changes.push_back(is_paused);
+    };
+    FlowController flow_controller(options, metrics);
+
+    flow_controller.acquire(10, 0);
+    flow_controller.acquire(1, 0);
+    UNIT_CHECK(flow_controller.tryAcquire(1, 0));
+    flow_controller.release(12, 0);
+    UNIT_CHECK((changes == std::vector<bool>{ true, false }));
+}
+
+UNIT_TEST(pausesWhileTheBrokerBlocksAnyConnection)
+{
+    StreamerMetrics metrics;
+    FlowController flow_controller(messageWatermarks(FlowControlPolicy::Reject), metrics);
+
+    flow_controller.onBrokerBlocked("low on memory");
+    flow_controller.onBrokerBlocked("low on disk");
+    UNIT_CHECK(flow_controller.isPaused());
+    UNIT_CHECK(flow_controller.statistics().blocked_connections_ == 2);
+    UNIT_CHECK(!flow_controller.tryAcquire(1, 0));
+
+    flow_controller.onBrokerUnblocked();
+    UNIT_CHECK(flow_controller.isPaused());
+    flow_controller.onBrokerUnblocked();
+    UNIT_CHECK(!flow_controller.isPaused());
+    UNIT_CHECK(flow_controller.tryAcquire(1, 0));
+}
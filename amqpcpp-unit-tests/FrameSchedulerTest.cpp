@@ -0,0 +1,189 @@
+#include "FrameScheduler.h"
+
+#include "UnitTest.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace RabbitMqStreamingPlugin;
+
+namespace
+{
+    constexpr uint8_t method_frame__ = 1;
+    constexpr uint8_t body_frame__ = 3;
+    constexpr uint8_t heartbeat_frame__ = 8;
+
+    std::string frame(uint8_t type, uint16_t channel, const std::string& payload)
+    {
+        std::string data;
+        data.push_back(static_cast<char>(type));
+        data.push_back(static_cast<char>(channel >> 8));
+        data.push_back(static_cast<char>(channel & 0xFF));
+        const auto size = static_cast<uint32_t>(payload.size());
+        for (int shift = 24; shift >= 0; shift -= 8)
+        {
+            data.push_back(static_cast<char>((size >> shift) & 0xFF));
+        }
+        data += payload;
+        data.push_back(static_cast<char>(0xCE));
+        return data;
+    }
+
+    std::string method(uint16_t channel, uint16_t class_id, uint16_t method_id, const std::string& arguments = "")
+    {
+        std::string payload;
+        payload.push_back(static_cast<char>(class_id >> 8));
+        payload.push_back(static_cast<char>(class_id & 0xFF));
+        payload.push_back(static_cast<char>(method_id >> 8));
+        payload.push_back(static_cast<char>(method_id & 0xFF));
+        return frame(method_frame__, channel, payload + arguments);
+    }
+
+    std::string heartbeat()
+    {
+        return frame(heartbeat_frame__, 0, "");
+    }
+
+    void append(FrameScheduler& scheduler, const std::string& data)
+    {
+        scheduler.append(data.data(), data.size());
+    }
+
+    // Gathers then consumes one write
+    std::string write(FrameScheduler& scheduler, size_t max_bytes, size_t max_buffers = 1000)
+    {
+        std::vector<boost::asio::const_buffer> buffers;
+        const size_t size = scheduler.gather(buffers, max_bytes, max_buffers);
+        std::string data(size, '\0');
+        UNIT_CHECK(boost::asio::buffer_copy(boost::asio::buffer(data), buffers) == size);
+        scheduler.consume(size);
+        return data;
+    }
+
+    // Opens channel 1 in the normal lane and channel 2 in the high one, returns what was appended
+    std::string openChannels(FrameScheduler& scheduler)
+    {
+        const std::string protocol_header("AMQP\0\0\x09\x01", 8);
+        append(scheduler, protocol_header);
+        append(scheduler, method(1, 20, 10));
+        scheduler.setOpeningChannelPriority(FramePriority::High);
+        append(scheduler, method(2, 20, 10));
+        scheduler.setOpeningChannelPriority(FramePriority::Normal);
+        return protocol_header + method(1, 20, 10) + method(2, 20, 10);
+    }
+}
+
+UNIT_TEST(writesTheControlLaneThenTheHighOneFirst)
+{
+    FrameScheduler scheduler(100, 4, 4, 1);
+    const std::string control_frames = openChannels(scheduler);
+
+    std::string bulk_frames;
+    for (int index = 0; index < 10; ++index)
+    {
+        const auto body = frame(body_frame__, 1, std::string(3000, static_cast<char>('a' + index)));
+        append(scheduler, body);
+        bulk_frames += body;
+    }
+    const auto ack = method(2, 60, 80, std::string(9, 'x'));
+    append(scheduler, ack);
+    append(scheduler, heartbeat());
+
+    UNIT_CHECK(write(scheduler, 1 << 20) == control_frames + heartbeat() + ack + bulk_frames);
+    UNIT_CHECK(scheduler.empty() && scheduler.pendingBytes() == 0);
+}
+
+UNIT_TEST(gathersOnlyWholeFrames)
+{
+    FrameScheduler scheduler(100, 4, 4, 1);
+    for (int index = 0; index < 10; ++index)
+    {
+        append(scheduler, frame(body_frame__, 1, std::string(3000, 'a')));
+    }
+    append(scheduler, heartbeat());
+
+    const auto data = write(scheduler, 8000);
+    UNIT_CHECK(data.size() == heartbeat().size() + 2 * 3008);
+    UNIT_CHECK(data.compare(0, heartbeat().size(), heartbeat()) == 0);
+    UNIT_CHECK(write(scheduler, 1 << 20).size() == 8 * 3008);
+
+    // A frame larger than the write still goes out alone
+    const auto large_frame = frame(body_frame__, 1, std::string(1000, 'z'));
+    append(scheduler, large_frame);
+    UNIT_CHECK(write(scheduler, 10, 2) == large_frame);
+
+    // The buffer count bounds the write, chunk boundaries included
+    const auto small_frame = frame(body_frame__, 1, std::string(50, 'a'));
+    const auto spanning_frame = frame(body_frame__, 1, std::string(300, 'b'));
+    append(scheduler, small_frame);
+    append(scheduler, spanning_frame);
+    UNIT_CHECK(write(scheduler, 1 << 20, 2) == small_frame);
+    UNIT_CHECK(write(scheduler, 1 << 20) == spanning_frame);
+}
+
+UNIT_TEST(sharesTheWritesByTheLaneWeights)
+{
+    FrameScheduler scheduler(100, 4, 4, 1);
+    openChannels(scheduler);
+    write(scheduler, 1 << 20);
+
+    for (int index = 0; index < 40; ++index)
+    {
+        append(scheduler, frame(body_frame__, 1, std::string(3000, 'n')));
+        append(scheduler, frame(body_frame__, 2, std::string(1000, 'h')));
+    }
+    const auto data = write(scheduler, 40000);
+    const auto high_bytes = std::count(data.begin(), data.end(), 'h');
+    const auto normal_bytes = std::count(data.begin(), data.end(), 'n');
+    UNIT_CHECK(high_bytes > normal_bytes);
+    // The normal lane is not starved
+    UNIT_CHECK(normal_bytes > 0);
+}
+
+UNIT_TEST(reassemblesTheFramesAppendedInPieces)
+{
+    FrameScheduler scheduler(100, 4, 4, 1);
+
+    const auto body = frame(body_frame__, 2, std::string(500, 'p'));
+    scheduler.append(body.data(), 10);
+    UNIT_CHECK(scheduler.empty());
+    std::vector<boost::asio::const_buffer> buffers;
+    UNIT_CHECK(scheduler.gather(buffers, 1000, 10) == 0);
+    scheduler.append(body.data() + 10, body.size() - 10);
+    UNIT_CHECK(write(scheduler, 1 << 20) == body);
+
+    // Several frames in a single append are split between their lanes
+    append(scheduler, frame(body_frame__, 1, "abc") + heartbeat());
+    UNIT_CHECK(write(scheduler, 1 << 20) == heartbeat() + frame(body_frame__, 1, "abc"));
+
+    // A frame header is never split by AMQP-CPP
+    const auto truncated_header = frame(body_frame__, 1, "abc").substr(0, 4);
+    UNIT_CHECK_THROWS(append(scheduler, truncated_header));
+}
+
+UNIT_TEST(writesTheConnectionCloseAfterEveryQueuedFrame)
+{
+    FrameScheduler scheduler(100, 4, 4, 1);
+    openChannels(scheduler);
+    write(scheduler, 1 << 20);
+
+    const auto high_frame = frame(body_frame__, 2, std::string(5000, 'h'));
+    const auto normal_frame = frame(body_frame__, 1, std::string(5000, 'l'));
+    for (int index = 0; index < 4; ++index)
+    {
+        append(scheduler, normal_frame);
+        append(scheduler, high_frame);
+    }
+    const auto close = method(0, 10, 50, "abc");
+    append(scheduler, close);
+
+    std::string data;
+    while (!scheduler.empty())
+    {
+        data += write(scheduler, 12000);
+    }
+    UNIT_CHECK(data.size() == 4 * (high_frame.size() + normal_frame.size()) + close.size());
+    UNIT_CHECK(data.compare(data.size() - close.size(), close.size(), close) == 0);
+}
@@ -0,0 +1,139 @@
+#include "HandlerAllocator.h"
+#include "PublishCompletion.h"
+
+#include "UnitTest.h"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+
+#include <array>
+#include <memory>
+
+using namespace RabbitMqStreamingPlugin;
+
+UNIT_TEST(reusesTheBlocksGivenBack)
+{
+    const auto memory = HandlerMemory::create(128, 4);
+
+    void* first = memory->allocate(100);
+    memory->deallocate(first, 100);
+    UNIT_CHECK(memory->heapAllocations() == 1);
+
+    // The last block given back is taken first
+    void* second = memory->allocate(64);
+    UNIT_CHECK(second == first);
+    memory->deallocate(second, 64);
+    UNIT_CHECK(memory->heapAllocations() == 1);
+}
+
+UNIT_TEST(allocatesTheLargerHandlersOnTheHeap)
+{
+    const auto memory = HandlerMemory::create(128, 4);
+
+    void* block = memory->allocate(128);
+    memory->deallocate(block, 128);
+    for (int round = 0; round < 3; ++round)
+    {
+        void* large = memory->allocate(129);
+        memory->deallocate(large, 129);
+    }
+    UNIT_CHECK(memory->heapAllocations() == 4);
+
+    // The block is still free for the handlers that fit
+    void* reused = memory->allocate(16);
+    UNIT_CHECK(reused == block);
+    memory->deallocate(reused, 16);
+}
+
+UNIT_TEST(keepsAtMostTheMaximumFreeBlocks)
+{
+    const auto memory = HandlerMemory::create(64, 2);
+
+    std::array<void*, 4> blocks{};
+    for (auto& block : blocks)
+    {
+        block = memory->allocate(64);
+    }
+    for (void* block : blocks)
+    {
+        memory->deallocate(block, 64);
+    }
+    UNIT_CHECK(memory->heapAllocations() == 4);
+
+    // Two blocks were kept, the other two freed
+    for (auto& block : blocks)
+    {
+        block = memory->allocate(64);
+    }
+    UNIT_CHECK(memory->heapAllocations() == 6);
+    for (void* block : blocks)
+    {
+        memory->deallocate(block, 64);
+    }
+}
+
+UNIT_TEST(recyclesThePostedHandlers)
+{
+    boost::asio::io_context io_context;
+    const auto memory = HandlerMemory::create(256, 16);
+
+    size_t calls = 0;
+    for (int round = 0; round < 100; ++round)
+    {
+        boost::asio::post(io_context, bindHandlerMemory(*memory, [&calls]()
+        {
+            ++calls;
+        }));
+        io_context.run();
+        io_context.restart();
+    }
+    UNIT_CHECK(calls == 100);
+    UNIT_CHECK(memory->heapAllocations() == 1);
+}
+
+UNIT_TEST(completesThePublishesWithTheHandlerMemory)
+{
+    boost::asio::io_context io_context;
+    const auto memory = HandlerMemory::create(256, 16);
+
+    size_t confirmed = 0;
+    for (int round = 0; round < 100; ++round)
+    {
+        // The completion and the posted handler take the same block in turn
+        PublishCompletion completion(bindHandlerMemory(*memory, [&confirmed](std::exception_ptr exception)
+        {
+            confirmed += exception == nullptr ? 1 : 0;
+        }));
+        completion.complete(nullptr, io_context.get_executor());
+        io_context.run();
+        io_context.restart();
+    }
+    UNIT_CHECK(confirmed == 100);
+    UNIT_CHECK(memory->heapAllocations() == 1);
+}
+
+UNIT_TEST(outlivesItsHandleWhileHandlersAreQueued)
+{
+    boost::asio::io_context io_context;
+    bool is_called = false;
+    {
+        auto memory = HandlerMemory::create(256, 16);
+        boost::asio::post(io_context, bindHandlerMemory(*memory, [&is_called]()
+        {
+            is_called = true;
+        }));
+        // Released by its owner, the memory waits for the queued handler
+    }
+    io_context.run();
+    UNIT_CHECK(is_called);
+
+    // A handler destroyed without running gives its block back too
+    {
+        auto memory = HandlerMemory::create(256, 16);
+        boost::asio::io_context stopped_io_context;
+        boost::asio::post(stopped_io_context, bindHandlerMemory(*memory, []()
+        {
+        }));
+        memory.reset();
+    }
+}
@@ -0,0 +1,277 @@
+#include "FlowController.h"
+#include "MessageAggregator.h"
+#include "MessageContainer.h"
+
+#include "UnitTest.h"
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace RabbitMqStreamingPlugin;
+
+namespace
+{
+    // Records the submitted containers, completed later by the test from the broker thread
+    class Broker
+    {
+    public:
+        explicit Broker(const FlowControlOptions& flow_control = FlowControlOptions())
+            : flow_controller_(flow_control, metrics_)
+            , work_(boost::asio::make_work_guard(io_context_))
+            , thread_([this]()
+            {
+                io_context_.run();
+            })
+        {
+        }
+
+        ~Broker()
+        {
+            work_.reset();
+            thread_.join();
+        }
+
+        FlowController& flowController()
+        {
+            return flow_controller_;
+        }
+
+        MessageAggregator::SubmitContainer submitContainer()
+        {
+            return [this](OutgoingMessage container, PublishCompletion completion)
+            {
+                std::unique_lock lock(mutex_);
+                containers_.push_back(std::move(container));
+                completions_.push_back(std::move(completion));
+            };
+        }
+
+        size_t containerCount()
+        {
+            std::unique_lock lock(mutex_);
+            return containers_.size();
+        }
+
+        std::vector<std::string> bodiesOf(size_t index)
+        {
+            std::unique_lock lock(mutex_);
+            std::vector<std::string> bodies;
+            for (const auto body : MessageContainer::decode(containers_.at(index).message_.view()))
+            {
+                bodies.emplace_back(body);
+            }
+            return bodies;
+        }
+
+        OutgoingMessage containerAt(size_t index)
+        {
+            std::unique_lock lock(mutex_);
+            return containers_.at(index);
+        }
+
+        // Settles every container submitted so far
+        void completeAll(std::exception_ptr exception)
+        {
+            std::unique_lock lock(mutex_);
+            for (auto& completion : completions_)
+            {
+                completion.complete(exception, io_context_.get_executor());
+            }
+            completions_.clear();
+        }
+
+    private:
+        StreamerMetrics metrics_;
+        FlowController flow_controller_;
+
+        boost::asio::io_context io_context_;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_;
+        std::thread thread_;
+
+        std::mutex mutex_;
+        std::vector<OutgoingMessage> containers_;
+        std::vector<PublishCompletion> completions_;
+    };
+
+    AggregationOptions aggregation(size_t max_messages, size_t max_bytes, std::chrono::microseconds linger)
+    {
+        AggregationOptions options;
+        options.is_enabled_ = true;
+        options.max_messages_ = max_messages;
+        options.max_bytes_ = max_bytes;
+        options.linger_ = linger;
+        return options;
+    }
+
+    OutgoingMessage message(const std::string& partition_key, const std::string& body)
+    {
+        return OutgoingMessage{ "topic", partition_key, "Event", body };
+    }
+}
+
+UNIT_TEST(sealsTheContainersAtTheMaximumMessageCount)
+{
+    Broker broker;
+    MessageAggregator aggregator(aggregation(3, 1024 * 1024, std::chrono::seconds(60)),
+        broker.flowController(), broker.submitContainer());
+
+    for (int index = 0; index < 7; ++index)
+    {
+        aggregator.add(message("key", std::to_string(index)), PublishCompletion());
+    }
+    UNIT_CHECK(broker.containerCount() == 2);
+    UNIT_CHECK((broker.bodiesOf(0) == std::vector<std::string>{ "0", "1", "2" }));
+    UNIT_CHECK((broker.bodiesOf(1) == std::vector<std::string>{ "3", "4", "5" }));
+
+    const auto container = broker.containerAt(0);
+    UNIT_CHECK(container.is_container_);
+    UNIT_CHECK(container.topic_ == "topic" && container.partition_key_ == "key");
+    UNIT_CHECK(container.event_type_name_ == "Event");
+
+    aggregator.flush();
+    UNIT_CHECK(broker.containerCount() == 3);
+    UNIT_CHECK((broker.bodiesOf(2) == std::vector<std::string>{ "6" }));
+    broker.completeAll(nullptr);
+}
+
+UNIT_TEST(sealsTheContainersAtTheMaximumByteCount)
+{
+    Broker broker;
+    // Two 100 bytes messages and their size prefix fit, a third one doesn't
+    MessageAggregator aggregator(aggregation(1000, 250, std::chrono::seconds(60)),
+        broker.flowController(), broker.submitContainer());
+
+    for (char letter : { 'a', 'b', 'c' })
+    {
+        aggregator.add(message("key", std::string(100, letter)), PublishCompletion());
+    }
+    UNIT_CHECK(broker.containerCount() == 1);
+    UNIT_CHECK((broker.bodiesOf(0) == std::vector<std::string>{ std::string(100, 'a'), std::string(100, 'b') }));
+
+    // A message larger than the bound gets a container of its own
+    aggregator.add(message("key", std::string(300, 'd')), PublishCompletion());
+    UNIT_CHECK(broker.containerCount() == 3);
+    UNIT_CHECK((broker.bodiesOf(1) == std::vector<std::string>{ std::string(100, 'c') }));
+    UNIT_CHECK((broker.bodiesOf(2) == std::vector<std::string>{ std::string(300, 'd') }));
+    broker.completeAll(nullptr);
+}
+
+UNIT_TEST(publishesTheContainersAfterTheirLingerTime)
+{
+    Broker broker;
+    MessageAggregator aggregator(aggregation(1000, 1024 * 1024, std::chrono::milliseconds(5)),
+        broker.flowController(), broker.submitContainer());
+
+    aggregator.add(message("key", "first"), PublishCompletion());
+    aggregator.add(message("other key", "second"), PublishCompletion());
+    UNIT_CHECK(UnitTest::waitFor([&broker]()
+    {
+        return broker.containerCount() == 2;
+    }, std::chrono::seconds(5)));
+    broker.completeAll(nullptr);
+}
+
+UNIT_TEST(settlesEveryMessageWithTheConfirmOfItsContainer)
+{
+    Broker broker;
+    std::atomic<size_t> confirmed_messages = 0;
+    std::atomic<size_t> failed_messages = 0;
+    {
+        MessageAggregator aggregator(aggregation(4, 1024 * 1024, std::chrono::seconds(60)),
+            broker.flowController(), broker.submitContainer());
+        for (int index = 0; index < 10; ++index)
+        {
+            aggregator.add(message("key", std::to_string(index)), PublishCompletion(
+                [&confirmed_messages, &failed_messages](std::exception_ptr exception)
+            {
+                ++(exception == nullptr ? confirmed_messages : failed_messages);
+            }));
+        }
+        broker.completeAll(nullptr);
+        aggregator.flush();
+        broker.completeAll(std::make_exception_ptr(std::runtime_error("Nacked")));
+        // The aggregator waits for the completions of its containers when destroyed
+    }
+    UNIT_CHECK(confirmed_messages == 8);
+    UNIT_CHECK(failed_messages == 2);
+}
+
+UNIT_TEST(keepsTheOrderOfEveryPartitionKey)
+{
+    constexpr int thread_count = 4;
+    constexpr int message_count = 2000;
+
+    Broker broker;
+    MessageAggregator aggregator(aggregation(50, 2000, std::chrono::milliseconds(1)),
+        broker.flowController(), broker.submitContainer());
+
+    std::vector<std::thread> threads;
+    for (int thread_index = 0; thread_index < thread_count; ++thread_index)
+    {
+        threads.emplace_back([&aggregator, thread_index]()
+        {
+            for (int index = 0; index < message_count; ++index)
+            {
+                aggregator.add(message("key " + std::to_string(thread_index),
+                    std::to_string(index) + ":" + std::string(index % 90, 'x')), PublishCompletion());
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    aggregator.flush();
+
+    std::vector<int> next_index(thread_count, 0);
+    for (size_t container_index = 0; container_index < broker.containerCount(); ++container_index)
+    {
+        const auto key = broker.containerAt(container_index).partition_key_;
+        int& expected_index = next_index.at(std::stoi(key.substr(4)));
+        for (const auto& body : broker.bodiesOf(container_index))
+        {
+            UNIT_CHECK(std::stoi(body.substr(0, body.find(':'))) == expected_index++);
+        }
+    }
+    UNIT_CHECK((next_index == std::vector<int>(thread_count, message_count)));
+    broker.completeAll(nullptr);
+}
+
+UNIT_TEST(countsTheAggregatedMessagesInTheFlowControl)
+{
+    FlowControlOptions flow_control;
+    flow_control.high_watermark_messages_ = 3;
+    flow_control.low_watermark_messages_ = 1;
+    flow_control.policy_ = FlowControlPolicy::Reject;
+    Broker broker(flow_control);
+    std::atomic<size_t> rejected_messages = 0;
+    {
+        MessageAggregator aggregator(aggregation(1000, 1024 * 1024, std::chrono::seconds(60)),
+            broker.flowController(), broker.submitContainer());
+        for (int index = 0; index < 4; ++index)
+        {
+            aggregator.add(message("key", std::to_string(index)), PublishCompletion(
+                [&rejected_messages](std::exception_ptr exception)
+            {
+                rejected_messages += exception == nullptr ? 0 : 1;
+            }));
+        }
+        UNIT_CHECK(broker.flowController().isPaused());
+        UNIT_CHECK(broker.flowController().statistics().pending_messages_ == 3);
+        UNIT_CHECK(rejected_messages == 1);
+
+        // The credit is handed over to the container once submitted
+        aggregator.flush();
+        UNIT_CHECK(broker.containerCount() == 1);
+        UNIT_CHECK(broker.flowController().statistics().pending_messages_ == 0);
+        UNIT_CHECK(!broker.flowController().isPaused());
+        broker.completeAll(nullptr);
+    }
+    UNIT_CHECK(rejected_messages == 1);
+}
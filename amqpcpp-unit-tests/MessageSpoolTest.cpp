@@ -0,0 +1,136 @@
+#include "MessageSpool.h"
+
+#include "UnitTest.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+using namespace RabbitMqStreamingPlugin;
+
+namespace
+{
+    // Spool file removed when the test case ends
+    class TemporarySpoolFile
+    {
+    public:
+        explicit TemporarySpoolFile(const std::string& name)
+            : path_((std::filesystem::temp_directory_path() / ("amqpcpp-unit-tests-" + name + ".spool")).string())
+        {
+            std::remove(path_.c_str());
+        }
+
+        ~TemporarySpoolFile()
+        {
+            std::remove(path_.c_str());
+        }
+
+        const std::string& path() const
+        {
+            return path_;
+        }
+
+    private:
+        const std::string path_;
+    };
+
+    OutgoingMessage message(size_t index)
+    {
+        // 88 bytes records with their header
+        std::string body = "body " + std::to_string(index);
+        body.resize(50, '.');
+        return OutgoingMessage{ "topic", "key", "Event", std::move(body) };
+    }
+
+    std::string bodyOf(const MessageSpool::Record& record)
+    {
+        return std::string(record.message_.message_.view());
+    }
+}
+
+UNIT_TEST(appendsReadsAndReleasesInOrder)
+{
+    TemporarySpoolFile file("order");
+    MessageSpool spool(file.path(), 64 * 1024);
+
+    for (size_t index = 0; index < 5; ++index)
+    {
+        UNIT_CHECK(spool.append(message(index)) == index);
+    }
+
+    auto records = spool.read(1, 3);
+    UNIT_CHECK(records.size() == 3);
+    UNIT_CHECK(records[0].sequence_ == 1 && records[2].sequence_ == 3);
+    UNIT_CHECK(bodyOf(records[0]) == message(1).message_.view());
+    UNIT_CHECK(records[0].message_.topic_ == "topic");
+    UNIT_CHECK(records[0].message_.partition_key_ == "key");
+    UNIT_CHECK(records[0].message_.event_type_name_ == "Event");
+
+    // Released out of order, the head only moves past released records
+    spool.release(1);
+    UNIT_CHECK(spool.firstSequence() == 0);
+    spool.release(0);
+    UNIT_CHECK(spool.firstSequence() == 2);
+    UNIT_CHECK(spool.endSequence() == 5);
+    UNIT_CHECK(spool.statistics().unreleased_records_ == 3);
+}
+
+UNIT_TEST(recoversTheUnreleasedRecordsWhenReopened)
+{
+    TemporarySpoolFile file("recover");
+    {
+        MessageSpool spool(file.path(), 64 * 1024);
+        for (size_t index = 0; index < 4; ++index)
+        {
+            spool.append(message(index));
+        }
+        spool.release(0);
+        spool.release(2);
+    }
+
+    // The capacity of an existing file is kept, the statistics leave out the file header
+    MessageSpool spool(file.path(), 0);
+    UNIT_CHECK(spool.statistics().capacity_ == 64 * 1024 - 64);
+    UNIT_CHECK(spool.firstSequence() == 1);
+    UNIT_CHECK(spool.endSequence() == 4);
+
+    const auto records = spool.read(spool.firstSequence(), 10);
+    UNIT_CHECK(records.size() == 2);
+    UNIT_CHECK(records[0].sequence_ == 1 && bodyOf(records[0]) == message(1).message_.view());
+    UNIT_CHECK(records[1].sequence_ == 3 && bodyOf(records[1]) == message(3).message_.view());
+    UNIT_CHECK(spool.append(message(4)) == 4);
+}
+
+UNIT_TEST(throwsWhenFullAndReusesTheReleasedSpace)
+{
+    TemporarySpoolFile file("full");
+    // Header and four records
+    MessageSpool spool(file.path(), 64 + 4 * 88);
+
+    size_t appended = 0;
+    const auto append_until_full = [&spool, &appended]()
+    {
+        for (; appended < 10; ++appended)
+        {
+            spool.append(message(appended));
+        }
+    };
+    UNIT_CHECK_THROWS(append_until_full());
+    UNIT_CHECK(appended >= 3 && appended <= 4);
+
+    // The tail wraps to the start of the data area
+    spool.release(0);
+    spool.release(1);
+    UNIT_CHECK(spool.append(message(appended)) == appended);
+    const auto records = spool.read(spool.firstSequence(), 10);
+    UNIT_CHECK(records.size() == appended - 1);
+    UNIT_CHECK(bodyOf(records.back()) == message(appended).message_.view());
+}
+
+UNIT_TEST(rejectsACapacityTooSmallBeforeCreatingTheFile)
+{
+    TemporarySpoolFile file("small");
+    UNIT_CHECK_THROWS(MessageSpool(file.path(), 0));
+    UNIT_CHECK_THROWS(MessageSpool(file.path(), 64));
+    UNIT_CHECK(!std::filesystem::exists(file.path()));
+}
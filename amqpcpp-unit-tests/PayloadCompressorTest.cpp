@@ -0,0 +1,178 @@
+#include "PayloadCompressor.h"
+
+#include "UnitTest.h"
+
+#if defined(AMQPCPP_STREAMER_WITH_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(AMQPCPP_STREAMER_WITH_ZSTD)
+#include <zstd.h>
+#endif
+
+#include <cstring>
+#include <random>
+#include <string>
+
+using namespace RabbitMqStreamingPlugin;
+
+namespace
+{
+    // Repetitive enough to shrink, and sharing its field names with the dictionary
+    std::string compressibleBody()
+    {
+        std::string body;
+        for (int index = 0; index < 40; ++index)
+        {
+            body += "user_id=" + std::to_string(index) + ";session_id=" + std::to_string(index * 7) + ";";
+        }
+        return body;
+    }
+
+#if defined(AMQPCPP_STREAMER_WITH_ZLIB) || defined(AMQPCPP_STREAMER_WITH_ZSTD)
+    std::string dictionary()
+    {
+        std::string data;
+        for (int index = 0; index < 50; ++index)
+        {
+            data += "user_id=;session_id=;";
+        }
+        return data;
+    }
+#endif
+
+    CompressionOptions options(CompressionAlgorithm algorithm)
+    {
+        CompressionOptions compression;
+        compression.algorithm_ = algorithm;
+        compression.min_size_ = 100;
+        return compression;
+    }
+
+#if defined(AMQPCPP_STREAMER_WITH_ZLIB)
+    std::string inflateBody(const MessageBody& body, size_t size, const std::string* preset_dictionary)
+    {
+        std::string output(size, '\0');
+        z_stream stream{};
+        UNIT_CHECK(inflateInit(&stream) == Z_OK);
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+        stream.avail_in = static_cast<uInt>(body.size());
+        stream.next_out = reinterpret_cast<Bytef*>(output.data());
+        stream.avail_out = static_cast<uInt>(output.size());
+        int result = inflate(&stream, Z_FINISH);
+        if (result == Z_NEED_DICT && preset_dictionary != nullptr)
+        {
+            UNIT_CHECK(inflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(preset_dictionary->data()),
+                static_cast<uInt>(preset_dictionary->size())) == Z_OK);
+            result = inflate(&stream, Z_FINISH);
+        }
+        inflateEnd(&stream);
+        UNIT_CHECK(result == Z_STREAM_END);
+        output.resize(stream.total_out);
+        return output;
+    }
+#endif
+}
+
+UNIT_TEST(leavesTheBodiesAloneWhenDisabled)
+{
+    StreamerMetrics metrics;
+    PayloadCompressor compressor(CompressionOptions(), metrics);
+
+    UNIT_CHECK(!compressor.isEnabled());
+    const auto body = compressor.compress("Event", MessageBody(compressibleBody()));
+    UNIT_CHECK(body.view() == compressibleBody());
+    UNIT_CHECK(body.contentEncoding() == nullptr);
+}
+
+UNIT_TEST(namesTheContentEncodings)
+{
+    UNIT_CHECK(std::strcmp(PayloadCompressor::contentEncoding(CompressionAlgorithm::Zlib), "deflate") == 0);
+    UNIT_CHECK(std::strcmp(PayloadCompressor::contentEncoding(CompressionAlgorithm::Zstd), "zstd") == 0);
+    UNIT_CHECK(PayloadCompressor::contentEncoding(CompressionAlgorithm::None) == nullptr);
+}
+
+#if defined(AMQPCPP_STREAMER_WITH_ZLIB)
+UNIT_TEST(compressesWithZlib)
+{
+    StreamerMetrics metrics;
+    PayloadCompressor compressor(options(CompressionAlgorithm::Zlib), metrics);
+
+    const std::string original = compressibleBody();
+    const auto body = compressor.compress("Event", MessageBody(original));
+    UNIT_CHECK(body.contentEncoding() != nullptr && std::strcmp(body.contentEncoding(), "deflate") == 0);
+    UNIT_CHECK(body.size() < original.size());
+    UNIT_CHECK(inflateBody(body, original.size(), nullptr) == original);
+    UNIT_CHECK(metrics.snapshot().compressed_messages_ == 1);
+}
+
+UNIT_TEST(compressesWithTheZlibDictionaryOfTheEventType)
+{
+    StreamerMetrics metrics;
+    auto compression = options(CompressionAlgorithm::Zlib);
+    compression.dictionaries_["Event"] = dictionary();
+    PayloadCompressor compressor(compression, metrics);
+
+    const std::string original = compressibleBody();
+    const auto body = compressor.compress("Event", MessageBody(original));
+    const std::string preset_dictionary = dictionary();
+    UNIT_CHECK(inflateBody(body, original.size(), &preset_dictionary) == original);
+}
+#else
+UNIT_TEST(rejectsZlibWhenBuiltWithout)
+{
+    StreamerMetrics metrics;
+    UNIT_CHECK_THROWS(PayloadCompressor(options(CompressionAlgorithm::Zlib), metrics));
+}
+#endif
+
+#if defined(AMQPCPP_STREAMER_WITH_ZSTD)
+UNIT_TEST(compressesWithTheZstdDictionaryOfTheEventType)
+{
+    StreamerMetrics metrics;
+    auto compression = options(CompressionAlgorithm::Zstd);
+    compression.dictionaries_["Event"] = dictionary();
+    PayloadCompressor compressor(compression, metrics);
+
+    const std::string original = compressibleBody();
+    for (const char* event_type_name : { "Event", "OtherEvent" })
+    {
+        const auto body = compressor.compress(event_type_name, MessageBody(original));
+        UNIT_CHECK(body.contentEncoding() != nullptr && std::strcmp(body.contentEncoding(), "zstd") == 0);
+
+        std::string output(original.size(), '\0');
+        const std::string preset_dictionary = dictionary();
+        ZSTD_DCtx* context = ZSTD_createDCtx();
+        const size_t size = ZSTD_decompress_usingDict(context, output.data(), output.size(), body.data(),
+            body.size(), preset_dictionary.data(), preset_dictionary.size());
+        ZSTD_freeDCtx(context);
+        UNIT_CHECK(!ZSTD_isError(size) && output.substr(0, size) == original);
+    }
+}
+#else
+UNIT_TEST(rejectsZstdWhenBuiltWithout)
+{
+    StreamerMetrics metrics;
+    UNIT_CHECK_THROWS(PayloadCompressor(options(CompressionAlgorithm::Zstd), metrics));
+}
+#endif
+
+#if defined(AMQPCPP_STREAMER_WITH_ZLIB)
+UNIT_TEST(keepsTheSmallAndIncompressibleBodies)
+{
+    StreamerMetrics metrics;
+    PayloadCompressor compressor(options(CompressionAlgorithm::Zlib), metrics);
+
+    const auto small_body = compressor.compress("Event", MessageBody(std::string(99, 'a')));
+    UNIT_CHECK(small_body.contentEncoding() == nullptr && small_body.size() == 99);
+
+    std::mt19937 random(42);
+    std::string noise(4096, '\0');
+    for (auto& byte : noise)
+    {
+        byte = static_cast<char>(random());
+    }
+    const auto noisy_body = compressor.compress("Event", MessageBody(noise));
+    UNIT_CHECK(noisy_body.contentEncoding() == nullptr && noisy_body.view() == noise);
+    UNIT_CHECK(metrics.snapshot().compressed_messages_ == 0);
+}
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "AmqpCppStreamer.h"
+#include "FakeBroker.h"
+
+#include <exception>
+
+namespace RabbitMqStreamingPlugin
+{
+    namespace UnitTest
+    {
+        // Connects to the fake broker, which accepts any credentials
+        inline RabbitMqServerConfig serverConfig(const Bench::FakeBroker& broker)
+        {
+            return RabbitMqServerConfig{ "127.0.0.1", broker.port(), "/", "guest", "guest" };
+        }
+
+        // Error callback of the streamers whose errors are checked through their publishes instead
+        inline void ignoreError(std::exception_ptr)
+        {
+        }
+    }  // namespace UnitTest
+}  // namespace RabbitMqStreamingPlugin
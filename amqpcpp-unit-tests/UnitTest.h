@@ -0,0 +1,118 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace RabbitMqStreamingPlugin
+{
+    namespace UnitTest
+    {
+        /*
+         * Minimal test registry: every UNIT_TEST of a program registers itself and runAll runs them in order. A failed
+         * check throws, which ends its test case, and the program exits with a failure code for CTest once every test
+         * case has run.
+         */
+        using TestFunction = void (*)();
+
+        struct TestCase
+        {
+            const char* name_;
+            TestFunction function_;
+        };
+
+        class CheckFailure : public std::runtime_error
+        {
+        public:
+            using std::runtime_error::runtime_error;
+        };
+
+        inline std::vector<TestCase>& testCases()
+        {
+            static std::vector<TestCase> test_cases;
+            return test_cases;
+        }
+
+        struct Registration
+        {
+            Registration(const char* name, TestFunction function)
+            {
+                testCases().push_back(TestCase{ name, function });
+            }
+        };
+
+        inline void check(bool condition, const char* expression, const char* file, int line)
+        {
+            if (!condition)
+            {
+                throw CheckFailure(std::string(file) + ":" + std::to_string(line) + ": check failed: " + expression);
+            }
+        }
+
+        // Polls the condition until it holds or the timeout expires, returns whether it held
+        inline bool waitFor(const std::function<bool()>& condition, std::chrono::milliseconds timeout)
+        {
+            const auto deadline = std::chrono::steady_clock::now() + timeout;
+            while (!condition())
+            {
+                if (std::chrono::steady_clock::now() >= deadline)
+                {
+                    return false;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return true;
+        }
+
+        // Returns the exit code of the test program
+        inline int runAll()
+        {
+            size_t failures = 0;
+            for (const auto& test_case : testCases())
+            {
+                try
+                {
+                    test_case.function_();
+                    std::printf("[ OK ] %s\n", test_case.name_);
+                }
+                catch (const std::exception& e)
+                {
+                    ++failures;
+                    std::printf("[FAIL] %s: %s\n", test_case.name_, e.what());
+                }
+            }
+            std::printf("%zu test case(s), %zu failure(s)\n", testCases().size(), failures);
+            return failures == 0 ? 0 : 1;
+        }
+
+    }  // namespace UnitTest
+}  // namespace RabbitMqStreamingPlugin
+
+#define UNIT_TEST(name) \
+    static void name(); \
+    static const ::RabbitMqStreamingPlugin::UnitTest::Registration name##_registration__(#name, &name); \
+    static void name()
+
+#define UNIT_CHECK(condition) \
+    ::RabbitMqStreamingPlugin::UnitTest::check(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
+
+#define UNIT_CHECK_THROWS(expression) \
+    do \
+    { \
+        bool has_thrown = false; \
+        try \
+        { \
+            expression; \
+        } \
+        catch (const std::exception&) \
+        { \
+            has_thrown = true; \
+        } \
+        ::RabbitMqStreamingPlugin::UnitTest::check(has_thrown, #expression " throws", __FILE__, __LINE__); \
+    } while (false)
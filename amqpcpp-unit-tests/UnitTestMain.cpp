@@ -0,0 +1,6 @@
+#include "UnitTest.h"
+
+int main()
+{
+    return RabbitMqStreamingPlugin::UnitTest::runAll();
+}
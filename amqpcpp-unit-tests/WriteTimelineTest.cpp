@@ -0,0 +1,66 @@
+#include "WriteTimeline.h"
+
+#include "UnitTest.h"
+
+#include <chrono>
+
+using namespace RabbitMqStreamingPlugin;
+
+namespace
+{
+    MetricsClock::time_point at(int milliseconds)
+    {
+        return MetricsClock::time_point(std::chrono::milliseconds(milliseconds));
+    }
+}
+
+UNIT_TEST(countsTheQueuedBytes)
+{
+    WriteTimeline timeline(4);
+    UNIT_CHECK(timeline.queuedBytes() == 0);
+    timeline.onQueued(100);
+    timeline.onQueued(20);
+    UNIT_CHECK(timeline.queuedBytes() == 120);
+}
+
+UNIT_TEST(findsTheWriteSendingTheEndOfAMessage)
+{
+    WriteTimeline timeline(8);
+    timeline.onQueued(300);
+    timeline.onWritten(100, at(1));
+    timeline.onWritten(150, at(2));
+
+    UNIT_CHECK(timeline.writtenAt(1) == at(1));
+    UNIT_CHECK(timeline.writtenAt(100) == at(1));
+    UNIT_CHECK(timeline.writtenAt(101) == at(2));
+    UNIT_CHECK(timeline.writtenAt(250) == at(2));
+    // Queued but not written yet
+    UNIT_CHECK(!timeline.writtenAt(251));
+    UNIT_CHECK(!timeline.writtenAt(0));
+
+    timeline.onWritten(50, at(3));
+    UNIT_CHECK(timeline.writtenAt(300) == at(3));
+}
+
+UNIT_TEST(forgetsTheWritesOlderThanItsCapacity)
+{
+    WriteTimeline timeline(2);
+    timeline.onQueued(30);
+    timeline.onWritten(10, at(1));
+    timeline.onWritten(10, at(2));
+    timeline.onWritten(10, at(3));
+
+    UNIT_CHECK(!timeline.writtenAt(5));
+    UNIT_CHECK(!timeline.writtenAt(10));
+    UNIT_CHECK(timeline.writtenAt(11) == at(2));
+    UNIT_CHECK(timeline.writtenAt(30) == at(3));
+
+    // The ring wraps around many times without growing
+    for (int write = 4; write < 100; ++write)
+    {
+        timeline.onWritten(10, at(write));
+    }
+    UNIT_CHECK(timeline.writtenAt(971) == at(98));
+    UNIT_CHECK(timeline.writtenAt(990) == at(99));
+    UNIT_CHECK(!timeline.writtenAt(970));
+}